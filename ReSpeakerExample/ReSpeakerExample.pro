@@ -18,6 +18,14 @@ SUBDIRS += 3rdparty/fftreal/fftreal.pro
 
 SUBDIRS += src
 
+SUBDIRS += tracedump
+
+SUBDIRS += hidbench
+
+SUBDIRS += analysisbench
+
+SUBDIRS += daemon
+
 
 FORMS    += mainwindow.ui
 
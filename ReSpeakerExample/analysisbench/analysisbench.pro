@@ -0,0 +1,17 @@
+# CPU and memory cost of the daemon's analysis, outside Qt
+TEMPLATE = app
+
+TARGET = analysisbench
+
+CONFIG   += console c++11
+CONFIG   -= qt app_bundle
+
+include(../../src/respeaker.pri)
+
+# FFTRealFixLen is header only
+INCLUDEPATH += ../3rdparty/fftreal
+
+SOURCES += main.cpp
+
+LIBS += /usr/lib/aarch64-linux-gnu/libusb-1.0.so
+LIBS += /usr/lib/aarch64-linux-gnu/libpthread.so
@@ -0,0 +1,50 @@
+# Headless capture and analysis, without Qt Widgets
+include(../src/micarray.pri)
+include(../../src/respeaker.pri)
+
+TEMPLATE = app
+
+TARGET = respeakerd
+
+QT        = core multimedia
+
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+# The audio and analysis side of the example; none of it paints
+app_dir = ../src
+INCLUDEPATH += $${app_dir}
+
+SOURCES += main.cpp \
+    respeakerdaemon.cpp \
+    $${app_dir}/audiointerface.cpp \
+    $${app_dir}/wavfile.cpp \
+    $${app_dir}/utils.cpp \
+    $${app_dir}/tonegenerator.cpp \
+    $${app_dir}/spectrumanalyser.cpp \
+    $${app_dir}/frequencyspectrum.cpp \
+    $${app_dir}/respeakernotifier.cpp
+
+HEADERS += respeakerdaemon.h \
+    $${app_dir}/audiointerface.h \
+    $${app_dir}/wavfile.h \
+    $${app_dir}/utils.h \
+    $${app_dir}/spectrumanalyser.h \
+    $${app_dir}/frequencyspectrum.h \
+    $${app_dir}/respeakernotifier.h
+
+LIBS += /usr/lib/aarch64-linux-gnu/libusb-1.0.so
+LIBS += /usr/lib/aarch64-linux-gnu/libpthread.so
+
+INCLUDEPATH += /usr/include/libusb-1.0/
+
+fftreal_dir = ../3rdparty/fftreal
+INCLUDEPATH += $${fftreal_dir}
+
+hidapi_dir = ../../hidapi/hidapi/
+INCLUDEPATH += $${hidapi_dir}
+
+!contains(DEFINES, DISABLE_FFT) {
+    LIBS += -L..$${spectrum_build_dir}
+    LIBS += -lfftreal
+}
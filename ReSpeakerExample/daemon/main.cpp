@@ -0,0 +1,57 @@
+// Headless capture and analysis, for boxes without a display. See
+// respeakerdaemon.h for what runs and README.md for the footprint.
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <iostream>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "respeakerdaemon.h"
+#include "../../src/respeakermicarray.h"
+
+// SIGINT and SIGTERM are turned into a write on this socket, read from the
+// event loop, since nothing else is safe to do in a signal handler
+static int signalSockets[2];
+
+static void handleSignal(int)
+{
+    const char byte = 1;
+    ssize_t written = ::write(signalSockets[0], &byte, sizeof(byte));
+    (void)written;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("respeakerd");
+
+    ReSpeakerDaemonConfig config;
+    QString error;
+    if (!config.load(app, &error)) {
+        std::cerr << error.toStdString() << std::endl;
+        return 1;
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets) != 0) {
+        std::cerr << "Unable to create the signal socket" << std::endl;
+        return 1;
+    }
+    QSocketNotifier signalNotifier(signalSockets[1], QSocketNotifier::Read);
+    QObject::connect(&signalNotifier, SIGNAL(activated(int)), &app, SLOT(quit()));
+    struct sigaction action;
+    action.sa_handler = handleSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+
+    hid_init();
+    ReSpeakerDaemon daemon(config);
+    if (!daemon.start())
+        return 1;
+    const int result = app.exec();
+    daemon.stop();
+    return result;
+}
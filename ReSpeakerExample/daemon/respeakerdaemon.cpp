@@ -0,0 +1,319 @@
+#include <QAudioDeviceInfo>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QSettings>
+#include <iostream>
+#include <stdio.h>
+
+#include "respeakerdaemon.h"
+#include "audiointerface.h"
+#include "frequencyspectrum.h"
+#include "respeakernotifier.h"
+#include "utils.h"
+#include "../../src/respeakermicarray.h"
+#include "../../src/respeakertransport.h"
+#include "../../src/respeakeremulatortransport.h"
+#include "../../src/respeakerrecordingtransport.h"
+#include "../../src/respeakercapture.h"
+
+//-----------------------------------------------------------------------------
+// Configuration
+//-----------------------------------------------------------------------------
+
+ReSpeakerDaemonConfig::ReSpeakerDaemonConfig()
+    : alsaPeriodFrames(160)
+    , alsaPeriodCount(4)
+    , realtime(false)
+    , sampleRate(16000)
+    , channelCount(0)
+    , wavPreallocateBytes(0)
+    , analysisHopFrames(0)
+    , levelAnalysis(true)
+    , spectrumAnalysis(true)
+    , emulator(false)
+    , statusIntervalMs(1000)
+    , durationMs(0)
+{
+}
+
+bool ReSpeakerDaemonConfig::load(const QCoreApplication &app, QString *error)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless ReSpeaker capture and analysis");
+    parser.addHelpOption();
+    const QCommandLineOption configOption("config", "Read settings from an INI file.", "file");
+    const QCommandLineOption deviceOption("device", "Record from the input device whose name contains name.", "name");
+    const QCommandLineOption alsaOption("alsa", "Record from an ALSA device in mmap mode instead.", "device");
+    const QCommandLineOption periodOption("period", "ALSA period in frames.", "frames", "160");
+    const QCommandLineOption periodsOption("periods", "ALSA periods of buffering.", "count", "4");
+    const QCommandLineOption realtimeOption("realtime", "Ask for a realtime ALSA reader thread.");
+    const QCommandLineOption rateOption("rate", "Sample rate to record at.", "hz", "16000");
+    const QCommandLineOption channelCountOption("channel-count", "Channels to record, 0 for all the device has.", "count", "0");
+    const QCommandLineOption wavOption("wav", "Stream the audio to a WAV (RF64 past 4 GB) file.", "file");
+    const QCommandLineOption preallocateOption("preallocate-mb", "Reserve this much disk for the WAV file.", "mb", "0");
+    const QCommandLineOption captureOption("capture", "Save HID reports and audio to a capture file.", "file");
+    const QCommandLineOption hopOption("hop", "Analyse level and spectrum every this many frames, 0 for 20 ms.", "frames", "0");
+    const QCommandLineOption noLevelOption("no-level", "Do not analyse the level.");
+    const QCommandLineOption noSpectrumOption("no-spectrum", "Do not analyse the spectrum.");
+    const QCommandLineOption channelsOption("channels", "Channels to analyse, first drives level and spectrum.", "list");
+    const QCommandLineOption emulatorOption("emulator", "Run against the array emulator.");
+    const QCommandLineOption statusOption("status-ms", "Interval between status lines, 0 for none.", "ms", "1000");
+    const QCommandLineOption durationOption("duration-ms", "Stop after this long, 0 to run until signalled.", "ms", "0");
+    parser.addOptions(QList<QCommandLineOption>() << configOption << deviceOption << alsaOption
+                      << periodOption << periodsOption << realtimeOption
+                      << rateOption << channelCountOption << wavOption
+                      << preallocateOption << captureOption << hopOption << noLevelOption << noSpectrumOption
+                      << channelsOption << emulatorOption
+                      << statusOption << durationOption);
+    parser.process(app);
+
+    QSettings *settings = 0;
+    if (parser.isSet(configOption)) {
+        const QString path = parser.value(configOption);
+        if (!QFileInfo(path).isReadable()) {
+            *error = QString("Cannot read %1").arg(path);
+            return false;
+        }
+        settings = new QSettings(path, QSettings::IniFormat);
+    }
+    // The command line wins over the file, the file over the defaults
+    auto value = [&] (const QCommandLineOption &option) {
+        const QString name = option.names().first();
+        if (parser.isSet(option) || !settings || !settings->contains(name))
+            return parser.value(option);
+        // QSettings reads an unquoted "1,2,3" as a list
+        const QVariant setting = settings->value(name);
+        if (QVariant::StringList == setting.type())
+            return setting.toStringList().join(',');
+        return setting.toString();
+    };
+    auto flag = [&] (const QCommandLineOption &option) {
+        const QString name = option.names().first();
+        if (parser.isSet(option) || !settings)
+            return parser.isSet(option);
+        return settings->value(name, false).toBool();
+    };
+
+    inputDevice = value(deviceOption);
+    alsaDevice = value(alsaOption);
+    alsaPeriodFrames = value(periodOption).toInt();
+    alsaPeriodCount = value(periodsOption).toInt();
+    realtime = flag(realtimeOption);
+    sampleRate = value(rateOption).toInt();
+    channelCount = value(channelCountOption).toInt();
+    wavPath = value(wavOption);
+    wavPreallocateBytes = value(preallocateOption).toLongLong() << 20;
+    capturePath = value(captureOption);
+    analysisHopFrames = value(hopOption).toInt();
+    levelAnalysis = !flag(noLevelOption);
+    spectrumAnalysis = !flag(noSpectrumOption);
+    emulator = flag(emulatorOption);
+    statusIntervalMs = value(statusOption).toInt();
+    durationMs = value(durationOption).toInt();
+    channelMap.clear();
+    foreach (const QString &channel, value(channelsOption).split(',', QString::SkipEmptyParts))
+        channelMap << channel.trimmed().toInt();
+    delete settings;
+
+    if (alsaPeriodFrames <= 0 || alsaPeriodCount < 2) {
+        *error = "The ALSA period must be positive, with at least 2 periods";
+        return false;
+    }
+    if (sampleRate <= 0 || channelCount < 0) {
+        *error = "The rate must be positive and the channel count 0 or more";
+        return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Daemon
+//-----------------------------------------------------------------------------
+
+ReSpeakerDaemon::ReSpeakerDaemon(const ReSpeakerDaemonConfig &config, QObject *parent)
+    : QObject(parent)
+    , config(config)
+    , audioInterface(new AudioInterface(this))
+    , micArray(0)
+    , reSpeakerNotifier(0)
+    , captureWriter(0)
+    , rmsLevel(0.0)
+    , peakLevel(0.0)
+    , spectrumPeakFrequency(0.0)
+    , autoReports(0)
+{
+    CHECKED_CONNECT(audioInterface, SIGNAL(levelChanged(qreal, qreal, int)),
+                    this, SLOT(levelChanged(qreal, qreal, int)));
+    CHECKED_CONNECT(audioInterface, SIGNAL(spectrumChanged(qint64, qint64, const FrequencySpectrum &)),
+                    this, SLOT(spectrumChanged(qint64, qint64, const FrequencySpectrum &)));
+    CHECKED_CONNECT(audioInterface, SIGNAL(infoMessage(QString, int)),
+                    this, SLOT(infoMessage(QString, int)));
+    CHECKED_CONNECT(audioInterface, SIGNAL(errorMessage(QString, QString)),
+                    this, SLOT(errorMessage(QString, QString)));
+    CHECKED_CONNECT(&statusTimer, SIGNAL(timeout()),
+                    this, SLOT(printStatus()));
+}
+
+ReSpeakerDaemon::~ReSpeakerDaemon()
+{
+    stop();
+    delete micArray;
+    audioInterface->setCaptureWriter(0);
+    delete captureWriter;
+}
+
+bool ReSpeakerDaemon::start()
+{
+    ReSpeakerTransport *transport = 0;
+    if (config.emulator) {
+        ReSpeakerEmulatorTransport *emulator = new ReSpeakerEmulatorTransport();
+        std::vector<ReSpeakerEmulatedReport> script;
+        for (int angle = 0; angle < 360; angle += 30) {
+            ReSpeakerEmulatedReport talking = { (unsigned short)angle, 2, 100 };
+            ReSpeakerEmulatedReport silent = { (unsigned short)angle, 0, 40 };
+            script.push_back(talking);
+            script.push_back(silent);
+        }
+        emulator->setAutoReportScript(script, ReSpeakerEmulatorTransport::DefaultReportIntervalUs, 1000);
+        transport = emulator;
+    } else if (!config.capturePath.isEmpty()) {
+        transport = ReSpeakerMicArray::openTransport();
+    }
+    if (!config.capturePath.isEmpty()) {
+        captureWriter = new ReSpeakerCaptureWriter;
+        if (captureWriter->open(QFile::encodeName(config.capturePath).constData())) {
+            transport = new ReSpeakerRecordingTransport(transport, captureWriter);
+            audioInterface->setCaptureWriter(captureWriter);
+        } else {
+            std::cerr << "Unable to create capture " << config.capturePath.toStdString() << std::endl;
+        }
+    }
+    micArray = transport ? new ReSpeakerMicArray(transport) : new ReSpeakerMicArray();
+    std::cout << "Mic Array: " << micArray->hidDevice() << std::endl;
+    reSpeakerNotifier = new ReSpeakerNotifier(micArray, this);
+    CHECKED_CONNECT(reSpeakerNotifier, SIGNAL(autoReportsAvailable()),
+                    this, SLOT(autoReportsAvailable()));
+    micArray->startEventReader();
+
+    // Always continuous: a daemon records for as long as it runs
+    audioInterface->setContinuousCapture(true);
+    audioInterface->setChannelMap(config.channelMap);
+    audioInterface->setAnalysisHop(config.analysisHopFrames);
+    audioInterface->setLevelAnalysis(config.levelAnalysis);
+    audioInterface->setSpectrumAnalysis(config.spectrumAnalysis);
+    if (!config.wavPath.isEmpty())
+        audioInterface->setWavRecording(config.wavPath, config.wavPreallocateBytes);
+    if (!config.alsaDevice.isEmpty()) {
+        // The ALSA backend settles the format with the device when it starts
+        audioInterface->setAlsaCapture(config.alsaDevice, config.alsaPeriodFrames,
+                                       config.alsaPeriodCount, config.realtime);
+    } else if (!selectInputDevice()) {
+        return false;
+    }
+    // Input only: a daemon has nothing to play back on and may have no
+    // output device at all
+    if (!audioInterface->initializeInput(config.sampleRate, config.channelCount))
+        return false;
+    audioInterface->startRecording();
+    if (QAudio::ActiveState != audioInterface->state() && QAudio::IdleState != audioInterface->state()) {
+        std::cerr << "Recording did not start" << std::endl;
+        return false;
+    }
+    std::cout << "Recording " << audioInterface->format().channelCount() << " channels at "
+              << audioInterface->format().sampleRate() << " Hz" << std::endl;
+
+    if (config.statusIntervalMs > 0)
+        statusTimer.start(config.statusIntervalMs);
+    if (config.durationMs > 0)
+        QTimer::singleShot(config.durationMs, QCoreApplication::instance(), SLOT(quit()));
+    return true;
+}
+
+void ReSpeakerDaemon::stop()
+{
+    statusTimer.stop();
+    // Finishes the WAV file and flushes the capture
+    audioInterface->stopRecording();
+    if (micArray)
+        micArray->stopEventReader();
+}
+
+bool ReSpeakerDaemon::selectInputDevice()
+{
+    if (config.inputDevice.isEmpty()) {
+        audioInterface->audioInputDevice = QAudioDeviceInfo::defaultInputDevice();
+    } else {
+        audioInterface->audioInputDevice = QAudioDeviceInfo();
+        QAudioDeviceInfo device;
+        foreach (device, audioInterface->availableAudioInputDevices) {
+            if (device.deviceName().contains(config.inputDevice, Qt::CaseInsensitive)) {
+                audioInterface->audioInputDevice = device;
+                break;
+            }
+        }
+    }
+    if (audioInterface->audioInputDevice.isNull()) {
+        std::cerr << "No input device";
+        if (!config.inputDevice.isEmpty())
+            std::cerr << " matching " << config.inputDevice.toStdString();
+        std::cerr << std::endl;
+        return false;
+    }
+    std::cout << "Input device: " << audioInterface->audioInputDevice.deviceName().toStdString() << std::endl;
+    return true;
+}
+
+void ReSpeakerDaemon::autoReportsAvailable()
+{
+    // Only counted; the direction history keeps the rest for printStatus()
+    ReSpeakerAutoReport report;
+    reSpeakerNotifier->acknowledge();
+    while (micArray->nextAutoReport(&report))
+        autoReports++;
+}
+
+void ReSpeakerDaemon::levelChanged(qreal rms, qreal peak, int numSamples)
+{
+    Q_UNUSED(numSamples)
+    rmsLevel = rms;
+    peakLevel = peak;
+}
+
+void ReSpeakerDaemon::spectrumChanged(qint64 position, qint64 length, const FrequencySpectrum &spectrum)
+{
+    Q_UNUSED(position)
+    Q_UNUSED(length)
+    qreal loudest = -1.0;
+    for (FrequencySpectrum::const_iterator i = spectrum.begin(); i != spectrum.end(); ++i) {
+        if (i->amplitude > loudest && i->frequency > 0.0) {
+            loudest = i->amplitude;
+            spectrumPeakFrequency = i->frequency;
+        }
+    }
+}
+
+void ReSpeakerDaemon::infoMessage(const QString &message, int durationMs)
+{
+    Q_UNUSED(durationMs)
+    std::cout << message.toStdString() << std::endl;
+}
+
+void ReSpeakerDaemon::errorMessage(const QString &heading, const QString &detail)
+{
+    std::cerr << heading.toStdString() << ": " << detail.toStdString() << std::endl;
+}
+
+void ReSpeakerDaemon::printStatus()
+{
+    const long long now = ReSpeakerDirectionHistory::now();
+    ReSpeakerDirectionHistory *history = micArray->history();
+    char line[160];
+    snprintf(line, sizeof(line), "rms %.3f peak %.3f spectrum peak %.0f Hz angle %d voice %.0f%% reports %llu"
+             " spectra skipped %u",
+             rmsLevel, peakLevel, spectrumPeakFrequency,
+             history->dominantAngle(now, config.statusIntervalMs),
+             100.0 * history->vadDutyCycle(now, config.statusIntervalMs), autoReports,
+             audioInterface->spectrumWindowsSkipped());
+    std::cout << line << std::endl;
+}
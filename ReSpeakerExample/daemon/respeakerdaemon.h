@@ -0,0 +1,96 @@
+#ifndef RESPEAKERDAEMON_H
+#define RESPEAKERDAEMON_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+class QCoreApplication;
+class AudioInterface;
+class FrequencySpectrum;
+class ReSpeakerMicArray;
+class ReSpeakerNotifier;
+class ReSpeakerCaptureWriter;
+
+/**
+ * Settings for the daemon. Read from the command line, or from an INI file
+ * whose keys are the long option names, with the command line taking
+ * precedence.
+ */
+struct ReSpeakerDaemonConfig
+{
+    ReSpeakerDaemonConfig();
+
+    /**
+     * Fill in from the application's arguments.
+     * \return false, with the reason in error, on a bad option or file
+     */
+    bool load(const QCoreApplication &app, QString *error);
+
+    QString inputDevice;        // Part of the QAudioInput device name; default input if empty
+    QString alsaDevice;         // ALSA mmap capture instead of QAudioInput when set
+    int alsaPeriodFrames;
+    int alsaPeriodCount;
+    bool realtime;
+    int sampleRate;             // Nearest the device supports
+    int channelCount;           // 0 for as many as the device offers
+    QString wavPath;            // Stream the capture to this WAV/RF64 file
+    qint64 wavPreallocateBytes;
+    QString capturePath;        // HID reports and audio, for replay on the bench
+    int analysisHopFrames;      // Frames between level and spectrum windows, 0 for 20 ms
+    bool levelAnalysis;         // Each is a graph node, costing nothing when off
+    bool spectrumAnalysis;
+    QVector<int> channelMap;
+    bool emulator;              // Stand in for the array with ReSpeakerEmulatorTransport
+    int statusIntervalMs;       // 0 for no status lines
+    int durationMs;             // 0 to run until signalled
+};
+
+/**
+ * Runs the array's event handling, capture, level and spectrum analysis and
+ * recording with no user interface, reporting on stdout. Everything runs
+ * from the event loop of a QCoreApplication.
+ */
+class ReSpeakerDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReSpeakerDaemon(const ReSpeakerDaemonConfig &config, QObject *parent = 0);
+    ~ReSpeakerDaemon();
+
+    /**
+     * Open the array and start recording.
+     * \return false if recording could not start
+     */
+    bool start();
+
+public slots:
+    void stop();
+
+private slots:
+    void autoReportsAvailable();
+    void levelChanged(qreal rmsLevel, qreal peakLevel, int numSamples);
+    void spectrumChanged(qint64 position, qint64 length, const FrequencySpectrum &spectrum);
+    void infoMessage(const QString &message, int durationMs);
+    void errorMessage(const QString &heading, const QString &detail);
+    void printStatus();
+
+private:
+    bool selectInputDevice();
+
+    ReSpeakerDaemonConfig config;
+    AudioInterface* audioInterface;
+    ReSpeakerMicArray* micArray;
+    ReSpeakerNotifier* reSpeakerNotifier;
+    ReSpeakerCaptureWriter* captureWriter;
+    QTimer statusTimer;
+
+    qreal rmsLevel;
+    qreal peakLevel;
+    qreal spectrumPeakFrequency;
+    unsigned long long autoReports;
+};
+
+#endif // RESPEAKERDAEMON_H
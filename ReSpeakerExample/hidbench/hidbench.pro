@@ -0,0 +1,14 @@
+# Control path benchmarks for ReSpeakerMicArray
+TEMPLATE = app
+
+TARGET = hidbench
+
+CONFIG   += console c++11
+CONFIG   -= qt app_bundle
+
+include(../../src/respeaker.pri)
+
+SOURCES += main.cpp
+
+LIBS += /usr/lib/aarch64-linux-gnu/libusb-1.0.so
+LIBS += /usr/lib/aarch64-linux-gnu/libpthread.so
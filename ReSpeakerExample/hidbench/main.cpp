@@ -0,0 +1,311 @@
+// hidbench - latency and throughput of the ReSpeakerMicArray control path
+//
+// Usage: hidbench [options]
+//   --hidapi | --libusb   run against the array instead of the emulator
+//   --iterations N        operations per benchmark (default 2000)
+//   --latency US          emulator response latency (default 0)
+//   --reader              run control benchmarks with the event reader started
+//   --record FILE         save the reports exchanged to a capture file
+//   --replay FILE         only time delivery of the reports in a capture
+//   --speed X             replay speed, 0 for as fast as possible (default 1)
+//   --json                print results as JSON
+//
+// On the array the write benchmarks write back the values they read first,
+// so its settings are left as they were. A replay runs the same capture
+// through the reader each time, so two builds can be compared on it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../../src/respeakermicarray.h"
+#include "../../src/respeakeremulatortransport.h"
+#include "../../src/respeakerrecordingtransport.h"
+#include "../../src/respeakerreplaytransport.h"
+
+typedef std::chrono::steady_clock Clock ;
+
+struct Result
+{
+    std::string name ;
+    long long operations ;
+    double seconds ;
+    // Latency of each timed call, in microseconds
+    std::vector<double> latencies ;
+};
+
+static double nowUs ( void ) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count() / 1000.0 ;
+}
+
+static double percentile ( const std::vector<double> &sorted, double p ) {
+    if (sorted.empty()) {
+        return 0.0 ;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5) ;
+    return sorted[std::min(index, sorted.size() - 1)] ;
+}
+
+// Time call() iterations times; each call counts opsPerCall operations
+template <typename Call>
+static Result run ( const char *name, int iterations, int opsPerCall, Call call ) {
+    Result result ;
+    result.name = name ;
+    result.latencies.reserve(iterations) ;
+    double start = nowUs() ;
+    for (int i = 0; i < iterations; i++) {
+        double before = nowUs() ;
+        call(i) ;
+        result.latencies.push_back(nowUs() - before) ;
+    }
+    result.seconds = (nowUs() - start) / 1e6 ;
+    result.operations = (long long)iterations * opsPerCall ;
+    return result ;
+}
+
+// Time from the reader decoding a report to a consumer thread holding it.
+// Stops after count reports, or once finished returns true
+static Result autoReportDelivery ( ReSpeakerMicArray *micArray, int count,
+                                   std::function<bool ()> finished = std::function<bool ()>() ) {
+    Result result ;
+    result.name = "autoreport" ;
+    result.latencies.reserve(std::min(count, 1 << 16)) ;
+    std::mutex mutex ;
+    std::condition_variable available ;
+    bool pending = false ;
+    micArray->setAutoReportCallback([&](const ReSpeakerAutoReport &) {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        pending = true ;
+        available.notify_one() ;
+    }) ;
+    micArray->startEventReader() ;
+
+    double start = nowUs() ;
+    double limit = start + 60e6 ;
+    bool done = false ;
+    while ((int)result.latencies.size() < count && nowUs() < limit && !done) {
+        // One more pass collects what the reader queued meanwhile
+        done = finished && finished() ;
+        {
+            std::unique_lock<std::mutex> lock(mutex) ;
+            available.wait_for(lock, std::chrono::milliseconds(100), [&] { return pending ; }) ;
+            pending = false ;
+        }
+        ReSpeakerAutoReport report ;
+        while (micArray->nextAutoReport(&report)) {
+            double receivedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                        Clock::now().time_since_epoch()).count() ;
+            result.latencies.push_back(receivedUs - report.timestampUs) ;
+        }
+    }
+    result.seconds = (nowUs() - start) / 1e6 ;
+    result.operations = result.latencies.size() ;
+    micArray->stopEventReader() ;
+    return result ;
+}
+
+static void print ( const std::vector<Result> &results, bool json, const char *transport ) ;
+
+// Feed a capture's reports through the reader and time their delivery
+static int replay ( const char *path, double speed, bool json ) {
+    ReSpeakerCapturePlayer player(path) ;
+    if (!player.isOpen()) {
+        fprintf(stderr, "%s is not a capture\n", path) ;
+        return 1 ;
+    }
+    ReSpeakerReplayTransport *transport = new ReSpeakerReplayTransport(&player) ;
+    ReSpeakerMicArray *micArray = new ReSpeakerMicArray(transport) ;
+    player.start(speed) ;
+    std::vector<Result> results ;
+    results.push_back(autoReportDelivery(micArray, 1 << 30, [&] {
+        return player.finished() && transport->queuedReports() == 0 ;
+    })) ;
+    print(results, json, "replay") ;
+    if (!json) {
+        printf("Replayed %llu records at speed %g, max lateness %lld us, %u reports dropped\n",
+               player.recordsPlayed(), speed, player.maxLatenessUs(), micArray->droppedAutoReports()) ;
+    }
+    delete micArray ;
+    return 0 ;
+}
+
+static void print ( const std::vector<Result> &results, bool json, const char *transport ) {
+    if (json) {
+        printf("{\n  \"transport\": \"%s\",\n  \"benchmarks\": [\n", transport) ;
+    } else {
+        printf("Transport: %s\n", transport) ;
+        printf("%-12s %10s %12s %10s %10s %10s %10s\n",
+               "benchmark", "ops", "ops/s", "p50 us", "p99 us", "p999 us", "max us") ;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        std::vector<double> sorted = results[i].latencies ;
+        std::sort(sorted.begin(), sorted.end()) ;
+        double opsPerSecond = results[i].seconds > 0 ? results[i].operations / results[i].seconds : 0.0 ;
+        double maximum = sorted.empty() ? 0.0 : sorted.back() ;
+        if (json) {
+            printf("    {\"name\": \"%s\", \"operations\": %lld, \"ops_per_sec\": %.1f, "
+                   "\"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}%s\n",
+                   results[i].name.c_str(), results[i].operations, opsPerSecond,
+                   percentile(sorted, 0.50), percentile(sorted, 0.99), percentile(sorted, 0.999),
+                   maximum, i + 1 < results.size() ? "," : "") ;
+        } else {
+            printf("%-12s %10lld %12.1f %10.2f %10.2f %10.2f %10.2f\n",
+                   results[i].name.c_str(), results[i].operations, opsPerSecond,
+                   percentile(sorted, 0.50), percentile(sorted, 0.99), percentile(sorted, 0.999),
+                   maximum) ;
+        }
+    }
+    if (json) {
+        printf("  ]\n}\n") ;
+    }
+}
+
+int main ( int argc, char *argv[] ) {
+    const char *transportName = "emulator" ;
+    bool hardware = false ;
+    ReSpeakerMicArray::Backend backend = ReSpeakerMicArray::HidapiBackend ;
+    int iterations = 2000 ;
+    int latencyUs = 0 ;
+    bool withReader = false ;
+    bool json = false ;
+    const char *recordPath = 0 ;
+    const char *replayPath = 0 ;
+    double speed = 1.0 ;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hidapi") == 0) {
+            hardware = true ;
+            backend = ReSpeakerMicArray::HidapiBackend ;
+            transportName = "hidapi" ;
+        } else if (strcmp(argv[i], "--libusb") == 0) {
+            hardware = true ;
+            backend = ReSpeakerMicArray::LibusbBackend ;
+            transportName = "libusb" ;
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]) ;
+        } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            latencyUs = atoi(argv[++i]) ;
+        } else if (strcmp(argv[i], "--reader") == 0) {
+            withReader = true ;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i] ;
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i] ;
+            transportName = "replay" ;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            speed = atof(argv[++i]) ;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = true ;
+        } else {
+            fprintf(stderr, "Usage: %s [--hidapi | --libusb] [--iterations N] [--latency US] [--reader]\n"
+                    "       [--record FILE | --replay FILE [--speed X]] [--json]\n", argv[0]) ;
+            return 2 ;
+        }
+    }
+    if (iterations < 1) {
+        iterations = 1 ;
+    }
+
+    if (replayPath) {
+        return replay(replayPath, speed, json) ;
+    }
+
+    ReSpeakerEmulatorTransport *emulator = 0 ;
+    ReSpeakerTransport *transport ;
+    if (hardware) {
+        if (backend == ReSpeakerMicArray::HidapiBackend) {
+            hid_init() ;
+        }
+        transport = ReSpeakerMicArray::openTransport(backend) ;
+    } else {
+        emulator = new ReSpeakerEmulatorTransport() ;
+        emulator->setResponseLatencyUs(latencyUs) ;
+        transport = emulator ;
+    }
+    ReSpeakerCaptureWriter capture ;
+    if (recordPath) {
+        if (!capture.open(recordPath)) {
+            fprintf(stderr, "Unable to create %s\n", recordPath) ;
+            delete transport ;
+            return 1 ;
+        }
+        transport = new ReSpeakerRecordingTransport(transport, &capture) ;
+    }
+    ReSpeakerMicArray *micArray = new ReSpeakerMicArray(transport) ;
+    if (!micArray->isOpen()) {
+        fprintf(stderr, "No array found\n") ;
+        delete micArray ;
+        return 1 ;
+    }
+    if (withReader) {
+        micArray->startEventReader() ;
+    }
+
+    // Registers the example already reads and writes. The write and batch
+    // benchmarks write back what was read, so without both values they
+    // would put zeroes into a real array
+    signed char micGain = 0 ;
+    unsigned char bypass = 0 ;
+    const bool haveValues = micArray->get<ReSpeakerRegisters::MicGain>(&micGain) &&
+                            micArray->get<ReSpeakerRegisters::SpeakerProcessingBypass>(&bypass) ;
+    if (!haveValues) {
+        fprintf(stderr, "Unable to read MicGain and SpeakerProcessingBypass; skipping write and batch\n") ;
+    }
+
+    std::vector<Result> results ;
+    results.push_back(run("read", iterations, 1, [&](int) {
+        signed char value ;
+        micArray->get<ReSpeakerRegisters::MicGain>(&value) ;
+    })) ;
+    if (haveValues) {
+        results.push_back(run("write", iterations, 1, [&](int) {
+            micArray->set<ReSpeakerRegisters::MicGain>(micGain) ;
+        })) ;
+
+        // Four reads and four writes in one pipelined transaction
+        ReSpeakerTransaction batch ;
+        for (int i = 0; i < 2; i++) {
+            ReSpeakerRegisters::queueRead<ReSpeakerRegisters::MicGain>(&batch) ;
+            ReSpeakerRegisters::queueRead<ReSpeakerRegisters::SpeakerProcessingBypass>(&batch) ;
+            ReSpeakerRegisters::queueWrite<ReSpeakerRegisters::MicGain>(&batch, micGain) ;
+            ReSpeakerRegisters::queueWrite<ReSpeakerRegisters::SpeakerProcessingBypass>(&batch, bypass) ;
+        }
+        results.push_back(run("batch", iterations, batch.size(), [&](int) {
+            batch.reset() ;
+            micArray->execute(&batch) ;
+        })) ;
+    }
+
+    results.push_back(run("led", iterations, 1, [&](int i) {
+        micArray->setLEDMode(4, i & 0xFF, 0, 0) ;
+    })) ;
+    micArray->setLEDAutoVoiceLocated() ;
+
+    if (withReader) {
+        micArray->stopEventReader() ;
+    }
+    if (emulator) {
+        std::vector<ReSpeakerEmulatedReport> script ;
+        ReSpeakerEmulatedReport talking = { 90, 2, 10 } ;
+        ReSpeakerEmulatedReport silent = { 270, 0, 10 } ;
+        script.push_back(talking) ;
+        script.push_back(silent) ;
+        emulator->setAutoReportScript(script, 1000, 200) ;
+    }
+    // The array reports at its own pace
+    int reports = emulator ? iterations : std::min(iterations, 1000) ;
+    results.push_back(autoReportDelivery(micArray, reports)) ;
+
+    print(results, json, transportName) ;
+    delete micArray ;
+    return 0 ;
+}
@@ -3,14 +3,18 @@
 #include <QAudioInput>
 #include <QAudioOutput>
 #include <QCoreApplication>
+#include <QMetaMethod>
 #include <QThread>
 #include <QDebug>
 
 
 #include <math.h>
+#include <string.h>
 
 #include "utils.h"
 #include "tonegenerator.h"
+#include "../../src/respeakercapture.h"
+#include "../../src/respeakerwavwriter.h"
 
 
 //-----------------------------------------------------------------------------
@@ -23,6 +27,17 @@ const int    NotifyIntervalMs       = 100;
 // Size of the level calculation window in microseconds
 const int    LevelWindowUs          = 0.1 * 1000000;
 
+// Continuous capture reads the device and writes the capture file in
+// blocks of this length. It is also the default analysis hop
+const qint64 CaptureBlockUs         = 20 * 1000;
+// Default interval between level and spectrum updates to the UI
+const int    UiRefreshIntervalMs    = 40;
+// How long a reader falling behind the capture is shown
+const int    OverrunMessageMs       = 5000;
+// Capture blocks the processing graph may hold at once before blocks
+// come from the heap
+const size_t BlockPoolCount         = 64;
+
 
 AudioInterface::AudioInterface(QObject *parent)
     : QObject(parent)
@@ -45,21 +60,59 @@ AudioInterface::AudioInterface(QObject *parent)
     , playPosition(0)
     , audioBufferPosition(0)
     , audioDataLength(0)
+    , mappedAudio(0)
+    , mappedAudioLength(0)
+    , mappedViewPosition(0)
     , levelBufferLength(0)
     , audioRmsLevel(0.0)
     , audioPeakLevel(0.0)
     , spectrumBufferLength(0)
     , spectrumAnalyser(0)
-    , spectrumPosition(0)
+    , analysisHopFrames(0)
+    , analysisPosition(0)
+    , spectrumHopsSkipped(0)
+    , spectrumSkipsReported(0)
+    , analysisPending(false)
+    , uiRefreshIntervalMs(UiRefreshIntervalMs)
+    , levelUpdated(false)
+    , levelSamples(0)
+    , spectrumUpdated(false)
+    , latestSpectrumPosition(0)
     , audioCount(0)
-
+    , captureWriter(0)
+    , replaying(false)
+    , alsaCapture(0)
+    , alsaOverrunsReported(0)
+    , continuousCapture(false)
+    , captureRing(0)
+    , wavPreallocateBytes(0)
+    , wavWriter(0)
+    , wavOverrunsReported(0)
+    , captureSourceNode(processingGraph.add(new ReSpeakerAudioSourceNode("capture")))
+    , levelNode(processingGraph.add(new ReSpeakerAudioCallbackNode("level",
+                    [this] (const ReSpeakerAudioBlockRef &block) { analyseLevelBlock(block); })))
+    , spectrumNode(processingGraph.add(new ReSpeakerAudioCallbackNode("spectrum",
+                    [this] (const ReSpeakerAudioBlockRef &block) { analyseSpectrumBlock(block); })))
+    , graphPosition(0)
+    , blockPool(0)
 {
     qRegisterMetaType<FrequencySpectrum>("FrequencySpectrum");
     qRegisterMetaType<WindowFunction>("WindowFunction");
     CHECKED_CONNECT(&spectrumAnalyser,
-                    SIGNAL(spectrumChanged(FrequencySpectrum)),
+                    SIGNAL(spectrumChanged(qint64, FrequencySpectrum)),
                     this,
-                    SLOT(spectrumChanged(FrequencySpectrum)));
+                    SLOT(spectrumChanged(qint64, FrequencySpectrum)));
+    // Replays and ALSA captures have no input device to call audioNotify()
+    CHECKED_CONNECT(&notifyTimer, SIGNAL(timeout()),
+                    this, SLOT(audioNotify()));
+    CHECKED_CONNECT(&uiRefreshTimer, SIGNAL(timeout()),
+                    this, SLOT(uiRefresh()));
+#ifndef DISABLE_LEVEL
+    setLevelAnalysis(true);
+#endif
+#ifndef DISABLE_SPECTRUM
+    setSpectrumAnalysis(true);
+#endif
 
     // initialize();
 
@@ -73,7 +126,11 @@ AudioInterface::AudioInterface(QObject *parent)
 }
 
 AudioInterface::~AudioInterface() {
-
+    delete alsaCapture;
+    delete wavWriter;
+    delete captureRing;
+    if (blockPool)
+        blockPool->retire();
 }
 
 qint64 AudioInterface::bufferLength() const
@@ -90,7 +147,6 @@ void AudioInterface::resetAudioDevices()
     delete audioOutput;
     audioOutput = 0;
     setPlayPosition(0);
-    spectrumPosition = 0;
     setLevel(0.0, 0.0, 0);
 }
 
@@ -101,11 +157,21 @@ void AudioInterface::reset()
     setState(QAudio::AudioInput, QAudio::StoppedState);
     setFormat(QAudioFormat());
     generateTone = false;
+    // The waveform may be showing the mapping of analysisFile
+    if (wavFile) {
+        audioBuffer.clear();
+        emit bufferChanged(0, 0, audioBuffer);
+    }
+    mappedView.clear();
+    mappedViewPosition = 0;
+    mappedAudio = 0;
+    mappedAudioLength = 0;
     delete wavFile;
     wavFile = 0;
     delete analysisFile;
     analysisFile = 0;
     audioBuffer.clear();
+    playbackSpare.clear();
     audioBufferPosition = 0;
     audioBufferLength = 0;
     audioDataLength = 0;
@@ -113,6 +179,34 @@ void AudioInterface::reset()
     resetAudioDevices();
 }
 
+bool AudioInterface::loadFile(const QString &fileName)
+{
+    reset();
+    bool result = false;
+    wavFile = new WavFile(this);
+    if (wavFile->open(fileName)) {
+        if (isPCMS16LE(wavFile->fileFormat())) {
+            result = initialize();
+        } else {
+            emit errorMessage(tr("Audio format not supported"),
+                              formatToString(wavFile->fileFormat()));
+        }
+    } else {
+        emit errorMessage(tr("Could not open file"), fileName);
+    }
+    if (result) {
+        // Read, or mapped, separately from the file QAudioOutput streams
+        analysisFile = new WavFile(this);
+        result = analysisFile->open(fileName);
+    }
+    if (!result) {
+        delete wavFile;
+        wavFile = 0;
+        delete analysisFile;
+        analysisFile = 0;
+    }
+    return result;
+}
 
 bool AudioInterface::initialize()
 {
@@ -173,6 +267,48 @@ bool AudioInterface::initialize()
     return result;
 }
 
+bool AudioInterface::initializeInput(int sampleRate, int channelCount)
+{
+    if (!alsaConfig.device.empty()) {
+        if (sampleRate > 0)
+            alsaConfig.sampleRate = sampleRate;
+        alsaConfig.channelCount = qMax(0, channelCount);
+        return true;
+    }
+
+    QAudioFormat format;
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setSampleRate(sampleRate > 0 ? sampleRate : audioInputDevice.preferredFormat().sampleRate());
+    if (channelCount <= 0) {
+        QList<int> channelsList = audioInputDevice.supportedChannelCounts();
+        qSort(channelsList);
+        channelCount = channelsList.isEmpty() ? 1 : channelsList.last();
+    }
+    format.setChannelCount(channelCount);
+    if (!audioInputDevice.isFormatSupported(format))
+        format = audioInputDevice.nearestFormat(format);
+    ENGINE_DEBUG << "AudioInterface::initializeInput" << format;
+    if (16 != format.sampleSize() || QAudioFormat::SignedInt != format.sampleType() ||
+        QAudioFormat::LittleEndian != format.byteOrder()) {
+        emit errorMessage(tr("No suitable input format found"), formatToString(format));
+        return false;
+    }
+
+    resetAudioDevices();
+    setFormat(format);
+    audioBufferLength = audioLength(audioFormat, BufferDurationUs);
+    audioBuffer.resize(audioBufferLength);
+    audioBuffer.fill(0);
+    emit bufferLengthChanged(bufferLength());
+    emit bufferChanged(0, 0, audioBuffer);
+    audioInput = new QAudioInput(audioInputDevice, audioFormat, this);
+    audioInput->setNotifyInterval(NotifyIntervalMs);
+    return true;
+}
+
 // Formats
 
 bool AudioInterface::selectFormat()
@@ -250,6 +386,10 @@ bool AudioInterface::selectFormat()
 
 void AudioInterface::startRecording()
 {
+    if (!alsaConfig.device.empty()) {
+        startAlsaCapture();
+        return;
+    }
     if (audioInput) {
         if (QAudio::AudioInput == audioMode &&
             QAudio::SuspendedState == audioState) {
@@ -268,10 +408,17 @@ void AudioInterface::startRecording()
                             this, SLOT(audioNotify()));
             audioCount = 0;
             audioDataLength = 0;
+            graphPosition = 0;
+            restartAnalysis(0);
             emit dataLengthChanged(0);
+            if (continuousCapture)
+                startContinuousCapture();
             audioInputIODevice = audioInput->start();
             CHECKED_CONNECT(audioInputIODevice, SIGNAL(readyRead()),
                             this, SLOT(audioDataReady()));
+            if (captureWriter)
+                captureWriter->writeAudioFormat(audioFormat.sampleRate(), audioFormat.channelCount(),
+                                                audioFormat.sampleSize());
         }
     }
 }
@@ -320,7 +467,10 @@ void AudioInterface::suspend()
         QAudio::IdleState == audioState) {
         switch (audioMode) {
         case QAudio::AudioInput:
-            audioInput->suspend();
+            if (alsaCapture)
+                stopRecording();
+            else
+                audioInput->suspend();
             break;
         case QAudio::AudioOutput:
             audioOutput->suspend();
@@ -348,12 +498,26 @@ void AudioInterface::setAudioOutputDevice(const QAudioDeviceInfo &device)
 
 void AudioInterface::stopRecording()
 {
+    if (alsaCapture) {
+        // Once the reader has stopped nothing else writes to the ring
+        alsaCapture->stop();
+        notifyTimer.stop();
+        finishContinuousCapture();
+        delete alsaCapture;
+        alsaCapture = 0;
+        stopGraph();
+        setState(QAudio::StoppedState);
+        return;
+    }
     if (audioInput) {
         audioInput->stop();
         QCoreApplication::instance()->processEvents();
         audioInput->disconnect();
     }
+    if (audioInputIODevice && captureRing)
+        finishContinuousCapture();
     audioInputIODevice = 0;
+    stopGraph();
 
 #ifdef DUMP_AUDIO
     dumpData();
@@ -374,6 +538,7 @@ void AudioInterface::setState(QAudio::State state)
 {
     const bool changed = (audioState != state);
     audioState = state;
+    updateUiRefresh();
     if (changed)
         emit stateChanged(audioMode, audioState);
 }
@@ -383,6 +548,7 @@ void AudioInterface::setState(QAudio::Mode mode, QAudio::State state)
     const bool changed = (audioMode != mode || audioState != state);
     audioMode = mode;
     audioState = state;
+    updateUiRefresh();
     if (changed)
         emit stateChanged(audioMode, audioState);
 }
@@ -411,27 +577,39 @@ void AudioInterface::calculateLevel(qint64 position, qint64 length)
 #else
     Q_ASSERT(position + length <= audioBufferPosition + audioDataLength);
 
-    qreal peakLevel = 0.0;
+    computeLevel(analysisData(position), length);
+
+    ENGINE_DEBUG << "AudioInterface::calculateLevel" << "pos" << position << "len" << length
+                 << "rms" << audioRmsLevel << "peak" << audioPeakLevel;
+#endif
+}
 
-    qreal sum = 0.0;
-    const char *ptr = audioBuffer.constData() + position - audioBufferPosition;
-    const char *const end = ptr + length;
-    while (ptr < end) {
-        const qint16 value = *reinterpret_cast<const qint16*>(ptr);
-        const qreal fracValue = pcmToReal(value);
-        peakLevel = qMax(peakLevel, fracValue);
-        sum += fracValue * fracValue;
-        ptr += 2;
+void AudioInterface::computeLevel(const char *data, qint64 length)
+{
+#ifdef DISABLE_LEVEL
+    Q_UNUSED(data)
+    Q_UNUSED(length)
+#else
+    const int numSamples = length / audioFormat.bytesPerFrame();
+    if (numSamples <= 0)
+        return;
+    deinterleaver.process(reinterpret_cast<const int16_t *>(data), numSamples);
+    if (0 == deinterleaver.frameCount())
+        return;
+
+    float peak = 0.0f;
+    float sum = 0.0f;
+    const float *samples = deinterleaver.plane(0);
+    for (int i = 0; i < numSamples; ++i) {
+        peak = qMax(peak, samples[i]);
+        sum += samples[i] * samples[i];
     }
-    const int numSamples = length / 2;
+    const qreal peakLevel = peak;
     qreal rmsLevel = sqrt(sum / numSamples);
 
     rmsLevel = qMax(qreal(0.0), rmsLevel);
     rmsLevel = qMin(qreal(1.0), rmsLevel);
     setLevel(rmsLevel, peakLevel, numSamples);
-
-    ENGINE_DEBUG << "AudioInterface::calculateLevel" << "pos" << position << "len" << length
-                 << "rms" << rmsLevel << "peak" << peakLevel;
 #endif
 }
 
@@ -449,33 +627,511 @@ void AudioInterface::calculateSpectrum(qint64 position)
                  << "count" << audioCount << "pos" << position << "len" << spectrumBufferLength
                  << "spectrumAnalyser.isReady" << spectrumAnalyser.isReady();
 
-    if (spectrumAnalyser.isReady()) {
-        spectrumBuffer = QByteArray::fromRawData(audioBuffer.constData() + position - audioBufferPosition,
-                                                   spectrumBufferLength);
-        spectrumPosition = position;
-        spectrumAnalyser.calculate(spectrumBuffer, audioFormat);
-    }
+    if (spectrumAnalyser.isReady())
+        analyseSpectrum(analysisData(position), position);
 #endif
 }
 
+// The sample at position, from the mapped file being played or audioBuffer
+const char *AudioInterface::analysisData(qint64 position) const
+{
+    if (mappedAudio)
+        return mappedAudio + position;
+    return audioBuffer.constData() + position - audioBufferPosition;
+}
+
+// A block from blockPool, or from the heap while the pool is empty or for
+// more than a pool block holds. The pool follows the current format
+ReSpeakerAudioBlockPtr AudioInterface::newBlock(size_t frameCount)
+{
+    const size_t blockBytes = audioLength(audioFormat, CaptureBlockUs);
+    if (!blockPool || blockPool->blockBytes() != blockBytes) {
+        if (blockPool)
+            blockPool->retire();
+        blockPool = new ReSpeakerAudioBlockPool(BlockPoolCount, blockBytes);
+        if (!blockPool->isLocked())
+            ENGINE_DEBUG << "AudioInterface::newBlock" << "could not lock block pool in memory";
+    }
+    ReSpeakerAudioBlockPtr block = blockPool->acquire(audioFormat.sampleRate(), audioFormat.channelCount(),
+                                                      frameCount);
+    if (!block)
+        block = ReSpeakerAudioBlock::create(audioFormat.sampleRate(), audioFormat.channelCount(), frameCount);
+    return block;
+}
+
+// Restarts the analysis windows if audio was lost before block
+void AudioInterface::deliverBlock(const ReSpeakerAudioBlockPtr &block)
+{
+    const qint64 position = block->position * audioFormat.bytesPerFrame();
+    if (position != analysisPosition)
+        restartAnalysis(position);
+    analysisPosition = position + block->bytes();
+    captureSourceNode->deliver(block);
+}
+
+// The whole frames appended to audioBuffer since the last call, copied once
+// into blocks of at most CaptureBlockUs; the nodes share them from there
+void AudioInterface::feedGraph()
+{
+    const int frameBytes = audioFormat.bytesPerFrame();
+    if (0 == captureSourceNode->outputCount() || 16 != audioFormat.sampleSize() || frameBytes <= 0)
+        return;
+    processingGraph.start();
+    const qint64 blockFrames = qMax<qint64>(1, audioLength(audioFormat, CaptureBlockUs) / frameBytes);
+    qint64 frames = (audioDataLength - graphPosition) / frameBytes;
+    while (frames > 0) {
+        ReSpeakerAudioBlockPtr block = newBlock(qMin(frames, blockFrames));
+        block->position = graphPosition / frameBytes;
+        memcpy(block->samples, audioBuffer.constData() + graphPosition, block->bytes());
+        graphPosition += block->bytes();
+        frames -= block->frameCount;
+        deliverBlock(block);
+    }
+}
+
+// Lets the nodes with threads finish what they have queued
+void AudioInterface::stopGraph()
+{
+    if (!processingGraph.isRunning())
+        return;
+    processingGraph.stop();
+    foreach (ReSpeakerAudioNode *node, processingGraph.nodes()) {
+        const ReSpeakerAudioNodeStats stats = node->stats();
+        ENGINE_DEBUG << "AudioInterface::stopGraph" << node->name().c_str()
+                     << "blocks" << stats.blocks << "dropped" << stats.dropped
+                     << "totalUs" << stats.totalNs / 1000 << "maxUs" << stats.maxNs / 1000;
+    }
+    if (blockPool)
+        ENGINE_DEBUG << "AudioInterface::stopGraph" << "block pool" << blockPool->available()
+                     << "of" << blockPool->blockCount() << "free,"
+                     << "empty" << blockPool->exhausted() << "times";
+}
+
+// data holds spectrumBufferLength bytes starting at position
+void AudioInterface::analyseSpectrum(const char *data, qint64 position)
+{
+    Q_ASSERT(isPCMS16LE(audioFormat));
+    deinterleaver.process(reinterpret_cast<const int16_t *>(data), SpectrumLengthSamples);
+    if (0 == deinterleaver.frameCount())
+        return;
+    spectrumAnalyser.calculate(deinterleaver.plane(0), audioFormat.sampleRate(), position);
+}
+
 void AudioInterface::setFormat(const QAudioFormat &format)
 {
     const bool changed = (format != audioFormat);
     audioFormat = format;
     levelBufferLength = audioLength(audioFormat, LevelWindowUs);
+    if (!deinterleaver.setChannelCount(audioFormat.channelCount()) && QAudioFormat() != audioFormat)
+        emit errorMessage(tr("Level and spectrum are not analysed"),
+                          tr("%1 channels, more than the %2 supported")
+                          .arg(audioFormat.channelCount()).arg(ReSpeakerDeinterleaver::MaxChannels));
+    setChannelMap(channelMap);
     spectrumBufferLength = SpectrumLengthSamples *
                             (audioFormat.sampleSize() / 8) * audioFormat.channelCount();
+    const int frameBytes = audioFormat.bytesPerFrame();
+    if (frameBytes > 0) {
+        const int hop = analysisHopFrames > 0 ? analysisHopFrames
+                                              : audioLength(audioFormat, CaptureBlockUs) / frameBytes;
+        levelFramer.configure(frameBytes, levelBufferLength / frameBytes, hop);
+        spectrumFramer.configure(frameBytes, SpectrumLengthSamples, hop);
+    }
     if (changed)
         emit formatChanged(audioFormat);
 }
 
 void AudioInterface::setLevel(qreal rmsLevel, qreal peakLevel, int numSamples)
 {
+    // While running, held with the highest peak for uiRefresh()
+    if (uiRefreshTimer.isActive()) {
+        audioPeakLevel = levelUpdated ? qMax(audioPeakLevel, peakLevel) : peakLevel;
+        audioRmsLevel = rmsLevel;
+        levelSamples += numSamples;
+        levelUpdated = true;
+        return;
+    }
     audioRmsLevel = rmsLevel;
     audioPeakLevel = peakLevel;
     emit levelChanged(audioRmsLevel, audioPeakLevel, numSamples);
 }
 
+void AudioInterface::setAnalysisHop(int hopFrames)
+{
+    analysisHopFrames = qMax(0, hopFrames);
+}
+
+void AudioInterface::setUiRefreshInterval(int intervalMs)
+{
+    uiRefreshIntervalMs = qMax(1, intervalMs);
+    if (uiRefreshTimer.isActive())
+        uiRefreshTimer.start(uiRefreshIntervalMs);
+}
+
+void AudioInterface::updateUiRefresh()
+{
+    if (QAudio::ActiveState == audioState) {
+        if (!uiRefreshTimer.isActive())
+            uiRefreshTimer.start(uiRefreshIntervalMs);
+    } else if (uiRefreshTimer.isActive()) {
+        uiRefreshTimer.stop();
+        uiRefresh();
+    }
+}
+
+void AudioInterface::uiRefresh()
+{
+    if (levelUpdated) {
+        levelUpdated = false;
+        emit levelChanged(audioRmsLevel, audioPeakLevel, levelSamples);
+        levelSamples = 0;
+    }
+    if (spectrumUpdated) {
+        spectrumUpdated = false;
+        emit spectrumChanged(latestSpectrumPosition, spectrumBufferLength, latestSpectrum);
+    }
+    reportSpectrumSkips();
+}
+
+void AudioInterface::reportSpectrumSkips()
+{
+    if (spectrumHopsSkipped == spectrumSkipsReported)
+        return;
+    spectrumSkipsReported = spectrumHopsSkipped;
+    ENGINE_DEBUG << "AudioInterface::reportSpectrumSkips" << "skipped" << spectrumHopsSkipped;
+    emit infoMessage(tr("Spectrum analysis fell behind, %1 windows skipped so far")
+                     .arg(spectrumHopsSkipped), OverrunMessageMs);
+}
+
+// The level and spectrum nodes, run on this thread for each block of
+// captured audio, which follows on from the last unless restartAnalysis()
+// was called
+void AudioInterface::analyseLevelBlock(const ReSpeakerAudioBlockRef &block)
+{
+    levelFramer.push(block->samples, block->bytes(), [this] (const char *window, long long) {
+        computeLevel(window, levelBufferLength);
+    });
+}
+
+void AudioInterface::analyseSpectrumBlock(const ReSpeakerAudioBlockRef &block)
+{
+    // Each hop is queued for the analyser thread; a window is only
+    // skipped when SpectrumQueueWindows are already waiting
+    spectrumFramer.push(block->samples, block->bytes(), [this] (const char *window, long long position) {
+        if (spectrumAnalyser.isReady())
+            analyseSpectrum(window, position);
+        else
+            spectrumHopsSkipped++;
+    });
+}
+
+bool AudioInterface::setLevelAnalysis(bool enabled)
+{
+    return setAnalysisNode(levelNode, enabled);
+}
+
+bool AudioInterface::setSpectrumAnalysis(bool enabled)
+{
+    return setAnalysisNode(spectrumNode, enabled);
+}
+
+bool AudioInterface::setAnalysisNode(ReSpeakerAudioNode *node, bool enabled)
+{
+    if (processingGraph.isRunning())
+        return false;
+    if (enabled)
+        return processingGraph.connect(captureSourceNode, node);
+    processingGraph.disconnect(captureSourceNode, node);
+    return true;
+}
+
+void AudioInterface::restartAnalysis(qint64 position)
+{
+    analysisPosition = position;
+    levelFramer.restart(position);
+    spectrumFramer.restart(position);
+    // Skips are counted over the whole capture, across overruns
+    if (0 == position) {
+        spectrumHopsSkipped = 0;
+        spectrumSkipsReported = 0;
+    }
+}
+
+// Everything written to captureRing since the last call, read straight
+// into the graph's blocks
+void AudioInterface::analyseCapture()
+{
+    analysisPending = false;
+    if (!captureRing || 0 == captureSourceNode->outputCount() || 16 != audioFormat.sampleSize())
+        return;
+    processingGraph.start();
+    for (;;) {
+        ReSpeakerAudioBlockPtr block = newBlock(captureBlock.size() / audioFormat.bytesPerFrame());
+        const size_t length = graphCursor.read(block->samples, block->bytes());
+        if (0 == length)
+            break;
+        block->frameCount = length / audioFormat.bytesPerFrame();
+        block->position = (graphCursor.position() - length) / audioFormat.bytesPerFrame();
+        deliverBlock(block);
+    }
+    reportOverrun(graphCursor, tr("Processing graph"));
+}
+
+void AudioInterface::setCaptureWriter(ReSpeakerCaptureWriter *writer)
+{
+    captureWriter = writer;
+}
+
+void AudioInterface::setContinuousCapture(bool enabled)
+{
+    continuousCapture = enabled;
+}
+
+void AudioInterface::setChannelMap(const QVector<int> &map)
+{
+    channelMap = map;
+    if (!deinterleaver.setChannelMap(map.toStdVector())) {
+        ENGINE_DEBUG << "AudioInterface::setChannelMap" << map << "does not fit"
+                     << deinterleaver.channelCount() << "channels, analysing all";
+        deinterleaver.setChannelMap(std::vector<int>());
+    }
+}
+
+void AudioInterface::setWavRecording(const QString &path, qint64 preallocateBytes)
+{
+    wavRecordPath = path;
+    wavPreallocateBytes = preallocateBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Continuous capture
+//-----------------------------------------------------------------------------
+
+void AudioInterface::startContinuousCapture()
+{
+    delete captureRing;
+    captureRing = new ReSpeakerAudioRing(audioLength(audioFormat, BufferDurationUs),
+                                         audioFormat.bytesPerFrame());
+    captureBlock.resize(audioLength(audioFormat, CaptureBlockUs));
+    diskBuffer.resize(captureBlock.size());
+    waveformCursor.attach(captureRing);
+    diskCursor.attach(captureRing);
+    graphCursor.attach(captureRing);
+
+    if (!wavRecordPath.isEmpty()) {
+        ReSpeakerCaptureAudioFormat format;
+        format.sampleRate = audioFormat.sampleRate();
+        format.channelCount = audioFormat.channelCount();
+        format.sampleSize = audioFormat.sampleSize();
+        wavWriter = new ReSpeakerWavWriter;
+        wavOverrunsReported = 0;
+        if (!wavWriter->open(QFile::encodeName(wavRecordPath).constData(), format,
+                             captureRing, wavPreallocateBytes)) {
+            emit errorMessage(tr("Unable to create WAV file"), wavRecordPath);
+            delete wavWriter;
+            wavWriter = 0;
+        }
+    }
+}
+
+// Catch the capture file up, and leave the newest audio in the buffer
+// where playback and the non-continuous analysis expect it
+void AudioInterface::finishContinuousCapture()
+{
+    continuousNotify();
+    const qint64 length = qMin(qint64(audioBuffer.size()), captureRing->written());
+    if (captureRing->read(captureRing->written() - length, audioBuffer.data(), length))
+        audioDataLength = length;
+    else
+        audioDataLength = 0;
+    audioBufferPosition = 0;
+    if (wavWriter) {
+        // The writer reads the ring, so it goes first
+        if (!wavWriter->close())
+            emit errorMessage(tr("Unable to write WAV file"), wavRecordPath);
+        delete wavWriter;
+        wavWriter = 0;
+    }
+    delete captureRing;
+    captureRing = 0;
+    emit dataLengthChanged(dataLength());
+    emit bufferChanged(0, audioDataLength, audioBuffer);
+}
+
+void AudioInterface::continuousNotify()
+{
+    setRecordPosition(captureRing->written());
+
+    // The capture file takes every byte, in order
+    if (captureWriter) {
+        size_t length;
+        while ((length = diskCursor.read(diskBuffer.data(), diskBuffer.size())) > 0)
+            captureWriter->write(ReSpeakerCapture::AudioBlock, diskBuffer.constData(), length);
+        reportOverrun(diskCursor, tr("Capture file"));
+    }
+    // So do the processing graph and the analysis in it, which are
+    // usually ahead already
+    analyseCapture();
+    if (alsaCapture && alsaCapture->overruns() != alsaOverrunsReported) {
+        alsaOverrunsReported = alsaCapture->overruns();
+        ENGINE_DEBUG << "AudioInterface::continuousNotify ALSA overruns" << alsaOverrunsReported;
+        emit infoMessage(tr("Audio device overran %1 times").arg(alsaOverrunsReported),
+                         OverrunMessageMs);
+    }
+    if (wavWriter && wavWriter->overruns() != wavOverrunsReported) {
+        wavOverrunsReported = wavWriter->overruns();
+        ENGINE_DEBUG << "AudioInterface::continuousNotify WAV file"
+                     << "overruns" << wavOverrunsReported << "lostBytes" << wavWriter->lostBytes();
+        emit infoMessage(tr("WAV file fell behind the capture, %1 bytes lost so far")
+                         .arg(wavWriter->lostBytes()), OverrunMessageMs);
+    }
+
+    // The waveform only wants the newest window
+    // Nothing draws the waveform when running headless; skip the copy
+    static const QMetaMethod bufferChangedSignal = QMetaMethod::fromSignal(&AudioInterface::bufferChanged);
+    if (!isSignalConnected(bufferChangedSignal))
+        return;
+    const qint64 waveformLength = qMin(qint64(captureRing->capacity()),
+                                       audioLength(audioFormat, WaveformWindowDuration) + WaveformTileLength);
+    waveformBuffer.resize(waveformLength);
+    const qint64 waveformPosition = waveformCursor.readLatest(waveformBuffer.data(), waveformLength);
+    if (waveformPosition >= 0)
+        emit bufferChanged(waveformPosition, waveformLength, waveformBuffer);
+    reportOverrun(waveformCursor, tr("Waveform"));
+}
+
+void AudioInterface::reportOverrun(ReSpeakerAudioRingCursor &cursor, const QString &reader)
+{
+    if (cursor.takeOverrun()) {
+        ENGINE_DEBUG << "AudioInterface::reportOverrun" << reader
+                     << "overruns" << cursor.overruns() << "lostBytes" << cursor.lostBytes();
+        emit infoMessage(tr("%1 fell behind the capture, %2 bytes lost so far")
+                         .arg(reader).arg(cursor.lostBytes()), OverrunMessageMs);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Replay
+//-----------------------------------------------------------------------------
+
+void AudioInterface::startReplay(int sampleRate, int channelCount, int sampleSize)
+{
+    stopRecording();
+    stopPlayback();
+    spectrumAnalyser.cancelCalculation();
+    spectrumChanged(0, 0, FrequencySpectrum());
+
+    setCaptureFormat(sampleRate, channelCount, sampleSize);
+    if (continuousCapture)
+        startContinuousCapture();
+
+    replaying = true;
+    setState(QAudio::AudioInput, QAudio::ActiveState);
+    notifyTimer.start(NotifyIntervalMs);
+}
+
+void AudioInterface::replayAudio(const QByteArray &block)
+{
+    if (!replaying)
+        return;
+    if (captureRing) {
+        captureRing->write(block.constData(), block.size());
+        analyseCapture();
+        return;
+    }
+    const qint64 bytesSpace = audioBuffer.size() - audioDataLength;
+    const qint64 bytesCopied = qMin(qint64(block.size()), bytesSpace);
+    memcpy(audioBuffer.data() + audioDataLength, block.constData(), bytesCopied);
+    audioDataAppended(bytesCopied);
+}
+
+void AudioInterface::stopReplay()
+{
+    if (!replaying)
+        return;
+    if (captureRing)
+        finishContinuousCapture();
+    replaying = false;
+    notifyTimer.stop();
+    setState(QAudio::StoppedState);
+}
+
+void AudioInterface::setAlsaCapture(const QString &device, int periodFrames, int periodCount,
+                                    bool realtime)
+{
+    alsaConfig.device = device.toStdString();
+    alsaConfig.periodFrames = periodFrames;
+    alsaConfig.periodCount = periodCount;
+    alsaConfig.realtime = realtime;
+}
+
+// For captures which do not come through audioInput
+void AudioInterface::setCaptureFormat(int sampleRate, int channelCount, int sampleSize)
+{
+    QAudioFormat format;
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(channelCount);
+    format.setSampleSize(sampleSize);
+    setFormat(format);
+
+    audioBufferLength = audioLength(audioFormat, BufferDurationUs);
+    audioBuffer.resize(audioBufferLength);
+    audioBuffer.fill(0);
+    emit bufferLengthChanged(bufferLength());
+    audioCount = 0;
+    audioDataLength = 0;
+    graphPosition = 0;
+    restartAnalysis(0);
+    emit dataLengthChanged(0);
+    setRecordPosition(0, true);
+}
+
+void AudioInterface::startAlsaCapture()
+{
+    stopRecording();
+    stopPlayback();
+    spectrumAnalyser.cancelCalculation();
+    spectrumChanged(0, 0, FrequencySpectrum());
+
+    // Ask for the selected format; the device may offer something near it
+    if (audioFormat.sampleRate() > 0)
+        alsaConfig.sampleRate = audioFormat.sampleRate();
+    if (audioFormat.channelCount() > 0)
+        alsaConfig.channelCount = audioFormat.channelCount();
+    alsaCapture = new ReSpeakerAlsaCapture;
+    if (!alsaCapture->open(alsaConfig)) {
+        emit errorMessage(tr("Unable to open ALSA device %1").arg(QString::fromStdString(alsaConfig.device)),
+                          QString::fromStdString(alsaCapture->errorString()));
+        delete alsaCapture;
+        alsaCapture = 0;
+        return;
+    }
+    ENGINE_DEBUG << "AudioInterface::startAlsaCapture" << alsaConfig.device.c_str()
+                 << "rate" << alsaCapture->sampleRate() << "channels" << alsaCapture->channelCount()
+                 << "period" << alsaCapture->periodFrames() << "buffer" << alsaCapture->bufferFrames();
+
+    setCaptureFormat(alsaCapture->sampleRate(), alsaCapture->channelCount(), 16);
+    startContinuousCapture();
+    if (captureWriter)
+        captureWriter->writeAudioFormat(audioFormat.sampleRate(), audioFormat.channelCount(),
+                                        audioFormat.sampleSize());
+
+    // The only copy: from the DMA area into the ring
+    ReSpeakerAudioRing *ring = captureRing;
+    const size_t frameBytes = audioFormat.bytesPerFrame();
+    alsaOverrunsReported = 0;
+    // Each period is analysed as soon as the event loop gets to it
+    alsaCapture->start([this, ring, frameBytes] (const ReSpeakerAlsaCaptureView &view) {
+        ring->write(view.frames, view.frameCount * frameBytes);
+        if (!analysisPending.exchange(true))
+            QMetaObject::invokeMethod(this, "analyseCapture", Qt::QueuedConnection);
+    });
+    setState(QAudio::AudioInput, QAudio::ActiveState);
+    notifyTimer.start(NotifyIntervalMs);
+}
+
 
 //-----------------------------------------------------------------------------
 // Private slots
@@ -485,15 +1141,21 @@ void AudioInterface::audioNotify()
 {
     switch (audioMode) {
     case QAudio::AudioInput: {
-            const qint64 recordPosition = qMin(audioBufferLength, audioLength(audioFormat,audioInput->processedUSecs()));
-            setRecordPosition(recordPosition);
-            const qint64 levelPosition = audioDataLength - levelBufferLength;
-            if (levelPosition >= 0)
-                calculateLevel(levelPosition, levelBufferLength);
-            if (audioDataLength >= spectrumBufferLength) {
-                const qint64 spectrumPosition = audioDataLength - spectrumBufferLength;
-                calculateSpectrum(spectrumPosition);
+            if (alsaCapture && !alsaCapture->isRunning()) {
+                emit errorMessage(tr("ALSA capture stopped"),
+                                  QString::fromStdString(alsaCapture->errorString()));
+                stopRecording();
+                break;
             }
+            if (captureRing) {
+                continuousNotify();
+                break;
+            }
+            const qint64 processed = replaying ? audioDataLength
+                                               : audioLength(audioFormat,audioInput->processedUSecs());
+            const qint64 recordPosition = qMin(audioBufferLength, processed);
+            setRecordPosition(recordPosition);
+            // Level and spectrum were analysed as the blocks arrived
             emit bufferChanged(0, audioDataLength, audioBuffer);
         }
         break;
@@ -502,7 +1164,27 @@ void AudioInterface::audioNotify()
             setPlayPosition(qMin(bufferLength(), playPosition));
             const qint64 levelPosition = playPosition - levelBufferLength;
             const qint64 spectrumPosition = playPosition - spectrumBufferLength;
-            if (wavFile) {
+            const char *mapped = wavFile ? analysisFile->mappedData() : 0;
+            if (mapped) {
+                // The whole file is analysed in place: nothing to seek, read
+                // or copy. The waveform only ever gets a window-sized view,
+                // moved on once playback nears its end
+                mappedAudio = mapped;
+                mappedAudioLength = analysisFile->dataLength();
+                audioBufferPosition = 0;
+                audioDataLength = mappedAudioLength;
+                const qint64 windowLength = audioLength(audioFormat, WaveformWindowDuration);
+                const qint64 viewPosition = qMax(qint64(0), qMin(levelPosition, spectrumPosition));
+                const qint64 viewEnd = mappedViewPosition + mappedView.size();
+                if (mappedView.isEmpty() || viewPosition < mappedViewPosition ||
+                    (playPosition + windowLength > viewEnd && viewEnd < mappedAudioLength)) {
+                    const qint64 viewLength = qMin(mappedAudioLength - viewPosition,
+                                                   2 * windowLength + WaveformTileLength);
+                    mappedViewPosition = viewPosition;
+                    mappedView = QByteArray::fromRawData(mapped + viewPosition, int(viewLength));
+                    emit bufferChanged(mappedViewPosition, viewLength, mappedView);
+                }
+            } else if (wavFile) {
                 if (levelPosition > audioBufferPosition ||
                     spectrumPosition > audioBufferPosition ||
                     qMax(levelBufferLength, spectrumBufferLength) > audioDataLength) {
@@ -517,6 +1199,7 @@ void AudioInterface::audioNotify()
                              << "readPos" << readPos
                              << "readLen" << readLen;
                     if (analysisFile->seek(readPos + analysisFile->headerLength())) {
+                        audioBuffer.swap(playbackSpare);
                         audioBuffer.resize(readLen);
                         audioBufferPosition = readPos;
                         audioDataLength = analysisFile->read(audioBuffer.data(), readLen);
@@ -569,6 +1252,15 @@ void AudioInterface::audioStateChanged(QAudio::State state)
 
 void AudioInterface::audioDataReady()
 {
+    if (captureRing) {
+        // Take everything the device has; the ring never fills up
+        qint64 bytesRead;
+        while ((bytesRead = audioInputIODevice->read(captureBlock.data(), captureBlock.size())) > 0)
+            captureRing->write(captureBlock.constData(), bytesRead);
+        analyseCapture();
+        return;
+    }
+
     Q_ASSERT(0 == audioBufferPosition);
     const qint64 bytesReady = audioInput->bytesReady();
     const qint64 bytesSpace = audioBuffer.size() - audioDataLength;
@@ -578,18 +1270,41 @@ void AudioInterface::audioDataReady()
                                        audioBuffer.data() + audioDataLength,
                                        bytesToRead);
 
-    if (bytesRead) {
-        audioDataLength += bytesRead;
+    audioDataAppended(bytesRead);
+}
+
+// length bytes of captured audio, from the device or a replay, have been
+// placed at the end of the data in the buffer
+void AudioInterface::audioDataAppended(qint64 length)
+{
+    if (length > 0) {
+        if (captureWriter)
+            captureWriter->write(ReSpeakerCapture::AudioBlock,
+                                 audioBuffer.constData() + audioDataLength, length);
+        audioDataLength += length;
+        feedGraph();
         emit dataLengthChanged(dataLength());
     }
 
-    if (audioBuffer.size() == audioDataLength)
-        stopRecording();
+    if (audioBuffer.size() == audioDataLength) {
+        if (replaying)
+            stopReplay();
+        else
+            stopRecording();
+    }
 }
 
-void AudioInterface::spectrumChanged(const FrequencySpectrum &spectrum)
+void AudioInterface::spectrumChanged(qint64 position, const FrequencySpectrum &spectrum)
 {
-    ENGINE_DEBUG << "AudioInterface::spectrumChanged" << "pos" << spectrumPosition;
-    emit spectrumChanged(spectrumPosition, spectrumBufferLength, spectrum);
+    ENGINE_DEBUG << "AudioInterface::spectrumChanged" << "pos" << position
+                 << "skipped" << spectrumHopsSkipped;
+    if (uiRefreshTimer.isActive()) {
+        latestSpectrum = spectrum;
+        latestSpectrumPosition = position;
+        spectrumUpdated = true;
+        return;
+    }
+    reportSpectrumSkips();
+    emit spectrumChanged(position, spectrumBufferLength, spectrum);
 }
 
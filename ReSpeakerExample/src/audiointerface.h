@@ -2,17 +2,26 @@
 #define AUDIOINTERFACE_H
 
 #include <QObject>
+#include <atomic>
 #include <QAudioDeviceInfo>
 #include <QAudioFormat>
 #include <QBuffer>
+#include <QTimer>
 
 #include "wavfile.h"
 #include "micarray.h"
 #include "spectrumanalyser.h"
+#include "../../src/respeakeraudioring.h"
+#include "../../src/respeakerdeinterleaver.h"
+#include "../../src/respeakeralsacapture.h"
+#include "../../src/respeakeraudiograph.h"
+#include "../../src/respeakeranalysisframer.h"
 
 class QAudioInput;
 class QAudioOutput;
 class FrequencySpectrum;
+class ReSpeakerCaptureWriter;
+class ReSpeakerWavWriter;
 
 class AudioInterface : public QObject
 {
@@ -42,6 +51,14 @@ public:
      */
     void reset();
 
+    /**
+     * Load a 16 bit PCM WAV file for playback, in place of the buffer.
+     * Level and spectrum are analysed as it plays, on a memory mapping of
+     * the file where it can be mapped.
+     * \return Whether the file was opened and its format is supported
+     */
+    bool loadFile(const QString &fileName);
+
 
     QAudio::Mode        audioMode;
     QAudio::State       audioState;
@@ -68,9 +85,21 @@ public:
     QAudioFormat        audioFormat;
 
     QByteArray          audioBuffer;
+    // The other half of audioBuffer while playing a file: the waveform keeps
+    // the last buffer it was sent, so refills alternate between the two
+    // rather than detaching a fresh copy each time
+    QByteArray          playbackSpare;
     qint64              audioBufferLength;
     qint64              audioBufferPosition;
     qint64              audioDataLength;
+    // A memory-mapped file being played. Level and spectrum read the mapping
+    // in place, which may be larger than a QByteArray can address; the
+    // waveform is sent mappedView, a window of it starting at
+    // mappedViewPosition
+    const char         *mappedAudio;
+    qint64              mappedAudioLength;
+    QByteArray          mappedView;
+    qint64              mappedViewPosition;
 
     bool                generateTone;
     SweptTone           tone;
@@ -81,13 +110,80 @@ public:
 
 
 
+    // Level and spectrum analyse plane 0 of the deinterleaved channels
+    ReSpeakerDeinterleaver deinterleaver;
+    QVector<int>        channelMap;
+
     int                 spectrumBufferLength;
-    QByteArray          spectrumBuffer;
     SpectrumAnalyser    spectrumAnalyser;
-    qint64              spectrumPosition;
+
+    // Captured audio is analysed as it arrives, a window every hop, so
+    // nothing goes unanalysed. Results are held for uiRefreshTimer, which
+    // passes on the newest spectrum and the level with the peak since the
+    // last refresh. analysisPosition is where the next captured block is
+    // expected; a gap restarts the windows
+    ReSpeakerAnalysisFramer levelFramer;
+    ReSpeakerAnalysisFramer spectrumFramer;
+    int                 analysisHopFrames;
+    qint64              analysisPosition;
+    // Windows the analyser had no room for, shown through infoMessage()
+    unsigned int        spectrumHopsSkipped;
+    unsigned int        spectrumSkipsReported;
+    std::atomic<bool>   analysisPending;
+    QTimer              uiRefreshTimer;
+    int                 uiRefreshIntervalMs;
+    bool                levelUpdated;
+    int                 levelSamples;
+    bool                spectrumUpdated;
+    FrequencySpectrum   latestSpectrum;
+    qint64              latestSpectrumPosition;
 
     int                 audioCount;
 
+    // Captured blocks are also written here when set
+    ReSpeakerCaptureWriter *captureWriter;
+    // Blocks come from replayAudio() instead of the input device
+    bool                replaying;
+    // Drives audioNotify() when there is no QAudioInput to
+    QTimer              notifyTimer;
+
+    // Capture straight from ALSA instead of audioInput when
+    // alsaConfig.device is set. The reader thread writes into captureRing
+    ReSpeakerAlsaCaptureConfig alsaConfig;
+    ReSpeakerAlsaCapture* alsaCapture;
+    unsigned int        alsaOverrunsReported;
+
+    // Continuous capture: recording never stops. The newest
+    // BufferDurationUs of audio is kept in captureRing and the processing
+    // graph, waveform and capture file each read it through their own
+    // cursor, so memory use stays the same however long it runs
+    bool                continuousCapture;
+    ReSpeakerAudioRing* captureRing;
+    QByteArray          captureBlock;
+    ReSpeakerAudioRingCursor waveformCursor;
+    ReSpeakerAudioRingCursor diskCursor;
+    QByteArray          waveformBuffer;
+    QByteArray          diskBuffer;
+    // Streams the ring to wavRecordPath on a thread of its own
+    QString             wavRecordPath;
+    qint64              wavPreallocateBytes;
+    ReSpeakerWavWriter* wavWriter;
+    unsigned int        wavOverrunsReported;
+    // Captured audio enters processingGraph at captureSourceNode. While
+    // capturing continuously graphCursor follows captureRing; otherwise
+    // graphPosition is how much of audioBuffer has been passed on.
+    // Level and spectrum analysis are nodes of their own, run inline on
+    // this thread since they drive signals of this object
+    ReSpeakerAudioGraph processingGraph;
+    ReSpeakerAudioSourceNode* captureSourceNode;
+    ReSpeakerAudioCallbackNode* levelNode;
+    ReSpeakerAudioCallbackNode* spectrumNode;
+    ReSpeakerAudioRingCursor graphCursor;
+    qint64              graphPosition;
+    // Capture blocks for the graph, each CaptureBlockUs long, reused once
+    // the nodes let go of them
+    ReSpeakerAudioBlockPool* blockPool;
+
 
     /**
      * Length of the internal engine buffer.
@@ -105,6 +201,17 @@ public:
 
 
     bool initialize() ;
+
+    /**
+     * Prepare to record from audioInputDevice alone, for when there is no
+     * output device to play back on: 16 bit PCM at sampleRate, or the
+     * nearest rate the device supports, with channelCount channels, 0 for
+     * as many as the device offers. With an ALSA capture set, the rate and
+     * channel count are asked of the ALSA device when recording starts.
+     * \return false, with an error message, if the device cannot record
+     * 16 bit PCM
+     */
+    bool initializeInput(int sampleRate, int channelCount);
     void resetAudioDevices();
     bool selectFormat() ;
 
@@ -119,8 +226,84 @@ public:
     void setPlayPosition(qint64 position, bool forceEmit = false);
     void calculateLevel(qint64 position, qint64 length);
     void calculateSpectrum(qint64 position);
+    const char *analysisData(qint64 position) const;
     void setLevel(qreal rmsLevel, qreal peakLevel, int numSamples);
 
+    /**
+     * Tee captured audio into a capture file, with its format at the start
+     * of each recording. 0 stops the tee; the writer is not owned.
+     */
+    void setCaptureWriter(ReSpeakerCaptureWriter *writer);
+
+    /**
+     * Record continuously into a ring instead of stopping once the buffer
+     * is full. Takes effect from the next recording or replay. When the
+     * recording stops, the newest audio is left in the buffer for playback.
+     */
+    void setContinuousCapture(bool enabled);
+
+    /**
+     * Stream continuous captures to a WAV file, switching to RF64 past
+     * 4 GB. preallocateBytes of disk are reserved up front. An empty path
+     * stops writing from the next recording.
+     */
+    void setWavRecording(const QString &path, qint64 preallocateBytes = 0);
+
+    /**
+     * Select the input channels to analyse, in order. The first drives the
+     * level meter and spectrum. An empty map, or one that does not fit the
+     * format, takes every channel.
+     */
+    void setChannelMap(const QVector<int> &map);
+
+    /**
+     * Record from an ALSA capture device in mmap mode rather than the
+     * selected input device, with periodFrames per period and periodCount
+     * periods of buffering. Always captures continuously. An empty device
+     * goes back to QAudioInput. Suspending an ALSA capture stops it.
+     */
+    void setAlsaCapture(const QString &device, int periodFrames, int periodCount,
+                        bool realtime = false);
+
+    /**
+     * Graph of processing nodes fed with every block of captured audio, in
+     * order, through captureSource(). Add and connect nodes between
+     * recordings; nothing is copied into the graph while captureSource()
+     * has no outputs. It starts with the first block and stops with the
+     * recording. The level and spectrum analysis are nodes in it, named
+     * "level" and "spectrum".
+     */
+    ReSpeakerAudioGraph *graph() { return &processingGraph; }
+
+    /**
+     * Connect the level or spectrum analysis of captured audio to
+     * captureSource(), as they are by default, or take it out of the
+     * graph so that it costs nothing. Returns false while the graph is
+     * running.
+     */
+    bool setLevelAnalysis(bool enabled);
+    bool setSpectrumAnalysis(bool enabled);
+
+    /**
+     * Analyse the level and spectrum every hopFrames of captured audio; 0
+     * picks 20 ms. Takes effect when the format next changes.
+     */
+    void setAnalysisHop(int hopFrames);
+
+    /**
+     * How often levelChanged() and spectrumChanged() are emitted while
+     * audio is running, independent of how often it is analysed.
+     */
+    void setUiRefreshInterval(int intervalMs);
+
+    /**
+     * Spectrum windows of the current capture which were not analysed
+     * because the analyser fell behind. Each new count is also reported
+     * through infoMessage().
+     */
+    unsigned int spectrumWindowsSkipped() const { return spectrumHopsSkipped; }
+    ReSpeakerAudioNode *captureSource() const { return captureSourceNode; }
+
 signals:
     void stateChanged(QAudio::Mode mode, QAudio::State state);
 
@@ -193,11 +376,43 @@ public slots:
     void setAudioInputDevice(const QAudioDeviceInfo &device);
     void setAudioOutputDevice(const QAudioDeviceInfo &device);
 
+    /**
+     * Record from a capture being replayed instead of the input device.
+     * Blocks passed to replayAudio() take the same path through the buffer,
+     * level and spectrum analysis as blocks read from the device.
+     */
+    void startReplay(int sampleRate, int channelCount, int sampleSize);
+    void replayAudio(const QByteArray &block);
+    void stopReplay();
+
 private slots:
     void audioNotify();
     void audioStateChanged(QAudio::State state);
     void audioDataReady();
-    void spectrumChanged(const FrequencySpectrum &spectrum);
+    void spectrumChanged(qint64 position, const FrequencySpectrum &spectrum);
+    void analyseCapture();
+    void uiRefresh();
+
+private:
+    void audioDataAppended(qint64 length);
+    void setCaptureFormat(int sampleRate, int channelCount, int sampleSize);
+    void startAlsaCapture();
+    void startContinuousCapture();
+    void finishContinuousCapture();
+    void continuousNotify();
+    void reportOverrun(ReSpeakerAudioRingCursor &cursor, const QString &reader);
+    void computeLevel(const char *data, qint64 length);
+    void analyseLevelBlock(const ReSpeakerAudioBlockRef &block);
+    void analyseSpectrumBlock(const ReSpeakerAudioBlockRef &block);
+    bool setAnalysisNode(ReSpeakerAudioNode *node, bool enabled);
+    void restartAnalysis(qint64 position);
+    void reportSpectrumSkips();
+    void updateUiRefresh();
+    void analyseSpectrum(const char *data, qint64 position);
+    ReSpeakerAudioBlockPtr newBlock(size_t frameCount);
+    void deliverBlock(const ReSpeakerAudioBlockPtr &block);
+    void feedGraph();
+    void stopGraph();
 
 };
 
@@ -10,7 +10,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <iostream>
 
 #include "mainwindow.h"
@@ -19,6 +18,12 @@
 #include "micarray.h"
 #include "audiointerface.h"
 #include "../../src/respeakermicarray.h"
+#include "../../src/respeakeremulatortransport.h"
+#include "../../src/respeakerrecordingtransport.h"
+#include "../../src/respeakerreplaytransport.h"
+#include "respeakernotifier.h"
+#include "../../src/respeakerledscheduler.h"
+#include "../../src/respeakertrace.h"
 #include "levelmeter.h"
 #include "waveform.h"
 #include "progressbar.h"
@@ -26,11 +31,13 @@
 
 // Constants
 const int NullTimerId = -1;
-const int AutoReportInterval = 5; // ms
+// Register writes are coalesced and sent at most once per interval
+const int RegisterFlushInterval = 20; // ms
+// Startup light show: all white, then briefly dark before the array takes over
+const int StartupFlashMs = 1000;
+const int StartupDarkMs = 100;
 
 
-// micArray is the global handle to the far field microphone array
-ReSpeakerMicArray *micArray ;
 QColor ledAllColor ;
 
 
@@ -40,51 +47,195 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     audioInterface(new AudioInterface(this)),
     waveform(NULL),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    micArray(NULL),
+    ledScheduler(NULL),
+    captureWriter(NULL),
+    capturePlayer(NULL)
 {
     ui->setupUi(this);
     createUI() ;
     connectUI() ;
     hid_init();
-    micArray = new ReSpeakerMicArray() ;
-    std::cout << "Mic Array: " << micArray->handle << std::endl ;
+    // RESPEAKER_REPLAY plays back a capture saved with RESPEAKER_RECORD, at
+    // RESPEAKER_REPLAY_SPEED times real time (0 for as fast as possible)
+    const char *replayPath = getenv("RESPEAKER_REPLAY");
+    const char *recordPath = getenv("RESPEAKER_RECORD");
+    ReSpeakerTransport *transport = NULL;
+    if (replayPath) {
+        capturePlayer = new ReSpeakerCapturePlayer(replayPath);
+        if (!capturePlayer->isOpen())
+            std::cout << "Unable to open capture " << replayPath << std::endl;
+        transport = new ReSpeakerReplayTransport(capturePlayer);
+        // Audio goes through the same buffer and analysis as captured audio
+        AudioInterface *audio = audioInterface;
+        capturePlayer->setHandler(ReSpeakerCapture::AudioFormat, [audio] (const ReSpeakerCaptureRecord &record) {
+            ReSpeakerCaptureAudioFormat format;
+            if (record.data.size() < sizeof(format))
+                return;
+            memcpy(&format, &record.data[0], sizeof(format));
+            QMetaObject::invokeMethod(audio, "startReplay", Qt::QueuedConnection,
+                                      Q_ARG(int, format.sampleRate), Q_ARG(int, format.channelCount),
+                                      Q_ARG(int, format.sampleSize));
+        });
+        capturePlayer->setHandler(ReSpeakerCapture::AudioBlock, [audio] (const ReSpeakerCaptureRecord &record) {
+            QByteArray block(reinterpret_cast<const char *>(record.data.data()), record.data.size());
+            QMetaObject::invokeMethod(audio, "replayAudio", Qt::QueuedConnection, Q_ARG(QByteArray, block));
+        });
+    } else if (getenv("RESPEAKER_EMULATOR")) {
+        // No array needed: a talker walking around the array, pausing now and then
+        ReSpeakerEmulatorTransport *emulator = new ReSpeakerEmulatorTransport() ;
+        std::vector<ReSpeakerEmulatedReport> script ;
+        for (int angle = 0; angle < 360; angle += 30) {
+            ReSpeakerEmulatedReport talking = { (unsigned short)angle, 2, 100 } ;
+            ReSpeakerEmulatedReport silent = { (unsigned short)angle, 0, 40 } ;
+            script.push_back(talking) ;
+            script.push_back(silent) ;
+        }
+        emulator->setAutoReportScript(script, ReSpeakerEmulatorTransport::DefaultReportIntervalUs, 1000) ;
+        transport = emulator ;
+    } else if (recordPath) {
+        transport = ReSpeakerMicArray::openTransport() ;
+    }
+    if (transport && recordPath) {
+        captureWriter = new ReSpeakerCaptureWriter ;
+        if (captureWriter->open(recordPath)) {
+            transport = new ReSpeakerRecordingTransport(transport, captureWriter) ;
+            audioInterface->setCaptureWriter(captureWriter) ;
+        } else {
+            std::cout << "Unable to create capture " << recordPath << std::endl ;
+        }
+    }
+    // RESPEAKER_CONTINUOUS_CAPTURE keeps recording past the buffer length,
+    // holding the newest audio in a ring. RESPEAKER_WAV_RECORD streams it
+    // to a WAV file as well, reserving RESPEAKER_WAV_PREALLOCATE_MB of disk
+    const char *wavPath = getenv("RESPEAKER_WAV_RECORD") ;
+    audioInterface->setContinuousCapture(getenv("RESPEAKER_CONTINUOUS_CAPTURE") != NULL || wavPath != NULL) ;
+    if (wavPath) {
+        const char *preallocate = getenv("RESPEAKER_WAV_PREALLOCATE_MB") ;
+        audioInterface->setWavRecording(QString::fromLocal8Bit(wavPath),
+                                        preallocate ? qint64(atoll(preallocate)) << 20 : 0) ;
+    }
+    // RESPEAKER_CHANNEL_MAP lists the input channels to analyse, such as
+    // "1,2,3,4" for the raw microphones of the 6 channel firmware
+    if (const char *channels = getenv("RESPEAKER_CHANNEL_MAP")) {
+        QVector<int> map ;
+        foreach (const QString &channel, QString(channels).split(',', QString::SkipEmptyParts))
+            map << channel.trimmed().toInt() ;
+        audioInterface->setChannelMap(map) ;
+    }
+    // RESPEAKER_ALSA_DEVICE records from that ALSA device in mmap mode, for
+    // example "hw:1,0" for the array, or "null" to run without it. Periods
+    // are RESPEAKER_ALSA_PERIOD frames, RESPEAKER_ALSA_PERIODS of them, and
+    // RESPEAKER_ALSA_REALTIME asks for a realtime reader thread
+    if (const char *alsaDevice = getenv("RESPEAKER_ALSA_DEVICE")) {
+        const char *period = getenv("RESPEAKER_ALSA_PERIOD") ;
+        const char *periods = getenv("RESPEAKER_ALSA_PERIODS") ;
+        audioInterface->setAlsaCapture(QString::fromLocal8Bit(alsaDevice),
+                                       period ? atoi(period) : 160, periods ? atoi(periods) : 4,
+                                       getenv("RESPEAKER_ALSA_REALTIME") != NULL) ;
+    }
+    // RESPEAKER_ANALYSIS_HOP sets how many frames apart level and spectrum
+    // are analysed; RESPEAKER_UI_REFRESH_MS how often the meters redraw
+    if (const char *hop = getenv("RESPEAKER_ANALYSIS_HOP"))
+        audioInterface->setAnalysisHop(atoi(hop)) ;
+    if (const char *refresh = getenv("RESPEAKER_UI_REFRESH_MS"))
+        audioInterface->setUiRefreshInterval(atoi(refresh)) ;
+    // RESPEAKER_PLAY_WAV loads a WAV file, such as one recorded with
+    // RESPEAKER_WAV_RECORD, for the play button
+    if (const char *playPath = getenv("RESPEAKER_PLAY_WAV")) {
+        if (!audioInterface->loadFile(QString::fromLocal8Bit(playPath)))
+            std::cout << "Unable to load " << playPath << std::endl ;
+    }
+    micArray = transport ? new ReSpeakerMicArray(transport) : new ReSpeakerMicArray() ;
+    micArray->enableRegisterCache(ReSpeakerMicArray::DefaultCacheLifetimeMs, RegisterFlushInterval) ;
+    std::cout << "Mic Array: " << micArray->hidDevice() << std::endl ;
     initAudioDeviceSelector() ;
-    std::cout<<"Lights all white\n" ;
     ledAllColor = Qt::white ;
     QString qss = QString("background-color: %1").arg(ledAllColor.name());
     ui->ledAllColorButton->setStyleSheet(qss);
-    micArray->setLEDMode(1,ledAllColor.red(),ledAllColor.green(),ledAllColor.blue()) ;
-    usleep(1000000);
-    micArray->setLEDAllOff() ;
-    usleep(100000) ;
-    micArray->setLEDAutoVoiceLocated();
-    autoReportTimer = new QTimer(this) ;
-    // Get the list of audio devices and print them out
-    connect(autoReportTimer, SIGNAL(timeout()), this, SLOT(autoReportTimerExpired()));
-    autoReportTimer->start(AutoReportInterval);
-
-    unsigned char buf[4];
-
-    micArray->readRegister( 0x10, buf, 1);
-    printf("mic gain is %d\n", (char)buf[0]);
+    ledScheduler = new ReSpeakerLedScheduler(micArray) ;
+    // Auto reports are read on the mic array's own thread; we are only
+    // woken up when there is something in the queue
+    reSpeakerNotifier = new ReSpeakerNotifier(micArray, this) ;
+    CHECKED_CONNECT(reSpeakerNotifier, SIGNAL(autoReportsAvailable()),
+                    this, SLOT(autoReportsAvailable()));
+    micArray->startEventReader() ;
+    startDeviceBringUp() ;
+    if (capturePlayer) {
+        const char *speed = getenv("RESPEAKER_REPLAY_SPEED");
+        capturePlayer->start(speed ? atof(speed) : 1.0);
+    }
+}
 
-    buf[0] = 35;
-    micArray->writeRegister(0x10, buf, 1);
+// Nothing here waits for the array, so the window comes up at once. The
+// light show is played by the LED scheduler's thread and the DSP setup
+// runs on the array's command queue, which reports back through
+// deviceSetupFinished()
+void MainWindow::startDeviceBringUp ( void ) {
+    std::cout<<"Lights all white\n" ;
+    const unsigned char red = ledAllColor.red() ;
+    const unsigned char green = ledAllColor.green() ;
+    const unsigned char blue = ledAllColor.blue() ;
+    ledScheduler->setAnimation([red, green, blue] (long long elapsedMs, ReSpeakerLedFrame *frame) -> bool {
+        if (elapsedMs < StartupFlashMs) {
+            *frame = { 1, red, green, blue } ;
+            return true ;
+        }
+        if (elapsedMs < StartupFlashMs + StartupDarkMs) {
+            *frame = { 0, 0, 0, 0 } ;
+            return true ;
+        }
+        *frame = { 7, 0, 0, 0 } ;
+        return false ;
+    });
 
-    buf[0] = 0; // spk proc bypass
-    micArray->writeRegister(0x13, buf, 1);
+    // Initial DSP setup goes out as one pipelined batch
+    micGainRead = ReSpeakerRegisters::queueRead<ReSpeakerRegisters::MicGain>(&deviceSetup);
 
-    buf[0] = 0; // no AGC
-    micArray->writeRegister(0x2A, buf, 1);
+    ReSpeakerRegisters::queueWrite<ReSpeakerRegisters::MicGain>(&deviceSetup, 35);
 
-    fflush(stdout) ;
+    // spk proc bypass
+    ReSpeakerRegisters::queueWrite<ReSpeakerRegisters::SpeakerProcessingBypass>(&deviceSetup, 0);
 
+    // no AGC
+    ReSpeakerRegisters::queueWrite<ReSpeakerRegisters::AutomaticGainControl>(&deviceSetup, 0);
 
+    deviceSetupDone = micArray->submit(&deviceSetup, [this] (ReSpeakerTransaction *setup) {
+        const ReSpeakerTransaction::Operation &read = setup->operation(micGainRead) ;
+        int micGain = read.status == ReSpeakerTransaction::Done ?
+                    ReSpeakerRegisters::result<ReSpeakerRegisters::MicGain>(*setup, micGainRead) : -1 ;
+        QMetaObject::invokeMethod(this, "deviceSetupFinished", Qt::QueuedConnection,
+                                  Q_ARG(bool, setup->succeeded()), Q_ARG(int, micGain)) ;
+    }) ;
+}
 
+void MainWindow::deviceSetupFinished ( bool succeeded, int micGain ) {
+    if (succeeded) {
+        printf("mic gain is %d\n", micGain);
+    } else {
+        printf("Mic array setup failed\n");
+    }
+    fflush(stdout) ;
 }
 
 MainWindow::~MainWindow()
 {
+    // The setup callback posts to this window
+    if (deviceSetupDone.valid()) {
+        deviceSetupDone.wait() ;
+    }
+    // Save the device trace for tracedump when asked to
+    const char *tracePath = getenv("RESPEAKER_TRACE_FILE");
+    if (tracePath) {
+        ReSpeakerTrace::dump(tracePath);
+    }
+    delete ledScheduler;
+    // Stops the replay, if any, before its player goes
+    delete micArray;
+    delete capturePlayer;
+    audioInterface->setCaptureWriter(NULL);
+    delete captureWriter;
     delete ui;
 }
 
@@ -93,24 +244,32 @@ MainWindow::~MainWindow()
 //
 
 int MainWindow::setLEDAllRGB ( unsigned char redColor, unsigned char greenColor, unsigned char blueColor ) {
-    micArray->setLEDAllRGB(redColor,greenColor,blueColor);
+    ledScheduler->setLEDAllRGB(redColor,greenColor,blueColor);
+    return 1;
 }
 
 void MainWindow::on_ledAllOffRB_clicked()
 {
-    micArray->setLEDAllOff() ;
+    ledScheduler->setLEDAllOff() ;
 }
 
 void MainWindow::on_ledAudioVoiceLocatedRB_clicked()
 {
-    micArray->setLEDAllOff();
-    usleep(100000) ;
-    micArray->setLEDAutoVoiceLocated();
+    // Lights off for 100 ms before handing the ring back to the array,
+    // played by the scheduler instead of sleeping on the GUI thread
+    ledScheduler->setAnimation([] (long long elapsedMs, ReSpeakerLedFrame *frame) -> bool {
+        if (elapsedMs < 100) {
+            *frame = { 0, 0, 0, 0 } ;
+            return true ;
+        }
+        *frame = { 7, 0, 0, 0 } ;
+        return false ;
+    });
 }
 
 void MainWindow::on_ledWaitingRB_clicked()
 {
-    micArray->setLEDWaiting() ;
+    ledScheduler->setLEDWaiting() ;
 }
 
 
@@ -122,7 +281,7 @@ void MainWindow::on_ledAllColorButton_clicked()
         ledAllColor = color ;
         QString qss = QString("background-color: %1").arg(ledAllColor.name());
         ui->ledAllColorButton->setStyleSheet(qss);
-        micArray->setLEDAllRGB(ledAllColor.red(),ledAllColor.green(),ledAllColor.blue()) ;
+        ledScheduler->setLEDAllRGB(ledAllColor.red(),ledAllColor.green(),ledAllColor.blue()) ;
     }
 }
 
@@ -130,36 +289,36 @@ void MainWindow::on_ledAllOneColorRB_clicked()
 {
     QString qss = QString("background-color: %1").arg(ledAllColor.name());
     ui->ledAllColorButton->setStyleSheet(qss);
-    micArray->setLEDAllRGB(ledAllColor.red(),ledAllColor.green(),ledAllColor.blue()) ;
+    ledScheduler->setLEDAllRGB(ledAllColor.red(),ledAllColor.green(),ledAllColor.blue()) ;
 
 }
 
 void MainWindow::on_ledListeningRB_clicked()
 {
-    micArray->setLEDListening(45,0) ;
+    ledScheduler->setLEDListening(45,0) ;
 
 }
 
 void MainWindow::on_ledSpeakingRB_clicked()
 {
-    micArray->setLEDSpeaking(32,32,32) ;
+    ledScheduler->setLEDSpeaking(32,32,32) ;
 
 }
 
 void MainWindow::on_ledDisplayDataRB_clicked()
 {
-    micArray->setLEDData() ;
+    ledScheduler->setLEDData() ;
 }
 
 void MainWindow::on_ledVolumeSlider_actionTriggered(int action)
 {
-    micArray->setLEDVolume(ui->ledVolumeSlider->value());
+    ledScheduler->setLEDVolume(ui->ledVolumeSlider->value());
     ui->ledVolumeRB->setChecked(true) ;
 }
 
 void MainWindow::on_ledVolumeRB_clicked()
 {
-    micArray->setLEDVolume(ui->ledVolumeSlider->value()) ;
+    ledScheduler->setLEDVolume(ui->ledVolumeSlider->value()) ;
 
 }
 
@@ -295,16 +454,11 @@ void MainWindow::updateButtonStates()
     ui->playButton->setEnabled(playEnabled);
 }
 
-void MainWindow::autoReportTimerExpired() {
-    unsigned char vadActivity ;
-    unsigned short angle ;
-    int returned ;
-    returned = micArray->readAutoReport(&angle,&vadActivity);
-    if (returned) {
-        printf("Return: %d Angle: %d VAD: %d\n",returned, angle, vadActivity) ;
-        fflush(stdout);
-
-        switch (vadActivity) {
+void MainWindow::autoReportsAvailable() {
+    ReSpeakerAutoReport report ;
+    reSpeakerNotifier->acknowledge() ;
+    while (micArray->nextAutoReport(&report)) {
+        switch (report.vadActivity) {
           case 0:
             ui->vadIndicator->setPixmap(amberPixMap);
             break ;
@@ -323,8 +477,6 @@ void MainWindow::autoReportTimerExpired() {
 
 
     }
-    // printf("Voice Angle:\n") ;
-    // micArray->voiceAngle();
 }
 
 
@@ -5,7 +5,16 @@
 #include <QAudio>
 #include <QAudioFormat>
 
+#include <future>
+
+#include "../../src/respeakertransaction.h"
+
 class AudioInterface ;
+class ReSpeakerMicArray ;
+class ReSpeakerLedScheduler ;
+class ReSpeakerCaptureWriter ;
+class ReSpeakerCapturePlayer ;
+class ReSpeakerNotifier ;
 class FrequencySpectrum;
 class LevelMeter;
 class ProgressBar;
@@ -103,17 +112,34 @@ private slots:
 
     void updateButtonStates();
 
-    void autoReportTimerExpired() ;
+    void autoReportsAvailable() ;
+
+    void deviceSetupFinished ( bool succeeded, int micGain ) ;
 
 private:
     Ui::MainWindow *ui;
     void createUI ( void ) ;
     void initAudioDeviceSelector ( void );
+    void startDeviceBringUp ( void ) ;
 
     QIcon recordIcon ;
     QIcon pauseIcon ;
     QIcon playIcon ;
-    QTimer *autoReportTimer;
+    ReSpeakerNotifier *reSpeakerNotifier;
+
+    // The far field microphone array. Only the GUI thread calls it directly;
+    // other threads go through its command queue
+    ReSpeakerMicArray *micArray ;
+    // UI driven LED changes go through ledScheduler, which bounds their USB traffic
+    ReSpeakerLedScheduler *ledScheduler ;
+    // Set while recording or replaying a capture
+    ReSpeakerCaptureWriter *captureWriter ;
+    ReSpeakerCapturePlayer *capturePlayer ;
+
+    // Register setup sent in the background at startup
+    ReSpeakerTransaction deviceSetup ;
+    int micGainRead ;
+    std::future<int> deviceSetupDone ;
 
 };
 
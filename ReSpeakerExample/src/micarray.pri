@@ -10,6 +10,11 @@
 # Debug output from engine
 # DEFINES += LOG_ENGINE
 
+# Binary trace level of the mic array library: 0 off, 1 errors,
+# 2 (default) adds info, 3 adds every report and register access.
+# Set RESPEAKER_TRACE_FILE when running to save the trace on exit
+#DEFINES += RESPEAKER_TRACE_LEVEL=3
+
 # Dump input data to spectrum analyer, plus artefact data files
 #DEFINES += DUMP_SPECTRUMANALYSER
 
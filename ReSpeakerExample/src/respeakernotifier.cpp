@@ -0,0 +1,23 @@
+#include "respeakernotifier.h"
+#include "../../src/respeakermicarray.h"
+
+ReSpeakerNotifier::ReSpeakerNotifier(ReSpeakerMicArray *micArray, QObject *parent)
+    : QObject(parent)
+    , m_pending(false)
+{
+    micArray->setAutoReportCallback([this] (const ReSpeakerAutoReport &) {
+        reportQueued();
+    });
+}
+
+void ReSpeakerNotifier::acknowledge()
+{
+    m_pending = false;
+}
+
+// Runs on the reader thread; the signal is delivered through a queued connection
+void ReSpeakerNotifier::reportQueued()
+{
+    if (!m_pending.exchange(true))
+        emit autoReportsAvailable();
+}
@@ -0,0 +1,38 @@
+#ifndef RESPEAKERNOTIFIER_H
+#define RESPEAKERNOTIFIER_H
+
+#include <QObject>
+
+#include <atomic>
+
+class ReSpeakerMicArray ;
+
+/**
+ * Bridges the ReSpeakerMicArray event reader thread to the Qt event loop.
+ *
+ * The reader thread queues auto reports without taking a lock.  This object
+ * emits autoReportsAvailable() at most once per batch of queued reports; the
+ * receiving slot calls acknowledge() and then drains the queue with
+ * ReSpeakerMicArray::nextAutoReport().
+ */
+class ReSpeakerNotifier : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Installs the auto report callback, so construct before startEventReader()
+    explicit ReSpeakerNotifier(ReSpeakerMicArray *micArray, QObject *parent = 0);
+
+    // Re-arm the notification; call before draining the queue
+    void acknowledge();
+
+signals:
+    void autoReportsAvailable();
+
+private:
+    void reportQueued();
+
+    std::atomic<bool> m_pending;
+};
+
+#endif // RESPEAKERNOTIFIER_H
@@ -42,6 +42,7 @@
 #include "utils.h"
 #include "fftreal_wrapper.h"
 
+#include <string.h>
 #include <qmath.h>
 #include <qmetatype.h>
 #include <QAudioFormat>
@@ -55,6 +56,7 @@ SpectrumAnalyserThread::SpectrumAnalyserThread(QObject *parent)
     ,   m_numSamples(SpectrumLengthSamples)
     ,   m_windowFunction(DefaultWindowFunction)
     ,   m_window(SpectrumLengthSamples, 0.0)
+    ,   m_samples(SpectrumQueueWindows * SpectrumLengthSamples, 0.0f)
     ,   m_input(SpectrumLengthSamples, 0.0)
     ,   m_output(SpectrumLengthSamples, 0.0)
     ,   m_spectrum(SpectrumLengthSamples)
@@ -104,23 +106,13 @@ void SpectrumAnalyserThread::calculateWindow()
     }
 }
 
-void SpectrumAnalyserThread::calculateSpectrum(const QByteArray &buffer,
-                                                int inputFrequency,
-                                                int bytesPerSample)
+void SpectrumAnalyserThread::calculateSpectrum(int window, int inputFrequency)
 {
 #ifndef DISABLE_FFT
-    Q_ASSERT(buffer.size() == m_numSamples * bytesPerSample);
-
-    // Initialize data array
-    const char *ptr = buffer.constData();
-    for (int i=0; i<m_numSamples; ++i) {
-        const qint16 pcmSample = *reinterpret_cast<const qint16*>(ptr);
-        // Scale down to range [-1.0, 1.0]
-        const DataType realSample = pcmToReal(pcmSample);
-        const DataType windowedSample = realSample * m_window[i];
-        m_input[i] = windowedSample;
-        ptr += bytesPerSample;
-    }
+    // Initialize data array; the samples are one channel, already scaled
+    const float *ptr = m_samples.constData() + window * m_numSamples;
+    for (int i=0; i<m_numSamples; ++i)
+        m_input[i] = ptr[i] * m_window[i];
 
     // Calculate the FFT
     m_fft->calculateFFT(m_output.data(), m_input.data());
@@ -157,7 +149,9 @@ void SpectrumAnalyserThread::calculateSpectrum(const QByteArray &buffer,
 SpectrumAnalyser::SpectrumAnalyser(QObject *parent)
     :   QObject(parent)
     ,   m_thread(new SpectrumAnalyserThread(this))
-    ,   m_state(Idle)
+    ,   m_first(0)
+    ,   m_pending(0)
+    ,   m_cancelled(0)
 #ifdef DUMP_SPECTRUMANALYSER
     ,   m_count(0)
 #endif
@@ -194,37 +188,34 @@ void SpectrumAnalyser::setWindowFunction(WindowFunction type)
     Q_UNUSED(b) // suppress warnings in release builds
 }
 
-void SpectrumAnalyser::calculate(const QByteArray &buffer,
-                         const QAudioFormat &format)
+void SpectrumAnalyser::calculate(const float *samples, int sampleRate, qint64 position)
 {
     // QThread::currentThread is marked 'for internal use only', but
     // we're only using it for debug output here, so it's probably OK :)
     SPECTRUMANALYSER_DEBUG << "SpectrumAnalyser::calculate"
                            << QThread::currentThread()
-                           << "state" << m_state;
+                           << "pending" << m_pending;
 
     if (isReady()) {
-        Q_ASSERT(isPCMS16LE(format));
-
-        const int bytesPerSample = format.sampleSize() * format.channelCount() / 8;
+        // Copied into a window of the thread's own, which it leaves alone
+        // until calculationComplete() hands it back; nothing is allocated
+        const int window = (m_first + m_pending) % SpectrumQueueWindows;
+        memcpy(m_thread->samples(window), samples, SpectrumLengthSamples * sizeof(float));
+        m_positions[window] = position;
 
 #ifdef DUMP_SPECTRUMANALYSER
         m_count++;
-        const QString pcmFileName = m_outputDir.filePath(QString("spectrum_%1.pcm").arg(m_count, 4, 10, QChar('0')));
+        const QString pcmFileName = m_outputDir.filePath(QString("spectrum_%1.f32").arg(m_count, 4, 10, QChar('0')));
         QFile pcmFile(pcmFileName);
         pcmFile.open(QIODevice::WriteOnly);
-        const int bufferLength = m_numSamples * bytesPerSample;
-        pcmFile.write(buffer, bufferLength);
+        pcmFile.write(reinterpret_cast<const char *>(samples), SpectrumLengthSamples * sizeof(float));
 
         m_textStream << "TimeDomain " << m_count << "\n";
-        const qint16* input = reinterpret_cast<const qint16*>(buffer);
-        for (int i=0; i<m_numSamples; ++i) {
-            m_textStream << i << "\t" << *input << "\n";
-            input += format.channels();
-        }
+        for (int i=0; i<SpectrumLengthSamples; ++i)
+            m_textStream << i << "\t" << samples[i] << "\n";
 #endif
 
-        m_state = Busy;
+        m_pending++;
 
         // Invoke SpectrumAnalyserThread::calculateSpectrum using QMetaObject.  If
         // m_thread is in a different thread from the current thread, the
@@ -233,9 +224,8 @@ void SpectrumAnalyser::calculate(const QByteArray &buffer,
         // emitted by m_thread.
         const bool b = QMetaObject::invokeMethod(m_thread, "calculateSpectrum",
                                   Qt::AutoConnection,
-                                  Q_ARG(QByteArray, buffer),
-                                  Q_ARG(int, format.sampleRate()),
-                                  Q_ARG(int, bytesPerSample));
+                                  Q_ARG(int, window),
+                                  Q_ARG(int, sampleRate));
         Q_ASSERT(b);
         Q_UNUSED(b) // suppress warnings in release builds
 
@@ -253,13 +243,12 @@ void SpectrumAnalyser::calculate(const QByteArray &buffer,
 
 bool SpectrumAnalyser::isReady() const
 {
-    return (Idle == m_state);
+    return m_pending < SpectrumQueueWindows;
 }
 
 void SpectrumAnalyser::cancelCalculation()
 {
-    if (Busy == m_state)
-        m_state = Cancelled;
+    m_cancelled = m_pending;
 }
 
 
@@ -269,8 +258,12 @@ void SpectrumAnalyser::cancelCalculation()
 
 void SpectrumAnalyser::calculationComplete(const FrequencySpectrum &spectrum)
 {
-    Q_ASSERT(Idle != m_state);
-    if (Busy == m_state)
-        emit spectrumChanged(spectrum);
-    m_state = Idle;
+    Q_ASSERT(m_pending > 0);
+    const qint64 position = m_positions[m_first];
+    m_first = (m_first + 1) % SpectrumQueueWindows;
+    m_pending--;
+    if (m_cancelled > 0)
+        m_cancelled--;
+    else
+        emit spectrumChanged(position, spectrum);
 }
@@ -65,6 +65,10 @@ class FFTRealWrapper;
 
 class SpectrumAnalyserThreadPrivate;
 
+// Windows which may wait for, or be in, the calculation at once, enough
+// for every hop of a notify interval of capture to be analysed
+const int SpectrumQueueWindows = 16;
+
 /**
  * Implementation of the spectrum analysis which can be run in a
  * separate thread.
@@ -77,11 +81,16 @@ public:
     SpectrumAnalyserThread(QObject *parent);
     ~SpectrumAnalyserThread();
 
+    /*
+     * SpectrumLengthSamples samples of one of SpectrumQueueWindows windows,
+     * written by the owning SpectrumAnalyser only while no calculation of
+     * that window is outstanding
+     */
+    float *samples(int window) { return m_samples.data() + window * m_numSamples; }
+
 public slots:
     void setWindowFunction(WindowFunction type);
-    void calculateSpectrum(const QByteArray &buffer,
-                           int inputFrequency,
-                           int bytesPerSample);
+    void calculateSpectrum(int window, int inputFrequency);
 
 signals:
     void calculationComplete(const FrequencySpectrum &spectrum);
@@ -105,6 +114,7 @@ private:
 #endif
     QVector<DataType>                           m_window;
 
+    QVector<float>                              m_samples;
     QVector<DataType>                           m_input;
     QVector<DataType>                           m_output;
 
@@ -140,31 +150,35 @@ public:
     /*
      * Calculate a frequency spectrum
      *
-     * \param buffer       Audio data
-     * \param format       Format of audio data
+     * \param samples      SpectrumLengthSamples samples of one channel,
+     *                     scaled to [-1.0, 1.0]
+     * \param sampleRate   Sample rate of the channel
+     *
+     * \param position     Where the samples start, passed back with the result
      *
      * Frequency spectrum is calculated asynchronously.  The result is returned
-     * via the spectrumChanged signal.
+     * via the spectrumChanged signal.  Up to SpectrumQueueWindows calculations
+     * are queued, and their results come back in order.
      *
-     * An ongoing calculation can be cancelled by calling cancelCalculation().
+     * Ongoing calculations can be cancelled by calling cancelCalculation().
      *
      */
-    void calculate(const QByteArray &buffer, const QAudioFormat &format);
+    void calculate(const float *samples, int sampleRate, qint64 position = 0);
 
     /*
-     * Check whether the object is ready to perform another calculation
+     * Check whether the object has room to queue another calculation
      */
     bool isReady() const;
 
     /*
-     * Cancel an ongoing calculation
+     * Cancel the queued calculations
      *
      * Note that cancelling is asynchronous.
      */
     void cancelCalculation();
 
 signals:
-    void spectrumChanged(const FrequencySpectrum &spectrum);
+    void spectrumChanged(qint64 position, const FrequencySpectrum &spectrum);
 
 private slots:
     void calculationComplete(const FrequencySpectrum &spectrum);
@@ -176,13 +190,12 @@ private:
 
     SpectrumAnalyserThread*    m_thread;
 
-    enum State {
-        Idle,
-        Busy,
-        Cancelled
-    };
-
-    State              m_state;
+    // A ring of the windows handed to m_thread: m_pending of them from
+    // m_first, the oldest of which are to be dropped while m_cancelled
+    int                m_first;
+    int                m_pending;
+    int                m_cancelled;
+    qint64             m_positions[SpectrumQueueWindows];
 
 #ifdef DUMP_SPECTRUMANALYSER
     QDir                m_outputDir;
@@ -1,4 +1,5 @@
 include(micarray.pri)
+include(../../src/respeaker.pri)
 
 TEMPLATE = app
 
@@ -6,6 +7,8 @@ TARGET = micArray
 
 QT       += multimedia widgets
 
+CONFIG   += c++11
+
 SOURCES += main.cpp\
     mainwindow.cpp \
     audiointerface.cpp \
@@ -14,12 +17,11 @@ SOURCES += main.cpp\
     tonegenerator.cpp \
     spectrumanalyser.cpp \
     frequencyspectrum.cpp \
-    ../../src/respeakermicarray.cpp \
+    respeakernotifier.cpp \
     progressbar.cpp \
     levelmeter.cpp \
     spectrograph.cpp \
-    waveform.cpp \
-    ../../hidapi/libusb/hid.c
+    waveform.cpp
 
 HEADERS  += mainwindow.h \
     audiointerface.h \
@@ -29,12 +31,11 @@ HEADERS  += mainwindow.h \
     tonegenerator.h \
     spectrumanalyser.h \
     frequencyspectrum.h \
-    ../../src/respeakermicarray.h \
+    respeakernotifier.h \
     levelmeter.h \
     progressbar.h \
     spectrograph.h \
-    waveform.h \
-    ../../hidapi/hidapi/hidapi.h
+    waveform.h
 
 FORMS    += ../mainwindow.ui
 
@@ -390,7 +390,7 @@ void Waveform::paintTile(int index)
     for (int i=0; i<numSamples; ++i) {
         const qint16* ptr = buffer + i * m_format.channelCount();
 
-        const int offset = reinterpret_cast<const char*>(ptr) - m_buffer.constData();
+        const qint64 offset = reinterpret_cast<const char*>(ptr) - m_buffer.constData();
         Q_ASSERT(offset >= 0);
         Q_ASSERT(offset < m_bufferLength);
         Q_UNUSED(offset);
@@ -67,20 +67,12 @@ struct WAVEHeader
     quint16     bitsPerSample;
 };
 
-struct DATAHeader
-{
-    chunk       descriptor;
-};
-
-struct CombinedHeader
-{
-    RIFFHeader  riff;
-    WAVEHeader  wave;
-};
-
 WavFile::WavFile(QObject *parent)
     : QFile(parent)
     , m_headerLength(0)
+    , m_dataLength(0)
+    , m_mappedData(0)
+    , m_mapFailed(false)
 {
 
 }
@@ -92,6 +84,15 @@ bool WavFile::open(const QString &fileName)
     return QFile::open(QIODevice::ReadOnly) && readHeader();
 }
 
+// QFile unmaps everything it mapped when it closes
+void WavFile::close()
+{
+    QFile::close();
+    m_dataLength = 0;
+    m_mappedData = 0;
+    m_mapFailed = false;
+}
+
 const QAudioFormat &WavFile::fileFormat() const
 {
     return m_fileFormat;
@@ -102,48 +103,88 @@ qint64 WavFile::headerLength() const
 return m_headerLength;
 }
 
+qint64 WavFile::dataLength() const
+{
+    return m_dataLength;
+}
+
+const char *WavFile::mappedData()
+{
+    if (m_mappedData || m_mapFailed || m_dataLength <= 0)
+        return m_mappedData;
+    // Tried once; callers fall back to reading
+    m_mapFailed = true;
+    const int sampleBytes = m_fileFormat.sampleSize() / 8;
+    if (sampleBytes <= 0 || m_headerLength % sampleBytes != 0)
+        return 0;
+    if (uchar *data = map(m_headerLength, m_dataLength)) {
+        m_mappedData = reinterpret_cast<const char *>(data);
+        m_mapFailed = false;
+    }
+    return m_mappedData;
+}
+
 bool WavFile::readHeader()
 {
     seek(0);
-    CombinedHeader header;
-    bool result = read(reinterpret_cast<char *>(&header), sizeof(CombinedHeader)) == sizeof(CombinedHeader);
-    if (result) {
-        if ((memcmp(&header.riff.descriptor.id, "RIFF", 4) == 0
-            || memcmp(&header.riff.descriptor.id, "RIFX", 4) == 0)
-            && memcmp(&header.riff.type, "WAVE", 4) == 0
-            && memcmp(&header.wave.descriptor.id, "fmt ", 4) == 0
-            && (header.wave.audioFormat == 1 || header.wave.audioFormat == 0)) {
-
-            // Read off remaining header information
-            DATAHeader dataHeader;
-
-            if (qFromLittleEndian<quint32>(header.wave.descriptor.size) > sizeof(WAVEHeader)) {
-                // Extended data available
-                quint16 extraFormatBytes;
-                if (peek((char*)&extraFormatBytes, sizeof(quint16)) != sizeof(quint16))
-                    return false;
-                const qint64 throwAwayBytes = sizeof(quint16) + qFromLittleEndian<quint16>(extraFormatBytes);
-                if (read(throwAwayBytes).size() != throwAwayBytes)
-                    return false;
+    RIFFHeader riff;
+    bool result = read(reinterpret_cast<char *>(&riff), sizeof(RIFFHeader)) == sizeof(RIFFHeader)
+            && (memcmp(&riff.descriptor.id, "RIFF", 4) == 0
+                || memcmp(&riff.descriptor.id, "RIFX", 4) == 0
+                || memcmp(&riff.descriptor.id, "RF64", 4) == 0)
+            && memcmp(&riff.type, "WAVE", 4) == 0;
+
+    // Walk the chunks up to the data, skipping any we do not use, such as
+    // the JUNK and ds64 chunks ReSpeakerWavWriter puts before fmt
+    bool haveFormat = false;
+    while (result) {
+        chunk descriptor;
+        if (read(reinterpret_cast<char *>(&descriptor), sizeof(chunk)) != sizeof(chunk)) {
+            result = false;
+            break;
+        }
+        const quint32 chunkSize = qFromLittleEndian<quint32>(descriptor.size);
+        if (memcmp(&descriptor.id, "data", 4) == 0) {
+            result = haveFormat;
+            // The rest of the file, unless the chunk says it is shorter: an
+            // RF64 data chunk, or one still being written, gives no size
+            m_dataLength = size() - pos();
+            if (memcmp(&riff.descriptor.id, "RF64", 4) != 0 && 0 != chunkSize && 0xffffffff != chunkSize)
+                m_dataLength = qMin(m_dataLength, qint64(chunkSize));
+            if (haveFormat && m_fileFormat.bytesPerFrame() > 0)
+                m_dataLength -= m_dataLength % m_fileFormat.bytesPerFrame();
+            break;
+        }
+        if (memcmp(&descriptor.id, "fmt ", 4) == 0 && chunkSize >= sizeof(WAVEHeader) - sizeof(chunk)) {
+            WAVEHeader wave;
+            const qint64 formatBytes = sizeof(WAVEHeader) - sizeof(chunk);
+            if (read(reinterpret_cast<char *>(&wave) + sizeof(chunk), formatBytes) != formatBytes
+                || (wave.audioFormat != 1 && wave.audioFormat != 0)) {
+                result = false;
+                break;
             }
 
-            if (read((char*)&dataHeader, sizeof(DATAHeader)) != sizeof(DATAHeader))
-                return false;
-
             // Establish format
-            if (memcmp(&header.riff.descriptor.id, "RIFF", 4) == 0)
-                m_fileFormat.setByteOrder(QAudioFormat::LittleEndian);
-            else
+            if (memcmp(&riff.descriptor.id, "RIFX", 4) == 0)
                 m_fileFormat.setByteOrder(QAudioFormat::BigEndian);
+            else
+                m_fileFormat.setByteOrder(QAudioFormat::LittleEndian);
 
-            int bps = qFromLittleEndian<quint16>(header.wave.bitsPerSample);
-            m_fileFormat.setChannelCount(qFromLittleEndian<quint16>(header.wave.numChannels));
+            int bps = qFromLittleEndian<quint16>(wave.bitsPerSample);
+            m_fileFormat.setChannelCount(qFromLittleEndian<quint16>(wave.numChannels));
             m_fileFormat.setCodec("audio/pcm");
-            m_fileFormat.setSampleRate(qFromLittleEndian<quint32>(header.wave.sampleRate));
-            m_fileFormat.setSampleSize(qFromLittleEndian<quint16>(header.wave.bitsPerSample));
+            m_fileFormat.setSampleRate(qFromLittleEndian<quint32>(wave.sampleRate));
+            m_fileFormat.setSampleSize(qFromLittleEndian<quint16>(wave.bitsPerSample));
             m_fileFormat.setSampleType(bps == 8 ? QAudioFormat::UnSignedInt : QAudioFormat::SignedInt);
+            haveFormat = true;
+
+            // Extended format data, if any
+            if (!seek(pos() + chunkSize - formatBytes + (chunkSize & 1)))
+                result = false;
         } else {
-            result = false;
+            // Chunks are padded to an even length
+            if (!seek(pos() + chunkSize + (chunkSize & 1)))
+                result = false;
         }
     }
     m_headerLength = pos();
@@ -52,15 +52,34 @@ public:
 
     using QFile::open;
     bool open(const QString &fileName);
+    void close();
     const QAudioFormat &fileFormat() const;
     qint64 headerLength() const;
 
+    /**
+     * Length of the audio data in bytes, in whole frames
+     */
+    qint64 dataLength() const;
+
+    /**
+     * The audio data mapped read only, from its first sample and
+     * dataLength() long, so analysis can read any part of a long recording
+     * without seeking or copying; pages are only read in as they are
+     * touched. Null if the file cannot be mapped, e.g. a multi-gigabyte
+     * file in a 32 bit process, or if the samples would not be aligned.
+     * Valid until the file is closed.
+     */
+    const char *mappedData();
+
 private:
     bool readHeader();
 
 private:
     QAudioFormat m_fileFormat;
     qint64 m_headerLength;
+    qint64 m_dataLength;
+    const char *m_mappedData;
+    bool m_mapFailed;
 };
 
 #endif // WAVFILE_H
@@ -0,0 +1,98 @@
+// tracedump - print a ReSpeakerTrace file as text
+//
+// Usage: tracedump [-t thread] tracefile
+// Times are shown in milliseconds relative to the first record
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../../src/respeakertrace.h"
+
+static const char *levelName ( int level ) {
+    switch (level) {
+    case RESPEAKER_TRACE_LEVEL_ERROR:   return "E" ;
+    case RESPEAKER_TRACE_LEVEL_INFO:    return "I" ;
+    case RESPEAKER_TRACE_LEVEL_DEBUG:   return "D" ;
+    default:                            return "?" ;
+    }
+}
+
+static void printRecord ( const ReSpeakerTraceRecord &r, long long startUs ) {
+    printf("%12.3f  t%-2u %s %-18s ", (r.timestampUs - startUs) / 1000.0,
+           r.thread, levelName(r.level), ReSpeakerTrace::eventName(r.event)) ;
+    switch (r.event) {
+    case ReSpeakerTrace::AutoReport:
+        printf("angle %d vad %d\n", r.a, r.b) ;
+        break ;
+    case ReSpeakerTrace::AutoReportDropped:
+        printf("total %d\n", r.a) ;
+        break ;
+    case ReSpeakerTrace::RegisterRead:
+    case ReSpeakerTrace::RegisterWrite:
+    case ReSpeakerTrace::RegisterTimeout:
+        printf("reg 0x%02x len %d\n", r.a, r.b) ;
+        break ;
+    case ReSpeakerTrace::RegisterValue:
+        printf("reg 0x%02x value %d\n", r.a, r.b) ;
+        break ;
+    case ReSpeakerTrace::LedFrame:
+        printf("mode %d data %d %d %d\n", r.a, (r.b >> 16) & 0xFF, (r.b >> 8) & 0xFF, r.b & 0xFF) ;
+        break ;
+    case ReSpeakerTrace::TransportError:
+        printf("result %d reg 0x%02x\n", r.a, r.b) ;
+        break ;
+    default:
+        printf("%d %d\n", r.a, r.b) ;
+        break ;
+    }
+}
+
+int main ( int argc, char *argv[] ) {
+    const char *path = 0 ;
+    long thread = -1 ;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thread = strtol(argv[++i], 0, 10) ;
+        } else {
+            path = argv[i] ;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "Usage: %s [-t thread] tracefile\n", argv[0]) ;
+        return 2 ;
+    }
+
+    FILE *file = fopen(path, "rb") ;
+    if (!file) {
+        perror(path) ;
+        return 1 ;
+    }
+    uint32_t header[4] ;
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != ReSpeakerTrace::DumpMagic) {
+        fprintf(stderr, "%s: not a trace file\n", path) ;
+        fclose(file) ;
+        return 1 ;
+    }
+    if (header[1] != ReSpeakerTrace::DumpVersion || header[2] != sizeof(ReSpeakerTraceRecord)) {
+        fprintf(stderr, "%s: unsupported version %u, record size %u\n", path, header[1], header[2]) ;
+        fclose(file) ;
+        return 1 ;
+    }
+    std::vector<ReSpeakerTraceRecord> records(header[3]) ;
+    size_t count = records.empty() ? 0 : fread(&records[0], sizeof(ReSpeakerTraceRecord), records.size(), file) ;
+    fclose(file) ;
+    if (count < records.size()) {
+        fprintf(stderr, "%s: truncated, %zu of %zu records\n", path, count, records.size()) ;
+        records.resize(count) ;
+    }
+
+    long long startUs = records.empty() ? 0 : records[0].timestampUs ;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (thread < 0 || records[i].thread == (uint32_t)thread) {
+            printRecord(records[i], startUs) ;
+        }
+    }
+    return 0 ;
+}
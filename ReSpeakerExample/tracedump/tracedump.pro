@@ -0,0 +1,12 @@
+# Decodes trace files saved by ReSpeakerTrace::dump
+TEMPLATE = app
+
+TARGET = tracedump
+
+CONFIG   += console c++11
+CONFIG   -= qt app_bundle
+
+SOURCES += main.cpp \
+    ../../src/respeakertrace.cpp
+
+HEADERS += ../../src/respeakertrace.h
@@ -0,0 +1,144 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+
+// Unbounded multiple producer / single consumer queue.
+// push() may be called from any number of threads at once and pop() from
+// one consumer thread. Producers never take a lock or wait for each other:
+// each push is one atomic exchange, with its node taken from a ring of
+// PoolSize free nodes allocated up front which pop() hands nodes back to.
+// Only while more than PoolSize are queued does a push allocate. A push
+// which is still linking its node can hide the nodes behind it from pop()
+// for a moment, so a consumer which finds the queue empty must be woken by
+// the producer rather than trust the result forever.
+template <typename T, size_t PoolSize = 64>
+class MpscQueue
+{
+public:
+    MpscQueue() : head(&stub), tail(&stub), freeIn(0), freeOut(0) {
+        stub.next.store(0, std::memory_order_relaxed) ;
+        for (size_t i = 0; i < PoolSize; i++) {
+            freeNodes[i].sequence.store(i, std::memory_order_relaxed) ;
+        }
+        for (size_t i = 0; i < PoolSize; i++) {
+            release(new Node) ;
+        }
+    }
+
+    // Consumer side; nothing may be pushing any more
+    ~MpscQueue() {
+        T value ;
+        while (pop(&value)) {
+        }
+        if (tail != &stub) {
+            delete tail ;
+        }
+        Node *node ;
+        while ((node = acquire()) != 0) {
+            delete node ;
+        }
+    }
+
+    void push ( T value ) {
+        Node *node = acquire() ;
+        if (node == 0) {
+            node = new Node ;
+        }
+        node->value = std::move(value) ;
+        node->next.store(0, std::memory_order_relaxed) ;
+        Node *previous = head.exchange(node, std::memory_order_acq_rel) ;
+        previous->next.store(node, std::memory_order_release) ;
+    }
+
+    // Consumer side only. Returns false if the queue is empty
+    bool pop ( T *value ) {
+        Node *first = tail ;
+        Node *next = first->next.load(std::memory_order_acquire) ;
+        if (next == 0) {
+            return false ;
+        }
+        // next becomes the new stub; its value has been taken
+        *value = std::move(next->value) ;
+        next->value = T() ;
+        tail = next ;
+        if (first != &stub && !release(first)) {
+            delete first ;
+        }
+        return true ;
+    }
+
+    // Consumer side only
+    bool empty ( void ) const {
+        return tail->next.load(std::memory_order_acquire) == 0 ;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node *> next ;
+        T value ;
+    };
+
+    // A slot of the free node ring (Vyukov's bounded queue): sequence says
+    // whether the slot is waiting for a node or holds one
+    struct FreeSlot {
+        std::atomic<size_t> sequence ;
+        Node *node ;
+    };
+
+    static_assert(PoolSize > 0 && (PoolSize & (PoolSize - 1)) == 0, "MpscQueue pool size is a power of two") ;
+
+    MpscQueue ( const MpscQueue & ) ;
+    MpscQueue &operator= ( const MpscQueue & ) ;
+
+    // Any producer. Returns 0 if every pooled node is in use
+    Node *acquire ( void ) {
+        size_t position = freeOut.load(std::memory_order_relaxed) ;
+        for (;;) {
+            FreeSlot *slot = &freeNodes[position & (PoolSize - 1)] ;
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire) ;
+            const ptrdiff_t ahead = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1) ;
+            if (ahead == 0) {
+                if (freeOut.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    Node *node = slot->node ;
+                    slot->sequence.store(position + PoolSize, std::memory_order_release) ;
+                    return node ;
+                }
+            } else if (ahead < 0) {
+                return 0 ;
+            } else {
+                position = freeOut.load(std::memory_order_relaxed) ;
+            }
+        }
+    }
+
+    // Consumer side only. Returns false if the ring is full
+    bool release ( Node *node ) {
+        const size_t position = freeIn ;
+        FreeSlot *slot = &freeNodes[position & (PoolSize - 1)] ;
+        if (slot->sequence.load(std::memory_order_acquire) != position) {
+            return false ;
+        }
+        freeIn = position + 1 ;
+        slot->node = node ;
+        slot->sequence.store(position + 1, std::memory_order_release) ;
+        return true ;
+    }
+
+    Node stub ;
+    // Producers swing head; kept off the consumer's line
+    char padStub[64] ;
+    std::atomic<Node *> head ;
+    char padHead[64 - sizeof(std::atomic<Node *>)] ;
+    Node *tail ;
+    char padTail[64 - sizeof(Node *)] ;
+
+    FreeSlot freeNodes[PoolSize] ;
+    size_t freeIn ;
+    char padFreeIn[64 - sizeof(size_t)] ;
+    std::atomic<size_t> freeOut ;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,67 @@
+# The mic array library, for projects which build it in.
+# Link libusb-1.0 and pthread as well.
+
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD/../hidapi/hidapi/
+INCLUDEPATH += /usr/include/libusb-1.0/
+
+# The ALSA mmap capture backend, when the ALSA development files are there
+packagesExist(alsa) {
+    DEFINES += HAVE_ALSA
+    LIBS += -lasound
+}
+
+SOURCES += \
+    $$PWD/respeakermicarray.cpp \
+    $$PWD/respeakertransport.cpp \
+    $$PWD/respeakerlibusbtransport.cpp \
+    $$PWD/respeakeremulatortransport.cpp \
+    $$PWD/respeakerrecordingtransport.cpp \
+    $$PWD/respeakerreplaytransport.cpp \
+    $$PWD/respeakerdevicemanager.cpp \
+    $$PWD/respeakerledscheduler.cpp \
+    $$PWD/respeakerdirectionhistory.cpp \
+    $$PWD/respeakertransaction.cpp \
+    $$PWD/respeakercommandqueue.cpp \
+    $$PWD/respeakerregistercache.cpp \
+    $$PWD/respeakerregisters.cpp \
+    $$PWD/respeakersnapshot.cpp \
+    $$PWD/respeakercapture.cpp \
+    $$PWD/respeakeraudioring.cpp \
+    $$PWD/respeakerwavwriter.cpp \
+    $$PWD/respeakerdeinterleaver.cpp \
+    $$PWD/respeakeralsacapture.cpp \
+    $$PWD/respeakeraudioblock.cpp \
+    $$PWD/respeakeraudiograph.cpp \
+    $$PWD/respeakeranalysisframer.cpp \
+    $$PWD/respeakertrace.cpp \
+    $$PWD/../hidapi/libusb/hid.c
+
+HEADERS += \
+    $$PWD/respeakermicarray.h \
+    $$PWD/respeakertransport.h \
+    $$PWD/respeakerlibusbtransport.h \
+    $$PWD/respeakeremulatortransport.h \
+    $$PWD/respeakerrecordingtransport.h \
+    $$PWD/respeakerreplaytransport.h \
+    $$PWD/respeakerdevicemanager.h \
+    $$PWD/respeakerledscheduler.h \
+    $$PWD/respeakerdirectionhistory.h \
+    $$PWD/respeakertransaction.h \
+    $$PWD/respeakercommandqueue.h \
+    $$PWD/respeakerregistercache.h \
+    $$PWD/respeakerregisters.h \
+    $$PWD/respeakersnapshot.h \
+    $$PWD/respeakercapture.h \
+    $$PWD/respeakeraudioring.h \
+    $$PWD/respeakerwavwriter.h \
+    $$PWD/respeakerdeinterleaver.h \
+    $$PWD/respeakeralsacapture.h \
+    $$PWD/respeakeraudioblock.h \
+    $$PWD/respeakeraudiograph.h \
+    $$PWD/respeakeranalysisframer.h \
+    $$PWD/respeakertrace.h \
+    $$PWD/spscqueue.h \
+    $$PWD/mpscqueue.h \
+    $$PWD/../hidapi/hidapi/hidapi.h
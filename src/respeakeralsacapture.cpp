@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include "respeakeralsacapture.h"
+
+const int ReSpeakerAlsaCapture::WaitTimeoutMs ;
+
+ReSpeakerAlsaCaptureConfig::ReSpeakerAlsaCaptureConfig()
+    : device("default")
+    , sampleRate(16000)
+    , channelCount(1)
+    , periodFrames(160)
+    , periodCount(4)
+    , realtime(false)
+    , realtimePriority(50)
+{
+}
+
+ReSpeakerAlsaCapture::ReSpeakerAlsaCapture()
+    : pcm(0)
+    , bufferSize(0)
+    , running(false)
+    , captured(0)
+    , overrunCount(0)
+    , realtimeGranted(false)
+{
+}
+
+ReSpeakerAlsaCapture::~ReSpeakerAlsaCapture()
+{
+    close() ;
+}
+
+bool ReSpeakerAlsaCapture::isOpen ( void ) const {
+    return pcm != 0 ;
+}
+
+const std::string &ReSpeakerAlsaCapture::errorString ( void ) const {
+    return error ;
+}
+
+unsigned int ReSpeakerAlsaCapture::sampleRate ( void ) const {
+    return config.sampleRate ;
+}
+
+unsigned int ReSpeakerAlsaCapture::channelCount ( void ) const {
+    return config.channelCount ;
+}
+
+unsigned int ReSpeakerAlsaCapture::periodFrames ( void ) const {
+    return config.periodFrames ;
+}
+
+unsigned int ReSpeakerAlsaCapture::bufferFrames ( void ) const {
+    return bufferSize ;
+}
+
+bool ReSpeakerAlsaCapture::isRunning ( void ) const {
+    return running ;
+}
+
+unsigned long long ReSpeakerAlsaCapture::framesCaptured ( void ) const {
+    return captured ;
+}
+
+unsigned int ReSpeakerAlsaCapture::overruns ( void ) const {
+    return overrunCount ;
+}
+
+bool ReSpeakerAlsaCapture::isRealtime ( void ) const {
+    return realtimeGranted ;
+}
+
+bool ReSpeakerAlsaCapture::start ( ReSpeakerAlsaCaptureHandler callback ) {
+    if (pcm == 0 || running) {
+        return false ;
+    }
+    handler = callback ;
+    captured = 0 ;
+    overrunCount = 0 ;
+    running = true ;
+    thread = std::thread(&ReSpeakerAlsaCapture::run, this) ;
+    return true ;
+}
+
+// The reader notices within WaitTimeoutMs
+void ReSpeakerAlsaCapture::stop ( void ) {
+    if (!thread.joinable()) {
+        return ;
+    }
+    running = false ;
+    thread.join() ;
+    handler = ReSpeakerAlsaCaptureHandler() ;
+}
+
+#ifdef HAVE_ALSA
+
+bool ReSpeakerAlsaCapture::fail ( const char *what, int code ) {
+    error = std::string(what) + ": " + snd_strerror(code) ;
+    close() ;
+    return false ;
+}
+
+bool ReSpeakerAlsaCapture::open ( const ReSpeakerAlsaCaptureConfig &wanted ) {
+    close() ;
+    config = wanted ;
+    error.clear() ;
+    int code = snd_pcm_open(&pcm, config.device.c_str(), SND_PCM_STREAM_CAPTURE, 0) ;
+    if (code < 0) {
+        pcm = 0 ;
+        return fail(config.device.c_str(), code) ;
+    }
+
+    snd_pcm_hw_params_t *hw ;
+    snd_pcm_hw_params_alloca(&hw) ;
+    snd_pcm_uframes_t period = config.periodFrames ;
+    snd_pcm_uframes_t buffer = config.periodFrames * config.periodCount ;
+    int direction = 0 ;
+    if ((code = snd_pcm_hw_params_any(pcm, hw)) < 0) {
+        return fail("No configuration", code) ;
+    }
+    if ((code = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+        return fail("No interleaved mmap access", code) ;
+    }
+    if ((code = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16_LE)) < 0) {
+        return fail("No S16_LE format", code) ;
+    }
+    code = config.channelCount == 0 ? snd_pcm_hw_params_set_channels_last(pcm, hw, &config.channelCount)
+                                    : snd_pcm_hw_params_set_channels_near(pcm, hw, &config.channelCount) ;
+    if (code < 0) {
+        return fail("Channel count", code) ;
+    }
+    if ((code = snd_pcm_hw_params_set_rate_near(pcm, hw, &config.sampleRate, &direction)) < 0) {
+        return fail("Sample rate", code) ;
+    }
+    if ((code = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, &direction)) < 0) {
+        return fail("Period size", code) ;
+    }
+    if ((code = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer)) < 0) {
+        return fail("Buffer size", code) ;
+    }
+    if ((code = snd_pcm_hw_params(pcm, hw)) < 0) {
+        return fail("Applying hardware parameters", code) ;
+    }
+    snd_pcm_hw_params_get_period_size(hw, &period, &direction) ;
+    snd_pcm_hw_params_get_buffer_size(hw, &buffer) ;
+    config.periodFrames = period ;
+    config.periodCount = period > 0 ? buffer / period : 0 ;
+    bufferSize = buffer ;
+
+    // Wake once a period is in; start() starts the stream explicitly
+    snd_pcm_sw_params_t *sw ;
+    snd_pcm_sw_params_alloca(&sw) ;
+    if ((code = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+        (code = snd_pcm_sw_params_set_avail_min(pcm, sw, period)) < 0 ||
+        (code = snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer + 1)) < 0 ||
+        (code = snd_pcm_sw_params(pcm, sw)) < 0) {
+        return fail("Applying software parameters", code) ;
+    }
+    if ((code = snd_pcm_prepare(pcm)) < 0) {
+        return fail("Preparing", code) ;
+    }
+    return true ;
+}
+
+void ReSpeakerAlsaCapture::close ( void ) {
+    stop() ;
+    if (pcm) {
+        snd_pcm_close(pcm) ;
+        pcm = 0 ;
+    }
+}
+
+// Overruns and suspends restart the stream; anything else ends the capture
+bool ReSpeakerAlsaCapture::recover ( int code ) {
+    if (code == -EPIPE) {
+        overrunCount++ ;
+    }
+    if (snd_pcm_recover(pcm, code, 1) < 0) {
+        error = std::string("Capture stopped: ") + snd_strerror(code) ;
+        return false ;
+    }
+    // An overrun leaves the stream prepared; a resumed suspend leaves it
+    // running already, and starting it again would fail
+    if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) {
+        const int res = snd_pcm_start(pcm) ;
+        if (res < 0) {
+            error = std::string("Restarting capture: ") + snd_strerror(res) ;
+            return false ;
+        }
+    }
+    return true ;
+}
+
+void ReSpeakerAlsaCapture::run ( void ) {
+    if (config.realtime) {
+        sched_param param ;
+        param.sched_priority = config.realtimePriority ;
+        realtimeGranted = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 ;
+    }
+    int code = snd_pcm_start(pcm) ;
+    if (code < 0 && !recover(code)) {
+        running = false ;
+        return ;
+    }
+    while (running) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm) ;
+        if (avail < 0) {
+            if (!recover(avail)) {
+                break ;
+            }
+            continue ;
+        }
+        if (avail < (snd_pcm_sframes_t)config.periodFrames) {
+            code = snd_pcm_wait(pcm, WaitTimeoutMs) ;
+            if (code < 0 && !recover(code)) {
+                break ;
+            }
+            continue ;
+        }
+        // The area may wrap, in which case it comes in two views
+        while (avail > 0) {
+            const snd_pcm_channel_area_t *areas ;
+            snd_pcm_uframes_t offset ;
+            snd_pcm_uframes_t frames = avail ;
+            if ((code = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames)) < 0) {
+                break ;
+            }
+            ReSpeakerAlsaCaptureView view ;
+            view.frames = reinterpret_cast<const int16_t *>(
+                static_cast<const char *>(areas[0].addr) + areas[0].first / 8 + offset * (areas[0].step / 8)) ;
+            view.frameCount = frames ;
+            view.channelCount = config.channelCount ;
+            view.position = captured ;
+            handler(view) ;
+            const snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, frames) ;
+            if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+                code = committed < 0 ? committed : -EPIPE ;
+                break ;
+            }
+            captured += frames ;
+            avail -= frames ;
+            code = 0 ;
+        }
+        if (code < 0 && !recover(code)) {
+            break ;
+        }
+    }
+    snd_pcm_drop(pcm) ;
+    snd_pcm_prepare(pcm) ;
+    running = false ;
+}
+
+#else
+
+bool ReSpeakerAlsaCapture::fail ( const char *what, int ) {
+    error = what ;
+    return false ;
+}
+
+bool ReSpeakerAlsaCapture::open ( const ReSpeakerAlsaCaptureConfig &wanted ) {
+    config = wanted ;
+    return fail("Built without ALSA", 0) ;
+}
+
+void ReSpeakerAlsaCapture::close ( void ) {
+    stop() ;
+}
+
+bool ReSpeakerAlsaCapture::recover ( int ) {
+    error = "Built without ALSA" ;
+    return false ;
+}
+
+void ReSpeakerAlsaCapture::run ( void ) {
+    running = false ;
+}
+
+#endif // HAVE_ALSA
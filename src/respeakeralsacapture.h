@@ -0,0 +1,118 @@
+#ifndef RESPEAKERALSACAPTURE_H
+#define RESPEAKERALSACAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Captures from an ALSA device in mmap mode on a reader thread of its own,
+// with the period and buffer sizes chosen by the caller rather than by a
+// sound server or Qt. Each period is handed to the handler as a view into
+// the device's DMA area, so nothing is copied before the handler decides
+// where the samples go; the view is only valid during the call.
+//
+// Built with HAVE_ALSA (and -lasound); without it open() always fails. Any
+// capture PCM works, so the backend can be exercised without the array on
+// the null plugin ("null", silence) or a file plugin reading raw PCM from
+// disk, e.g. in ~/.asoundrc:
+//
+//     pcm.respeakerfile {
+//         type file
+//         slave.pcm null
+//         file "/dev/null"
+//         infile "/tmp/capture.raw"
+//         format raw
+//     }
+//
+// Prefix "plug:" to either when the plugin cannot mmap, or to convert rate
+// and channels, at the cost of a copy inside ALSA.
+
+// Negotiated as near as the device allows; read back the actual values
+// from ReSpeakerAlsaCapture after open()
+struct ReSpeakerAlsaCaptureConfig
+{
+    ReSpeakerAlsaCaptureConfig() ;
+
+    std::string device ;
+    unsigned int sampleRate ;
+    unsigned int channelCount ;     // 0 for the most the device offers
+    unsigned int periodFrames ;     // Frames per handler call
+    unsigned int periodCount ;      // Periods in the ring ALSA fills
+    // Ask for SCHED_FIFO at realtimePriority for the reader thread. Falls
+    // back to normal scheduling without the privilege
+    bool realtime ;
+    int realtimePriority ;
+};
+
+// Signed 16 bit little endian interleaved frames
+struct ReSpeakerAlsaCaptureView
+{
+    const int16_t *frames ;
+    size_t frameCount ;
+    unsigned int channelCount ;
+    // Frames captured before this view since start()
+    unsigned long long position ;
+};
+
+typedef std::function<void (const ReSpeakerAlsaCaptureView &)> ReSpeakerAlsaCaptureHandler ;
+
+struct _snd_pcm ;
+
+class ReSpeakerAlsaCapture
+{
+public:
+    ReSpeakerAlsaCapture() ;
+    ~ReSpeakerAlsaCapture() ;
+
+    // Opens and configures the device; errorString() says why it failed
+    bool open ( const ReSpeakerAlsaCaptureConfig &config ) ;
+    void close ( void ) ;
+    bool isOpen ( void ) const ;
+    const std::string &errorString ( void ) const ;
+
+    unsigned int sampleRate ( void ) const ;
+    unsigned int channelCount ( void ) const ;
+    unsigned int periodFrames ( void ) const ;
+    unsigned int bufferFrames ( void ) const ;
+
+    // The handler runs on the reader thread, once per period or more when
+    // the thread falls behind; it must not block
+    bool start ( ReSpeakerAlsaCaptureHandler handler ) ;
+    void stop ( void ) ;
+    bool isRunning ( void ) const ;
+
+    unsigned long long framesCaptured ( void ) const ;
+    // Times the device overran the buffer and was restarted
+    unsigned int overruns ( void ) const ;
+    // Whether the reader thread got realtime scheduling
+    bool isRealtime ( void ) const ;
+
+    // How long the reader waits for a period before checking for stop()
+    static const int WaitTimeoutMs = 100 ;
+
+private:
+    ReSpeakerAlsaCapture ( const ReSpeakerAlsaCapture & ) ;
+    ReSpeakerAlsaCapture &operator= ( const ReSpeakerAlsaCapture & ) ;
+
+    void run ( void ) ;
+    bool recover ( int error ) ;
+    bool fail ( const char *what, int error ) ;
+
+    struct _snd_pcm *pcm ;
+    std::string error ;
+    ReSpeakerAlsaCaptureConfig config ;
+    unsigned int bufferSize ;
+
+    ReSpeakerAlsaCaptureHandler handler ;
+    std::thread thread ;
+    std::atomic<bool> running ;
+    std::atomic<unsigned long long> captured ;
+    std::atomic<unsigned int> overrunCount ;
+    std::atomic<bool> realtimeGranted ;
+};
+
+#endif // RESPEAKERALSACAPTURE_H
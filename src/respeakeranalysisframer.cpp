@@ -0,0 +1,89 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "respeakeranalysisframer.h"
+
+ReSpeakerAnalysisFramer::ReSpeakerAnalysisFramer()
+    : window(0)
+    , hop(0)
+    , filled(0)
+    , bufferStart(0)
+    , nextEnd(0)
+{
+}
+
+void ReSpeakerAnalysisFramer::configure ( size_t frameBytes, size_t windowFrames, size_t hopFrames ) {
+    window = frameBytes * windowFrames ;
+    hop = frameBytes * hopFrames ;
+    // Room for a window and a hop: once what no window needs is dropped,
+    // there is always space for more input
+    buffer.assign(window + hop, 0) ;
+    restart(0) ;
+}
+
+bool ReSpeakerAnalysisFramer::isConfigured ( void ) const {
+    return window > 0 && hop > 0 ;
+}
+
+size_t ReSpeakerAnalysisFramer::windowBytes ( void ) const {
+    return window ;
+}
+
+size_t ReSpeakerAnalysisFramer::hopBytes ( void ) const {
+    return hop ;
+}
+
+long long ReSpeakerAnalysisFramer::position ( void ) const {
+    return bufferStart + filled ;
+}
+
+void ReSpeakerAnalysisFramer::restart ( long long position ) {
+    filled = 0 ;
+    bufferStart = position ;
+    if (!isConfigured()) {
+        nextEnd = 0 ;
+        return ;
+    }
+    // The first hop boundary leaving a whole window after position
+    const long long end = position + window ;
+    nextEnd = (end + hop - 1) / hop * hop ;
+}
+
+size_t ReSpeakerAnalysisFramer::push ( const void *data, size_t length, const ReSpeakerAnalysisHandler &handler ) {
+    if (!isConfigured()) {
+        return 0 ;
+    }
+    const char *in = static_cast<const char *>(data) ;
+    size_t windows = 0 ;
+    while (length > 0) {
+        const long long keepFrom = nextEnd - window ;
+        // With the hop longer than the window some audio is never needed
+        if (filled == 0 && bufferStart < keepFrom) {
+            const size_t skip = std::min<long long>(length, keepFrom - bufferStart) ;
+            in += skip ;
+            length -= skip ;
+            bufferStart += skip ;
+            continue ;
+        }
+        const size_t copy = std::min(length, buffer.size() - filled) ;
+        memcpy(&buffer[filled], in, copy) ;
+        filled += copy ;
+        in += copy ;
+        length -= copy ;
+
+        while (bufferStart + (long long)filled >= nextEnd) {
+            const long long start = nextEnd - window ;
+            handler(&buffer[start - bufferStart], start) ;
+            nextEnd += hop ;
+            windows++ ;
+        }
+        const long long drop = std::min<long long>(filled, nextEnd - window - bufferStart) ;
+        if (drop > 0) {
+            filled -= drop ;
+            memmove(&buffer[0], &buffer[drop], filled) ;
+            bufferStart += drop ;
+        }
+    }
+    return windows ;
+}
@@ -0,0 +1,47 @@
+#ifndef RESPEAKERANALYSISFRAMER_H
+#define RESPEAKERANALYSISFRAMER_H
+
+#include <stddef.h>
+
+#include <functional>
+#include <vector>
+
+// Cuts a stream of interleaved frames, arriving in blocks of any length,
+// into analysis windows of windowFrames, one every hopFrames. Windows end
+// at whole multiples of the hop counted from the start of the stream, so
+// their boundaries do not depend on how the audio was split into blocks,
+// and with the hop no longer than the window every frame is analysed.
+//
+// Each window is handed over as one contiguous run of bytes, valid only
+// during the call, together with the stream position of its first byte.
+typedef std::function<void (const char *window, long long position)> ReSpeakerAnalysisHandler ;
+
+class ReSpeakerAnalysisFramer
+{
+public:
+    ReSpeakerAnalysisFramer() ;
+
+    // Drops anything buffered and starts again at position 0
+    void configure ( size_t frameBytes, size_t windowFrames, size_t hopFrames ) ;
+    bool isConfigured ( void ) const ;
+    size_t windowBytes ( void ) const ;
+    size_t hopBytes ( void ) const ;
+
+    // Returns the number of windows handed to the handler
+    size_t push ( const void *data, size_t length, const ReSpeakerAnalysisHandler &handler ) ;
+    // Bytes taken since the start, less any skipped by restart()
+    long long position ( void ) const ;
+    // Continue from position, after audio went missing, dropping what is
+    // buffered; the first window then starts at or after position
+    void restart ( long long position ) ;
+
+private:
+    std::vector<char> buffer ;
+    size_t window ;
+    size_t hop ;
+    size_t filled ;
+    long long bufferStart ;
+    long long nextEnd ;
+};
+
+#endif // RESPEAKERANALYSISFRAMER_H
@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "respeakeraudioblock.h"
+
+const size_t ReSpeakerAudioBlockPool::Alignment ;
+
+//-----------------------------------------------------------------------------
+// Blocks
+//-----------------------------------------------------------------------------
+
+ReSpeakerAudioBlock::ReSpeakerAudioBlock()
+    : sampleRate(0)
+    , channelCount(0)
+    , frameCount(0)
+    , position(0)
+    , samples(0)
+    , refs(0)
+    , pool(0)
+{
+}
+
+ReSpeakerAudioBlock::~ReSpeakerAudioBlock()
+{
+    if (!pool) {
+        delete[] samples ;
+    }
+}
+
+ReSpeakerAudioBlockPtr ReSpeakerAudioBlock::create ( unsigned int sampleRate, unsigned int channelCount,
+                                                     size_t frameCount ) {
+    ReSpeakerAudioBlock *block = new ReSpeakerAudioBlock ;
+    block->sampleRate = sampleRate ;
+    block->channelCount = channelCount ;
+    block->frameCount = frameCount ;
+    block->samples = new int16_t[frameCount * channelCount] ;
+    block->refs = 1 ;
+    return ReSpeakerAudioBlockPtr(block) ;
+}
+
+size_t ReSpeakerAudioBlock::bytes ( void ) const {
+    return frameCount * channelCount * sizeof(int16_t) ;
+}
+
+void ReSpeakerAudioBlock::retain ( void ) const {
+    refs.fetch_add(1, std::memory_order_relaxed) ;
+}
+
+// The last handle sends the block home; the acquire makes everything the
+// other holders did with it visible before it is reused
+void ReSpeakerAudioBlock::release ( void ) const {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return ;
+    }
+    ReSpeakerAudioBlock *block = const_cast<ReSpeakerAudioBlock *>(this) ;
+    if (pool) {
+        pool->release(block) ;
+    } else {
+        delete block ;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Pool
+//-----------------------------------------------------------------------------
+
+ReSpeakerAudioBlockPool::ReSpeakerAudioBlockPool ( size_t blockCount, size_t blockBytes )
+    : count(blockCount)
+    , size(blockBytes)
+    , storageBytes(0)
+    , storage(0)
+    , locked(false)
+    , blocks(new ReSpeakerAudioBlock[blockCount])
+    , next(new std::atomic<uint32_t>[blockCount])
+    , head(0)
+    , freeCount(0)
+    , refs(1)
+    , failures(0)
+{
+    // Blocks start on a cache line each, so two threads filling
+    // neighbouring blocks do not share one
+    const size_t stride = (size + Alignment - 1) / Alignment * Alignment ;
+    void *memory = 0 ;
+    if (count > 0 && posix_memalign(&memory, Alignment, count * stride) == 0) {
+        storage = static_cast<char *>(memory) ;
+        storageBytes = count * stride ;
+        memset(storage, 0, storageBytes) ;
+        locked = mlock(storage, storageBytes) == 0 ;
+    } else {
+        count = 0 ;
+    }
+    for (size_t i = count; i > 0; i--) {
+        blocks[i - 1].pool = this ;
+        blocks[i - 1].samples = reinterpret_cast<int16_t *>(storage + (i - 1) * stride) ;
+        push(&blocks[i - 1]) ;
+    }
+}
+
+ReSpeakerAudioBlockPool::~ReSpeakerAudioBlockPool()
+{
+    if (locked) {
+        munlock(storage, storageBytes) ;
+    }
+    free(storage) ;
+    delete[] next ;
+    delete[] blocks ;
+}
+
+size_t ReSpeakerAudioBlockPool::blockCount ( void ) const {
+    return count ;
+}
+
+size_t ReSpeakerAudioBlockPool::blockBytes ( void ) const {
+    return size ;
+}
+
+size_t ReSpeakerAudioBlockPool::available ( void ) const {
+    return freeCount ;
+}
+
+unsigned long long ReSpeakerAudioBlockPool::exhausted ( void ) const {
+    return failures ;
+}
+
+bool ReSpeakerAudioBlockPool::isLocked ( void ) const {
+    return locked ;
+}
+
+ReSpeakerAudioBlockPtr ReSpeakerAudioBlockPool::acquire ( unsigned int sampleRate, unsigned int channelCount,
+                                                          size_t frameCount ) {
+    if (frameCount * channelCount * sizeof(int16_t) > size) {
+        return ReSpeakerAudioBlockPtr() ;
+    }
+    uint64_t first = head.load(std::memory_order_acquire) ;
+    for (;;) {
+        const uint32_t index = uint32_t(first) ;
+        if (index == 0) {
+            failures++ ;
+            return ReSpeakerAudioBlockPtr() ;
+        }
+        const uint64_t following = ((first >> 32) + 1) << 32 | next[index - 1].load(std::memory_order_relaxed) ;
+        if (head.compare_exchange_weak(first, following, std::memory_order_acquire)) {
+            break ;
+        }
+    }
+    freeCount-- ;
+    refs++ ;
+    ReSpeakerAudioBlock *block = &blocks[uint32_t(first) - 1] ;
+    block->sampleRate = sampleRate ;
+    block->channelCount = channelCount ;
+    block->frameCount = frameCount ;
+    block->position = 0 ;
+    block->refs.store(1, std::memory_order_relaxed) ;
+    return ReSpeakerAudioBlockPtr(block) ;
+}
+
+void ReSpeakerAudioBlockPool::push ( ReSpeakerAudioBlock *block ) {
+    const uint32_t index = uint32_t(block - blocks) + 1 ;
+    uint64_t first = head.load(std::memory_order_relaxed) ;
+    do {
+        next[index - 1].store(uint32_t(first), std::memory_order_relaxed) ;
+    } while (!head.compare_exchange_weak(first, ((first >> 32) + 1) << 32 | index,
+                                         std::memory_order_release, std::memory_order_relaxed)) ;
+    freeCount++ ;
+}
+
+void ReSpeakerAudioBlockPool::release ( ReSpeakerAudioBlock *block ) {
+    push(block) ;
+    unref() ;
+}
+
+void ReSpeakerAudioBlockPool::retire ( void ) {
+    unref() ;
+}
+
+void ReSpeakerAudioBlockPool::unref ( void ) {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this ;
+    }
+}
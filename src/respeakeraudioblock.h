@@ -0,0 +1,163 @@
+#ifndef RESPEAKERAUDIOBLOCK_H
+#define RESPEAKERAUDIOBLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// Blocks of audio passed between threads by handle. The count of handles
+// lives in the block, so copying a handle is one atomic increment and never
+// allocates. Blocks come from a ReSpeakerAudioBlockPool, which hands the
+// same aligned memory out again once the last handle goes, or one at a time
+// from the heap where no pool is worth keeping.
+
+class ReSpeakerAudioBlockPool ;
+template <class Block> class ReSpeakerAudioBlockHandle ;
+
+// Signed 16 bit interleaved frames, with where they sit in the stream
+class ReSpeakerAudioBlock
+{
+public:
+    // A block of its own, freed with its last handle
+    static ReSpeakerAudioBlockHandle<ReSpeakerAudioBlock> create ( unsigned int sampleRate, unsigned int channelCount,
+                                                                   size_t frameCount ) ;
+
+    size_t bytes ( void ) const ;
+
+    unsigned int sampleRate ;
+    unsigned int channelCount ;
+    size_t frameCount ;
+    // Frames before this block since the capture started
+    unsigned long long position ;
+    int16_t *samples ;
+
+private:
+    friend class ReSpeakerAudioBlockPool ;
+    template <class Block> friend class ReSpeakerAudioBlockHandle ;
+
+    ReSpeakerAudioBlock() ;
+    ~ReSpeakerAudioBlock() ;
+    ReSpeakerAudioBlock ( const ReSpeakerAudioBlock & ) ;
+    ReSpeakerAudioBlock &operator= ( const ReSpeakerAudioBlock & ) ;
+
+    void retain ( void ) const ;
+    void release ( void ) const ;
+
+    mutable std::atomic<int> refs ;
+    // Where the block goes back to, or 0 when samples came from the heap
+    ReSpeakerAudioBlockPool *pool ;
+};
+
+// A counted reference to a block, ReSpeakerAudioBlockPtr while it is being
+// filled in and ReSpeakerAudioBlockRef, read only, once it is handed on
+template <class Block>
+class ReSpeakerAudioBlockHandle
+{
+public:
+    ReSpeakerAudioBlockHandle() : block(0) {}
+    ReSpeakerAudioBlockHandle ( const ReSpeakerAudioBlockHandle &other ) : block(other.block) {
+        if (block) {
+            block->retain() ;
+        }
+    }
+    ReSpeakerAudioBlockHandle ( ReSpeakerAudioBlockHandle &&other ) : block(other.block) {
+        other.block = 0 ;
+    }
+    // From writable to read only, never the other way
+    template <class Other>
+    ReSpeakerAudioBlockHandle ( const ReSpeakerAudioBlockHandle<Other> &other ) : block(other.get()) {
+        if (block) {
+            block->retain() ;
+        }
+    }
+    ~ReSpeakerAudioBlockHandle() {
+        reset() ;
+    }
+
+    ReSpeakerAudioBlockHandle &operator= ( ReSpeakerAudioBlockHandle other ) {
+        Block *swapped = block ;
+        block = other.block ;
+        other.block = swapped ;
+        return *this ;
+    }
+
+    void reset ( void ) {
+        if (block) {
+            block->release() ;
+            block = 0 ;
+        }
+    }
+
+    Block *get ( void ) const { return block ; }
+    Block *operator-> ( void ) const { return block ; }
+    Block &operator* ( void ) const { return *block ; }
+    explicit operator bool ( void ) const { return block != 0 ; }
+
+private:
+    friend class ReSpeakerAudioBlock ;
+    friend class ReSpeakerAudioBlockPool ;
+
+    // Takes over a reference already counted
+    explicit ReSpeakerAudioBlockHandle ( Block *adopted ) : block(adopted) {}
+
+    Block *block ;
+};
+
+typedef ReSpeakerAudioBlockHandle<ReSpeakerAudioBlock> ReSpeakerAudioBlockPtr ;
+typedef ReSpeakerAudioBlockHandle<const ReSpeakerAudioBlock> ReSpeakerAudioBlockRef ;
+
+// A fixed set of blocks carved from one aligned allocation, touched (and
+// locked, where the process may) up front so the audio path takes no page
+// faults. acquire() and the return of a block are lock free, so any thread
+// may take blocks and any thread may drop the last handle.
+//
+// The pool may be retired while blocks are still out: it goes once the last
+// of them comes back. Release it with retire() rather than delete.
+class ReSpeakerAudioBlockPool
+{
+public:
+    ReSpeakerAudioBlockPool ( size_t blockCount, size_t blockBytes ) ;
+
+    // Null when every block is in use, or frameCount does not fit
+    ReSpeakerAudioBlockPtr acquire ( unsigned int sampleRate, unsigned int channelCount, size_t frameCount ) ;
+    void retire ( void ) ;
+
+    size_t blockCount ( void ) const ;
+    size_t blockBytes ( void ) const ;
+    size_t available ( void ) const ;
+    // Calls to acquire() which found the pool empty
+    unsigned long long exhausted ( void ) const ;
+    bool isLocked ( void ) const ;
+
+    static const size_t Alignment = 64 ;
+
+private:
+    friend class ReSpeakerAudioBlock ;
+
+    ~ReSpeakerAudioBlockPool() ;
+    ReSpeakerAudioBlockPool ( const ReSpeakerAudioBlockPool & ) ;
+    ReSpeakerAudioBlockPool &operator= ( const ReSpeakerAudioBlockPool & ) ;
+
+    void push ( ReSpeakerAudioBlock *block ) ;
+    void release ( ReSpeakerAudioBlock *block ) ;
+    void unref ( void ) ;
+
+    size_t count ;
+    size_t size ;
+    size_t storageBytes ;
+    char *storage ;
+    bool locked ;
+    ReSpeakerAudioBlock *blocks ;
+    // Free list: the low 32 bits of head are the index of the first free
+    // block plus one, the high 32 bits a count of changes so a stale
+    // compare and swap cannot succeed
+    std::atomic<uint32_t> *next ;
+    std::atomic<uint64_t> head ;
+    std::atomic<size_t> freeCount ;
+    // One for the owner, one for each block out
+    std::atomic<size_t> refs ;
+    std::atomic<unsigned long long> failures ;
+};
+
+#endif // RESPEAKERAUDIOBLOCK_H
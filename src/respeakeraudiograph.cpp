@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <chrono>
+
+#include "respeakeraudiograph.h"
+
+const size_t ReSpeakerChannelSelectNode::PoolBlocks ;
+
+//-----------------------------------------------------------------------------
+// Nodes
+//-----------------------------------------------------------------------------
+
+// Time the inline nodes below the current one took, so each node's
+// counters only hold its own work
+static thread_local unsigned long long downstreamNs = 0 ;
+
+ReSpeakerAudioNode::ReSpeakerAudioNode ( const std::string &name )
+    : nodeName(name)
+    , depth(0)
+    , queueHead(0)
+    , queueCount(0)
+    , stopping(false)
+    , workerRunning(false)
+    , queued(false)
+    , blockCount(0)
+    , frameCount(0)
+    , droppedCount(0)
+    , totalNs(0)
+    , maxNs(0)
+{
+}
+
+ReSpeakerAudioNode::~ReSpeakerAudioNode()
+{
+    stopThread() ;
+}
+
+const std::string &ReSpeakerAudioNode::name ( void ) const {
+    return nodeName ;
+}
+
+void ReSpeakerAudioNode::setQueueDepth ( size_t queueDepth ) {
+    depth = queueDepth ;
+}
+
+size_t ReSpeakerAudioNode::queueDepth ( void ) const {
+    return depth ;
+}
+
+size_t ReSpeakerAudioNode::outputCount ( void ) const {
+    return outputs.size() ;
+}
+
+ReSpeakerAudioNodeStats ReSpeakerAudioNode::stats ( void ) const {
+    ReSpeakerAudioNodeStats result ;
+    result.blocks = blockCount ;
+    result.frames = frameCount ;
+    result.dropped = droppedCount ;
+    result.totalNs = totalNs ;
+    result.maxNs = maxNs ;
+    return result ;
+}
+
+void ReSpeakerAudioNode::resetStats ( void ) {
+    blockCount = 0 ;
+    frameCount = 0 ;
+    droppedCount = 0 ;
+    totalNs = 0 ;
+    maxNs = 0 ;
+}
+
+// Once the thread has gone, blocks still arriving are run inline
+void ReSpeakerAudioNode::deliver ( const ReSpeakerAudioBlockRef &block ) {
+    if (queued) {
+        std::unique_lock<std::mutex> lock(queueLock) ;
+        if (workerRunning) {
+            if (queueCount == queue.size()) {
+                droppedCount++ ;
+                return ;
+            }
+            queue[(queueHead + queueCount++) % queue.size()] = block ;
+            lock.unlock() ;
+            queueReady.notify_one() ;
+            return ;
+        }
+    }
+    invoke(block) ;
+}
+
+void ReSpeakerAudioNode::push ( const ReSpeakerAudioBlockRef &block ) {
+    for (size_t i = 0; i < outputs.size(); i++) {
+        outputs[i]->deliver(block) ;
+    }
+}
+
+void ReSpeakerAudioNode::invoke ( const ReSpeakerAudioBlockRef &block ) {
+    const unsigned long long outer = downstreamNs ;
+    downstreamNs = 0 ;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+    process(block) ;
+    const unsigned long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count() ;
+    const unsigned long long own = elapsed > downstreamNs ? elapsed - downstreamNs : 0 ;
+    downstreamNs = outer + elapsed ;
+
+    blockCount++ ;
+    frameCount += block->frameCount ;
+    totalNs += own ;
+    unsigned long long longest = maxNs ;
+    while (own > longest && !maxNs.compare_exchange_weak(longest, own)) {
+    }
+}
+
+void ReSpeakerAudioNode::startThread ( void ) {
+    if (depth == 0 || thread.joinable()) {
+        return ;
+    }
+    queue.assign(depth, ReSpeakerAudioBlockRef()) ;
+    queueHead = 0 ;
+    queueCount = 0 ;
+    stopping = false ;
+    workerRunning = true ;
+    queued = true ;
+    thread = std::thread(&ReSpeakerAudioNode::run, this) ;
+}
+
+void ReSpeakerAudioNode::stopThread ( void ) {
+    if (!thread.joinable()) {
+        return ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueLock) ;
+        stopping = true ;
+    }
+    queueReady.notify_one() ;
+    thread.join() ;
+    queued = false ;
+}
+
+// Finishes what is queued before stopping
+void ReSpeakerAudioNode::run ( void ) {
+    std::unique_lock<std::mutex> lock(queueLock) ;
+    for (;;) {
+        queueReady.wait(lock, [this] { return stopping || queueCount > 0 ; }) ;
+        if (queueCount == 0) {
+            workerRunning = false ;
+            break ;
+        }
+        ReSpeakerAudioBlockRef block = std::move(queue[queueHead]) ;
+        queueHead = (queueHead + 1) % queue.size() ;
+        queueCount-- ;
+        lock.unlock() ;
+        invoke(block) ;
+        block.reset() ;
+        lock.lock() ;
+    }
+}
+
+ReSpeakerAudioSourceNode::ReSpeakerAudioSourceNode ( const std::string &name )
+    : ReSpeakerAudioNode(name)
+{
+}
+
+void ReSpeakerAudioSourceNode::process ( const ReSpeakerAudioBlockRef &block ) {
+    push(block) ;
+}
+
+ReSpeakerAudioCallbackNode::ReSpeakerAudioCallbackNode ( const std::string &name, ReSpeakerAudioBlockHandler handler )
+    : ReSpeakerAudioNode(name)
+    , handler(handler)
+{
+}
+
+void ReSpeakerAudioCallbackNode::process ( const ReSpeakerAudioBlockRef &block ) {
+    handler(block) ;
+}
+
+ReSpeakerChannelSelectNode::ReSpeakerChannelSelectNode ( const std::string &name, const std::vector<unsigned int> &channels )
+    : ReSpeakerAudioNode(name)
+    , channels(channels)
+    , pool(0)
+{
+}
+
+ReSpeakerChannelSelectNode::~ReSpeakerChannelSelectNode()
+{
+    if (pool) {
+        pool->retire() ;
+    }
+}
+
+void ReSpeakerChannelSelectNode::process ( const ReSpeakerAudioBlockRef &block ) {
+    for (size_t c = 0; c < channels.size(); c++) {
+        if (channels[c] >= block->channelCount) {
+            return ;
+        }
+    }
+    // Sized for the largest block seen, so once the source has sent one
+    // of its full size every block comes from the pool
+    const size_t bytes = block->frameCount * channels.size() * sizeof(int16_t) ;
+    if (!pool || bytes > pool->blockBytes()) {
+        if (pool) {
+            pool->retire() ;
+        }
+        pool = new ReSpeakerAudioBlockPool(PoolBlocks, bytes) ;
+    }
+    ReSpeakerAudioBlockPtr selected = pool->acquire(block->sampleRate, channels.size(), block->frameCount) ;
+    if (!selected) {
+        selected = ReSpeakerAudioBlock::create(block->sampleRate, channels.size(), block->frameCount) ;
+    }
+    selected->position = block->position ;
+    const int16_t *in = block->samples ;
+    int16_t *out = selected->samples ;
+    for (size_t frame = 0; frame < block->frameCount; frame++) {
+        for (size_t c = 0; c < channels.size(); c++) {
+            *out++ = in[channels[c]] ;
+        }
+        in += block->channelCount ;
+    }
+    push(selected) ;
+}
+
+//-----------------------------------------------------------------------------
+// Graph
+//-----------------------------------------------------------------------------
+
+ReSpeakerAudioGraph::ReSpeakerAudioGraph()
+    : running(false)
+{
+}
+
+ReSpeakerAudioGraph::~ReSpeakerAudioGraph()
+{
+    stop() ;
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        delete nodeList[i] ;
+    }
+}
+
+bool ReSpeakerAudioGraph::contains ( const ReSpeakerAudioNode *node ) const {
+    return std::find(nodeList.begin(), nodeList.end(), node) != nodeList.end() ;
+}
+
+bool ReSpeakerAudioGraph::reaches ( const ReSpeakerAudioNode *from, const ReSpeakerAudioNode *to ) {
+    if (from == to) {
+        return true ;
+    }
+    for (size_t i = 0; i < from->outputs.size(); i++) {
+        if (reaches(from->outputs[i], to)) {
+            return true ;
+        }
+    }
+    return false ;
+}
+
+bool ReSpeakerAudioGraph::connect ( ReSpeakerAudioNode *from, ReSpeakerAudioNode *to ) {
+    if (running || !contains(from) || !contains(to) || reaches(to, from)) {
+        return false ;
+    }
+    if (std::find(from->outputs.begin(), from->outputs.end(), to) == from->outputs.end()) {
+        from->outputs.push_back(to) ;
+    }
+    return true ;
+}
+
+bool ReSpeakerAudioGraph::disconnect ( ReSpeakerAudioNode *from, ReSpeakerAudioNode *to ) {
+    if (running || !contains(from)) {
+        return false ;
+    }
+    std::vector<ReSpeakerAudioNode *>::iterator i = std::find(from->outputs.begin(), from->outputs.end(), to) ;
+    if (i == from->outputs.end()) {
+        return false ;
+    }
+    from->outputs.erase(i) ;
+    return true ;
+}
+
+const std::vector<ReSpeakerAudioNode *> &ReSpeakerAudioGraph::nodes ( void ) const {
+    return nodeList ;
+}
+
+void ReSpeakerAudioGraph::start ( void ) {
+    if (running) {
+        return ;
+    }
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        nodeList[i]->startThread() ;
+    }
+    running = true ;
+}
+
+// A node draining its queue may find the nodes it feeds already stopped;
+// they then run its last blocks inline
+void ReSpeakerAudioGraph::stop ( void ) {
+    if (!running) {
+        return ;
+    }
+    for (size_t i = 0; i < nodeList.size(); i++) {
+        nodeList[i]->stopThread() ;
+    }
+    running = false ;
+}
+
+bool ReSpeakerAudioGraph::isRunning ( void ) const {
+    return running ;
+}
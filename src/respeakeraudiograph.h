@@ -0,0 +1,177 @@
+#ifndef RESPEAKERAUDIOGRAPH_H
+#define RESPEAKERAUDIOGRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "respeakeraudioblock.h"
+
+// A graph of audio processing nodes: sources, filters and sinks. Blocks of
+// interleaved samples travel as counted handles, so a block fanned out to a
+// level meter, a recorder and a beamformer is one block, returned when the
+// last of them lets go. A node changing the audio makes a new block.
+//
+// Each node runs either on the thread that hands it a block, or on a thread
+// of its own behind a bounded queue, and keeps counters of the blocks it
+// processed, dropped and the time it took. Only the nodes connected to a
+// source are ever run.
+
+struct ReSpeakerAudioNodeStats
+{
+    unsigned long long blocks ;
+    unsigned long long frames ;
+    // Blocks that arrived with the queue full
+    unsigned long long dropped ;
+    // Time in process(), less the time spent in nodes it ran inline
+    unsigned long long totalNs ;
+    unsigned long long maxNs ;
+};
+
+class ReSpeakerAudioNode
+{
+public:
+    explicit ReSpeakerAudioNode ( const std::string &name ) ;
+    virtual ~ReSpeakerAudioNode() ;
+
+    const std::string &name ( void ) const ;
+
+    // 0, the default, runs the node on the thread delivering the block.
+    // Otherwise the node gets a thread of its own with up to depth blocks
+    // waiting, dropping any more. Set it while the graph is stopped
+    void setQueueDepth ( size_t depth ) ;
+    size_t queueDepth ( void ) const ;
+
+    // Hand the node a block, as its inputs do
+    void deliver ( const ReSpeakerAudioBlockRef &block ) ;
+
+    size_t outputCount ( void ) const ;
+    ReSpeakerAudioNodeStats stats ( void ) const ;
+    void resetStats ( void ) ;
+
+protected:
+    virtual void process ( const ReSpeakerAudioBlockRef &block ) = 0 ;
+    // Deliver a block to every output
+    void push ( const ReSpeakerAudioBlockRef &block ) ;
+
+private:
+    friend class ReSpeakerAudioGraph ;
+
+    ReSpeakerAudioNode ( const ReSpeakerAudioNode & ) ;
+    ReSpeakerAudioNode &operator= ( const ReSpeakerAudioNode & ) ;
+
+    void invoke ( const ReSpeakerAudioBlockRef &block ) ;
+    void startThread ( void ) ;
+    void stopThread ( void ) ;
+    void run ( void ) ;
+
+    std::string nodeName ;
+    size_t depth ;
+    std::vector<ReSpeakerAudioNode *> outputs ;
+
+    std::thread thread ;
+    std::mutex queueLock ;
+    std::condition_variable queueReady ;
+    // A ring of depth blocks, allocated when the thread starts
+    std::vector<ReSpeakerAudioBlockRef> queue ;
+    size_t queueHead ;
+    size_t queueCount ;
+    bool stopping ;
+    bool workerRunning ;
+    // Set while the node has a thread, so inline nodes never take the lock
+    std::atomic<bool> queued ;
+
+    std::atomic<unsigned long long> blockCount ;
+    std::atomic<unsigned long long> frameCount ;
+    std::atomic<unsigned long long> droppedCount ;
+    std::atomic<unsigned long long> totalNs ;
+    std::atomic<unsigned long long> maxNs ;
+};
+
+// Where captured audio enters the graph: passes every block to its outputs
+class ReSpeakerAudioSourceNode : public ReSpeakerAudioNode
+{
+public:
+    explicit ReSpeakerAudioSourceNode ( const std::string &name ) ;
+
+protected:
+    void process ( const ReSpeakerAudioBlockRef &block ) ;
+};
+
+// A sink calling a function with each block
+typedef std::function<void (const ReSpeakerAudioBlockRef &)> ReSpeakerAudioBlockHandler ;
+
+class ReSpeakerAudioCallbackNode : public ReSpeakerAudioNode
+{
+public:
+    ReSpeakerAudioCallbackNode ( const std::string &name, ReSpeakerAudioBlockHandler handler ) ;
+
+protected:
+    void process ( const ReSpeakerAudioBlockRef &block ) ;
+
+private:
+    ReSpeakerAudioBlockHandler handler ;
+};
+
+// Passes on the given input channels, in order, e.g. the four raw
+// microphones of the 6 channel firmware for a beamformer. Its blocks come
+// from a pool, made again should a larger block come in
+class ReSpeakerChannelSelectNode : public ReSpeakerAudioNode
+{
+public:
+    ReSpeakerChannelSelectNode ( const std::string &name, const std::vector<unsigned int> &channels ) ;
+    ~ReSpeakerChannelSelectNode() ;
+
+    static const size_t PoolBlocks = 16 ;
+
+protected:
+    void process ( const ReSpeakerAudioBlockRef &block ) ;
+
+private:
+    std::vector<unsigned int> channels ;
+    ReSpeakerAudioBlockPool *pool ;
+};
+
+// Owns the nodes and their connections. Connect and set queue depths while
+// stopped; start() runs the node threads, and stop() lets each finish the
+// blocks it has queued
+class ReSpeakerAudioGraph
+{
+public:
+    ReSpeakerAudioGraph() ;
+    ~ReSpeakerAudioGraph() ;
+
+    // Takes ownership
+    template <class Node> Node *add ( Node *node ) {
+        nodeList.push_back(node) ;
+        return node ;
+    }
+    // Fail while running, for nodes not in the graph, or if the
+    // connection would make a loop
+    bool connect ( ReSpeakerAudioNode *from, ReSpeakerAudioNode *to ) ;
+    bool disconnect ( ReSpeakerAudioNode *from, ReSpeakerAudioNode *to ) ;
+    const std::vector<ReSpeakerAudioNode *> &nodes ( void ) const ;
+
+    void start ( void ) ;
+    void stop ( void ) ;
+    bool isRunning ( void ) const ;
+
+private:
+    ReSpeakerAudioGraph ( const ReSpeakerAudioGraph & ) ;
+    ReSpeakerAudioGraph &operator= ( const ReSpeakerAudioGraph & ) ;
+
+    bool contains ( const ReSpeakerAudioNode *node ) const ;
+    static bool reaches ( const ReSpeakerAudioNode *from, const ReSpeakerAudioNode *to ) ;
+
+    std::vector<ReSpeakerAudioNode *> nodeList ;
+    std::atomic<bool> running ;
+};
+
+#endif // RESPEAKERAUDIOGRAPH_H
@@ -0,0 +1,187 @@
+#include <string.h>
+
+#include "respeakeraudioring.h"
+
+ReSpeakerAudioRing::ReSpeakerAudioRing ( size_t capacity, size_t frameBytes )
+    : frame(frameBytes > 0 ? frameBytes : 1)
+    , claimed(0)
+    , committed(0)
+{
+    const size_t frames = (capacity + frame - 1) / frame ;
+    buffer.resize((frames > 0 ? frames : 1) * frame) ;
+}
+
+size_t ReSpeakerAudioRing::capacity ( void ) const {
+    return buffer.size() ;
+}
+
+size_t ReSpeakerAudioRing::frameBytes ( void ) const {
+    return frame ;
+}
+
+// Sequence lock style: readers compare what they copied against claimed,
+// which moves before the bytes are overwritten, and committed, which moves
+// once they are complete
+void ReSpeakerAudioRing::write ( const void *data, size_t length ) {
+    const char *bytes = static_cast<const char *>(data) ;
+    long long position = committed.load(std::memory_order_relaxed) ;
+    // Only the newest capacity bytes of a large write can survive it
+    if (length > buffer.size()) {
+        bytes += length - buffer.size() ;
+        position += length - buffer.size() ;
+        length = buffer.size() ;
+    }
+    const long long end = position + length ;
+    claimed.store(end, std::memory_order_relaxed) ;
+    std::atomic_thread_fence(std::memory_order_release) ;
+
+    const size_t offset = position % buffer.size() ;
+    const size_t first = length < buffer.size() - offset ? length : buffer.size() - offset ;
+    memcpy(&buffer[offset], bytes, first) ;
+    memcpy(&buffer[0], bytes + first, length - first) ;
+
+    committed.store(end, std::memory_order_release) ;
+}
+
+long long ReSpeakerAudioRing::written ( void ) const {
+    return committed.load(std::memory_order_acquire) ;
+}
+
+long long ReSpeakerAudioRing::oldest ( void ) const {
+    const long long end = claimed.load(std::memory_order_acquire) ;
+    return end > (long long)buffer.size() ? end - buffer.size() : 0 ;
+}
+
+bool ReSpeakerAudioRing::read ( long long position, void *data, size_t length ) const {
+    if (length > buffer.size() || position < 0) {
+        return false ;
+    }
+    const long long end = committed.load(std::memory_order_acquire) ;
+    if (position + (long long)length > end || position < end - (long long)buffer.size()) {
+        return false ;
+    }
+    char *bytes = static_cast<char *>(data) ;
+    const size_t offset = position % buffer.size() ;
+    const size_t first = length < buffer.size() - offset ? length : buffer.size() - offset ;
+    memcpy(bytes, &buffer[offset], first) ;
+    memcpy(bytes + first, &buffer[0], length - first) ;
+
+    // Anything the writer claimed meanwhile may have landed on our bytes
+    std::atomic_thread_fence(std::memory_order_acquire) ;
+    return position >= claimed.load(std::memory_order_relaxed) - (long long)buffer.size() ;
+}
+
+//
+// Cursor
+//
+
+ReSpeakerAudioRingCursor::ReSpeakerAudioRingCursor()
+    : source(0)
+    , cursor(0)
+    , overrunCount(0)
+    , lost(0)
+    , overrunPending(false)
+{
+}
+
+ReSpeakerAudioRingCursor::ReSpeakerAudioRingCursor ( const ReSpeakerAudioRing *ring )
+    : source(0)
+    , cursor(0)
+    , overrunCount(0)
+    , lost(0)
+    , overrunPending(false)
+{
+    attach(ring) ;
+}
+
+void ReSpeakerAudioRingCursor::attach ( const ReSpeakerAudioRing *ring ) {
+    source = ring ;
+    cursor = ring ? ring->written() : 0 ;
+    overrunCount = 0 ;
+    lost = 0 ;
+    overrunPending = false ;
+}
+
+const ReSpeakerAudioRing *ReSpeakerAudioRingCursor::ring ( void ) const {
+    return source ;
+}
+
+long long ReSpeakerAudioRingCursor::position ( void ) const {
+    return cursor ;
+}
+
+long long ReSpeakerAudioRingCursor::available ( void ) const {
+    return source ? source->written() - cursor : 0 ;
+}
+
+size_t ReSpeakerAudioRingCursor::read ( void *data, size_t length ) {
+    if (source == 0) {
+        return 0 ;
+    }
+    const long long frame = source->frameBytes() ;
+    for (;;) {
+        const long long end = source->written() ;
+        const long long first = source->oldest() ;
+        if (cursor < first) {
+            skipTo(first) ;
+        }
+        long long count = end - cursor ;
+        if (count > (long long)length) {
+            count = length ;
+        }
+        count -= count % frame ;
+        if (count <= 0) {
+            return 0 ;
+        }
+        if (source->read(cursor, data, count)) {
+            cursor += count ;
+            return count ;
+        }
+        // Overwritten while we copied; go again from what is left, which
+        // oldest() now shows has moved on
+    }
+}
+
+long long ReSpeakerAudioRingCursor::readLatest ( void *data, size_t length ) {
+    if (source == 0 || length > source->capacity()) {
+        return -1 ;
+    }
+    for (;;) {
+        const long long end = source->written() ;
+        const long long start = end - length ;
+        if (start < 0) {
+            return -1 ;
+        }
+        if (source->read(start, data, length)) {
+            cursor = end ;
+            return start ;
+        }
+        // The writer lapped us mid copy; that is lost, not skipped
+        overrunCount++ ;
+        overrunPending = true ;
+    }
+}
+
+unsigned int ReSpeakerAudioRingCursor::overruns ( void ) const {
+    return overrunCount ;
+}
+
+long long ReSpeakerAudioRingCursor::lostBytes ( void ) const {
+    return lost ;
+}
+
+bool ReSpeakerAudioRingCursor::takeOverrun ( void ) {
+    const bool pending = overrunPending ;
+    overrunPending = false ;
+    return pending ;
+}
+
+// Move forward to position, rounded up to a frame, losing what is skipped
+void ReSpeakerAudioRingCursor::skipTo ( long long position ) {
+    const long long frame = source->frameBytes() ;
+    position += (frame - position % frame) % frame ;
+    lost += position - cursor ;
+    cursor = position ;
+    overrunCount++ ;
+    overrunPending = true ;
+}
@@ -0,0 +1,91 @@
+#ifndef RESPEAKERAUDIORING_H
+#define RESPEAKERAUDIORING_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+// Fixed size ring holding the newest capacity bytes of an audio stream.
+// One thread writes; any number of readers, on any threads, copy out of it
+// through their own ReSpeakerAudioRingCursor. Nothing takes a lock and the
+// writer never waits: it overwrites the oldest audio, and a reader whose
+// bytes were overwritten before or while it copied them is told so. Stream
+// positions count bytes since the ring was created, so they never wrap.
+class ReSpeakerAudioRing
+{
+public:
+    // capacity is rounded up to whole frames of frameBytes
+    explicit ReSpeakerAudioRing ( size_t capacity, size_t frameBytes = 1 ) ;
+
+    size_t capacity ( void ) const ;
+    size_t frameBytes ( void ) const ;
+
+    // Writer side. Appends length bytes, dropping the oldest if need be
+    void write ( const void *data, size_t length ) ;
+
+    // Stream position one past the newest byte
+    long long written ( void ) const ;
+    // Stream position of the oldest byte held and not being overwritten
+    long long oldest ( void ) const ;
+    // Copy length bytes starting at stream position. Returns false if any
+    // of them is not written yet or was overwritten, in which case data
+    // holds garbage
+    bool read ( long long position, void *data, size_t length ) const ;
+
+private:
+    ReSpeakerAudioRing ( const ReSpeakerAudioRing & ) ;
+    ReSpeakerAudioRing &operator= ( const ReSpeakerAudioRing & ) ;
+
+    std::vector<char> buffer ;
+    size_t frame ;
+    // Bytes below claimed - capacity may be being overwritten; bytes below
+    // committed are complete
+    std::atomic<long long> claimed ;
+    char padClaimed[64 - sizeof(std::atomic<long long>)] ;
+    std::atomic<long long> committed ;
+    char padCommitted[64 - sizeof(std::atomic<long long>)] ;
+};
+
+// One reader's place in a ReSpeakerAudioRing
+class ReSpeakerAudioRingCursor
+{
+public:
+    ReSpeakerAudioRingCursor() ;
+    // Starts at the newest byte, so only audio written afterwards is read
+    explicit ReSpeakerAudioRingCursor ( const ReSpeakerAudioRing *ring ) ;
+
+    void attach ( const ReSpeakerAudioRing *ring ) ;
+    const ReSpeakerAudioRing *ring ( void ) const ;
+
+    long long position ( void ) const ;
+    // Bytes written since position
+    long long available ( void ) const ;
+
+    // Copy up to length bytes, in whole frames, from the cursor on and move
+    // past them; returns the number copied. A reader which fell more than
+    // the ring's capacity behind first skips to the oldest audio held and
+    // counts an overrun
+    size_t read ( void *data, size_t length ) ;
+    // Copy the newest length bytes and move past them, skipping whatever
+    // came before without counting it lost. Returns the stream position of
+    // the first byte, or -1 if fewer than length bytes have been written
+    long long readLatest ( void *data, size_t length ) ;
+
+    // Times the reader lost audio, and how many bytes in all
+    unsigned int overruns ( void ) const ;
+    long long lostBytes ( void ) const ;
+    // True once for every run of overruns, for reporting them
+    bool takeOverrun ( void ) ;
+
+private:
+    void skipTo ( long long position ) ;
+
+    const ReSpeakerAudioRing *source ;
+    long long cursor ;
+    unsigned int overrunCount ;
+    long long lost ;
+    bool overrunPending ;
+};
+
+#endif // RESPEAKERAUDIORING_H
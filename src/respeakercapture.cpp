@@ -0,0 +1,389 @@
+#include <string.h>
+
+#include <chrono>
+
+#include "respeakercapture.h"
+#include "respeakerdirectionhistory.h"
+
+static_assert(sizeof(ReSpeakerCaptureRecordHeader) == 16, "capture record header layout") ;
+static_assert(sizeof(ReSpeakerCaptureAudioFormat) == 8, "capture audio format layout") ;
+
+// Largest payload accepted when reading, so a corrupt length cannot
+// allocate without bound
+static const uint32_t MaxRecordLength = 16 << 20 ;
+
+const uint32_t ReSpeakerCapture::CaptureMagic ;
+const uint32_t ReSpeakerCapture::CaptureVersion ;
+
+//
+// Writer
+//
+
+const size_t ReSpeakerCaptureWriter::RingBytes ;
+const size_t ReSpeakerCaptureWriter::Granule ;
+const int ReSpeakerCaptureWriter::PollIntervalMs ;
+
+static_assert(ReSpeakerCaptureWriter::RingBytes % ReSpeakerCaptureWriter::Granule == 0, "capture ring granules") ;
+static_assert(sizeof(ReSpeakerCaptureRecordHeader) <= ReSpeakerCaptureWriter::Granule, "capture record header wraps") ;
+
+static unsigned long long granules ( unsigned long long bytes ) {
+    return (bytes + ReSpeakerCaptureWriter::Granule - 1) / ReSpeakerCaptureWriter::Granule * ReSpeakerCaptureWriter::Granule ;
+}
+
+ReSpeakerCaptureWriter::ReSpeakerCaptureWriter()
+    : file(0)
+    , ring(0)
+    , ready(0)
+    , claimed(0)
+    , released(0)
+    , writers(0)
+    , accepting(false)
+    , stopping(false)
+    , written(0)
+    , failed(0)
+    , dropped(0)
+{
+}
+
+ReSpeakerCaptureWriter::~ReSpeakerCaptureWriter()
+{
+    close() ;
+    delete[] ring ;
+    delete[] ready ;
+}
+
+bool ReSpeakerCaptureWriter::open ( const char *path ) {
+    close() ;
+    file = fopen(path, "wb") ;
+    if (file == 0) {
+        return false ;
+    }
+    buffer.resize(BufferSize) ;
+    setvbuf(file, &buffer[0], _IOFBF, buffer.size()) ;
+    uint32_t header[4] = { ReSpeakerCapture::CaptureMagic, ReSpeakerCapture::CaptureVersion, 0, 0 } ;
+    if (fwrite(header, sizeof(header), 1, file) != 1) {
+        fclose(file) ;
+        file = 0 ;
+        return false ;
+    }
+    // Kept until the writer goes, so a late write() never sees it freed
+    if (ring == 0) {
+        ring = new char[RingBytes] ;
+        ready = new std::atomic<unsigned char>[RingBytes / Granule] ;
+        for (size_t i = 0; i < RingBytes / Granule; i++) {
+            ready[i].store(0, std::memory_order_relaxed) ;
+        }
+    }
+    claimed = 0 ;
+    released = 0 ;
+    written = 0 ;
+    failed = 0 ;
+    dropped = 0 ;
+    stopping = false ;
+    thread = std::thread(&ReSpeakerCaptureWriter::run, this) ;
+    accepting = true ;
+    return true ;
+}
+
+void ReSpeakerCaptureWriter::close ( void ) {
+    if (!thread.joinable()) {
+        return ;
+    }
+    accepting = false ;
+    // A write() already past the check finishes its record before the
+    // last drain, so nothing is left half written in the ring
+    while (writers > 0) {
+        std::this_thread::yield() ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        stopping = true ;
+    }
+    wakeUp.notify_one() ;
+    thread.join() ;
+    if (file) {
+        fclose(file) ;
+        file = 0 ;
+    }
+}
+
+bool ReSpeakerCaptureWriter::isOpen ( void ) const {
+    return accepting ;
+}
+
+void ReSpeakerCaptureWriter::write ( int stream, const void *data, unsigned int length, long long timestampUs ) {
+    ReSpeakerCaptureRecordHeader header ;
+    header.timestampUs = timestampUs < 0 ? ReSpeakerDirectionHistory::now() : timestampUs ;
+    header.length = length ;
+    header.stream = stream ;
+    header.reserved = 0 ;
+    const unsigned long long bytes = granules(sizeof(header) + length) ;
+
+    writers++ ;
+    if (!accepting) {
+        writers-- ;
+        return ;
+    }
+    unsigned long long start = claimed.load(std::memory_order_relaxed) ;
+    do {
+        if (start + bytes - released.load(std::memory_order_acquire) > RingBytes) {
+            dropped++ ;
+            writers-- ;
+            return ;
+        }
+    } while (!claimed.compare_exchange_weak(start, start + bytes, std::memory_order_relaxed)) ;
+    copyIn(start, &header, sizeof(header)) ;
+    if (length > 0) {
+        copyIn(start + sizeof(header), data, length) ;
+    }
+    ready[start % RingBytes / Granule].store(1, std::memory_order_release) ;
+    writers-- ;
+}
+
+void ReSpeakerCaptureWriter::writeAudioFormat ( int sampleRate, int channelCount, int sampleSize ) {
+    ReSpeakerCaptureAudioFormat format ;
+    format.sampleRate = sampleRate ;
+    format.channelCount = channelCount ;
+    format.sampleSize = sampleSize ;
+    write(ReSpeakerCapture::AudioFormat, &format, sizeof(format)) ;
+}
+
+unsigned long long ReSpeakerCaptureWriter::recordsWritten ( void ) const {
+    return written ;
+}
+
+unsigned long long ReSpeakerCaptureWriter::recordsFailed ( void ) const {
+    return failed ;
+}
+
+unsigned long long ReSpeakerCaptureWriter::recordsDropped ( void ) const {
+    return dropped ;
+}
+
+void ReSpeakerCaptureWriter::run ( void ) {
+    std::unique_lock<std::mutex> lock(mutex) ;
+    for (;;) {
+        const bool last = stopping ;
+        lock.unlock() ;
+        drain() ;
+        lock.lock() ;
+        if (last) {
+            return ;
+        }
+        wakeUp.wait_for(lock, std::chrono::milliseconds(PollIntervalMs)) ;
+    }
+}
+
+void ReSpeakerCaptureWriter::drain ( void ) {
+    unsigned long long position = released.load(std::memory_order_relaxed) ;
+    for (;;) {
+        const size_t offset = position % RingBytes ;
+        std::atomic<unsigned char> &flag = ready[offset / Granule] ;
+        if (flag.load(std::memory_order_acquire) == 0) {
+            // Empty, or the record there is still being copied in
+            return ;
+        }
+        ReSpeakerCaptureRecordHeader header ;
+        memcpy(&header, ring + offset, sizeof(header)) ;
+        const size_t length = sizeof(header) + header.length ;
+        if (file) {
+            if (writeOut(offset, length)) {
+                written++ ;
+            } else {
+                // A partial record would throw every later one out of step
+                failed++ ;
+                accepting = false ;
+                fclose(file) ;
+                file = 0 ;
+            }
+        }
+        flag.store(0, std::memory_order_relaxed) ;
+        position += granules(length) ;
+        released.store(position, std::memory_order_release) ;
+    }
+}
+
+void ReSpeakerCaptureWriter::copyIn ( unsigned long long position, const void *data, size_t length ) {
+    const size_t offset = position % RingBytes ;
+    const size_t first = length < RingBytes - offset ? length : RingBytes - offset ;
+    memcpy(ring + offset, data, first) ;
+    memcpy(ring, static_cast<const char *>(data) + first, length - first) ;
+}
+
+bool ReSpeakerCaptureWriter::writeOut ( size_t offset, size_t length ) {
+    const size_t first = length < RingBytes - offset ? length : RingBytes - offset ;
+    return fwrite(ring + offset, first, 1, file) == 1 &&
+           (first == length || fwrite(ring, length - first, 1, file) == 1) ;
+}
+
+//
+// Reader
+//
+
+ReSpeakerCaptureReader::ReSpeakerCaptureReader()
+    : file(0)
+{
+}
+
+ReSpeakerCaptureReader::~ReSpeakerCaptureReader()
+{
+    close() ;
+}
+
+bool ReSpeakerCaptureReader::open ( const char *path ) {
+    close() ;
+    file = fopen(path, "rb") ;
+    if (file == 0) {
+        return false ;
+    }
+    if (!rewind()) {
+        close() ;
+        return false ;
+    }
+    return true ;
+}
+
+void ReSpeakerCaptureReader::close ( void ) {
+    if (file) {
+        fclose(file) ;
+        file = 0 ;
+    }
+}
+
+bool ReSpeakerCaptureReader::isOpen ( void ) const {
+    return file != 0 ;
+}
+
+bool ReSpeakerCaptureReader::rewind ( void ) {
+    uint32_t header[4] ;
+    if (file == 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        fread(header, sizeof(header), 1, file) != 1) {
+        return false ;
+    }
+    return header[0] == ReSpeakerCapture::CaptureMagic && header[1] == ReSpeakerCapture::CaptureVersion ;
+}
+
+bool ReSpeakerCaptureReader::next ( ReSpeakerCaptureRecord *record ) {
+    ReSpeakerCaptureRecordHeader header ;
+    if (file == 0 || fread(&header, sizeof(header), 1, file) != 1 || header.length > MaxRecordLength) {
+        return false ;
+    }
+    record->timestampUs = header.timestampUs ;
+    record->stream = header.stream ;
+    record->data.resize(header.length) ;
+    return header.length == 0 || fread(&record->data[0], header.length, 1, file) == 1 ;
+}
+
+//
+// Player
+//
+
+ReSpeakerCapturePlayer::ReSpeakerCapturePlayer ( const char *path )
+    : running(false)
+    , done(false)
+    , played(0)
+    , maxLateness(0)
+{
+    reader.open(path) ;
+}
+
+ReSpeakerCapturePlayer::~ReSpeakerCapturePlayer()
+{
+    stop() ;
+}
+
+bool ReSpeakerCapturePlayer::isOpen ( void ) const {
+    return reader.isOpen() ;
+}
+
+void ReSpeakerCapturePlayer::setHandler ( int stream, ReSpeakerCaptureHandler handler ) {
+    if (stream > 0 && stream < ReSpeakerCapture::StreamCount) {
+        handlers[stream] = handler ;
+    }
+}
+
+bool ReSpeakerCapturePlayer::start ( double speed ) {
+    stop() ;
+    if (!reader.rewind()) {
+        return false ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        running = true ;
+        done = false ;
+    }
+    played = 0 ;
+    maxLateness = 0 ;
+    thread = std::thread(&ReSpeakerCapturePlayer::run, this, speed > 0 ? speed : 0) ;
+    return true ;
+}
+
+void ReSpeakerCapturePlayer::stop ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        running = false ;
+    }
+    wakeUp.notify_all() ;
+    if (thread.joinable()) {
+        thread.join() ;
+    }
+}
+
+bool ReSpeakerCapturePlayer::finished ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return done ;
+}
+
+void ReSpeakerCapturePlayer::waitFinished ( void ) {
+    std::unique_lock<std::mutex> lock(mutex) ;
+    wakeUp.wait(lock, [this] { return done || !running ; }) ;
+}
+
+unsigned long long ReSpeakerCapturePlayer::recordsPlayed ( void ) const {
+    return played.load() ;
+}
+
+long long ReSpeakerCapturePlayer::maxLatenessUs ( void ) const {
+    return maxLateness.load() ;
+}
+
+void ReSpeakerCapturePlayer::run ( double speed ) {
+    typedef std::chrono::steady_clock Clock ;
+    const Clock::time_point start = Clock::now() ;
+    long long firstUs = -1 ;
+    ReSpeakerCaptureRecord record ;
+    while (reader.next(&record)) {
+        if (record.stream <= 0 || record.stream >= ReSpeakerCapture::StreamCount || !handlers[record.stream]) {
+            continue ;
+        }
+        if (firstUs < 0) {
+            firstUs = record.timestampUs ;
+        }
+        if (speed > 0) {
+            const Clock::time_point due = start + std::chrono::microseconds(
+                        (long long)((record.timestampUs - firstUs) / speed)) ;
+            std::unique_lock<std::mutex> lock(mutex) ;
+            wakeUp.wait_until(lock, due, [this] { return !running ; }) ;
+            if (!running) {
+                return ;
+            }
+            lock.unlock() ;
+            const long long lateUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due).count() ;
+            if (lateUs > maxLateness.load()) {
+                maxLateness = lateUs ;
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(mutex) ;
+            if (!running) {
+                return ;
+            }
+        }
+        handlers[record.stream](record) ;
+        played++ ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        done = true ;
+    }
+    wakeUp.notify_all() ;
+}
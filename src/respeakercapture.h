@@ -0,0 +1,193 @@
+#ifndef RESPEAKERCAPTURE_H
+#define RESPEAKERCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A capture file holds the HID reports and audio blocks that crossed the
+// host stack, each stamped with the monotonic time it was seen, so a field
+// session can be played back on the bench. The file is a 16 byte header
+// {CaptureMagic, CaptureVersion, 0, 0} followed by records, each a
+// ReSpeakerCaptureRecordHeader and its payload. Little endian throughout.
+
+// 16 bytes, the layout written before every payload
+struct ReSpeakerCaptureRecordHeader
+{
+    int64_t timestampUs ;
+    uint32_t length ;       // Payload bytes that follow
+    uint16_t stream ;
+    uint16_t reserved ;
+};
+
+// Payload of an AudioFormat record; blocks are signed little endian PCM
+struct ReSpeakerCaptureAudioFormat
+{
+    uint32_t sampleRate ;
+    uint16_t channelCount ;
+    uint16_t sampleSize ;   // Bits
+};
+
+// A record read back from a capture
+struct ReSpeakerCaptureRecord
+{
+    long long timestampUs ;
+    int stream ;
+    std::vector<unsigned char> data ;
+};
+
+typedef std::function<void (const ReSpeakerCaptureRecord &)> ReSpeakerCaptureHandler ;
+
+class ReSpeakerCapture
+{
+public:
+    // Append new streams at the end; the numbers are stored in captures
+    enum Stream {
+        HostReport = 1,     // Report written to the array, report id first
+        DeviceReport,       // Report read from the array
+        AudioFormat,        // ReSpeakerCaptureAudioFormat for the blocks after it
+        AudioBlock,         // PCM as the audio device delivered it
+        StreamCount
+    };
+
+    static const uint32_t CaptureMagic = 0x50435352 ;   // "RSCP"
+    static const uint32_t CaptureVersion = 1 ;
+};
+
+// Appends records to a capture file. Any thread may write: a record is
+// copied into a lock-free ring, claimed with one compare and swap, and a
+// thread of the writer's own drains the ring to the file, so the HID
+// reader, the USB event thread or the audio thread never waits on the
+// disk. Records arriving while the ring is full are dropped and counted.
+class ReSpeakerCaptureWriter
+{
+public:
+    ReSpeakerCaptureWriter() ;
+    ~ReSpeakerCaptureWriter() ;
+
+    bool open ( const char *path ) ;
+    // Writes out what is in the ring and closes the file
+    void close ( void ) ;
+    bool isOpen ( void ) const ;
+
+    // A timestampUs of -1 stamps the record with ReSpeakerDirectionHistory::now()
+    void write ( int stream, const void *data, unsigned int length, long long timestampUs = -1 ) ;
+    void writeAudioFormat ( int sampleRate, int channelCount, int sampleSize ) ;
+
+    unsigned long long recordsWritten ( void ) const ;
+    // Records lost to a write error; the capture is closed after the first
+    unsigned long long recordsFailed ( void ) const ;
+    // Records dropped because the disk fell a whole ring behind
+    unsigned long long recordsDropped ( void ) const ;
+
+    static const size_t RingBytes = 4 << 20 ;
+    // Records start on a granule, so a record header never wraps
+    static const size_t Granule = 16 ;
+    static const int PollIntervalMs = 20 ;
+
+private:
+    static const int BufferSize = 1 << 20 ;
+
+    ReSpeakerCaptureWriter ( const ReSpeakerCaptureWriter & ) ;
+    ReSpeakerCaptureWriter &operator= ( const ReSpeakerCaptureWriter & ) ;
+
+    void run ( void ) ;
+    // Write every complete record at the front of the ring to the file
+    void drain ( void ) ;
+    void copyIn ( unsigned long long position, const void *data, size_t length ) ;
+    bool writeOut ( size_t offset, size_t length ) ;
+
+    // Only the writer thread touches file once it is running
+    FILE *file ;
+    std::vector<char> buffer ;
+
+    char *ring ;
+    // One flag per granule, set on the first granule of a record once the
+    // whole record is in the ring
+    std::atomic<unsigned char> *ready ;
+    // Producers claim ring bytes at claimed; bytes below released are free
+    std::atomic<unsigned long long> claimed ;
+    char padClaimed[64 - sizeof(std::atomic<unsigned long long>)] ;
+    std::atomic<unsigned long long> released ;
+    char padReleased[64 - sizeof(std::atomic<unsigned long long>)] ;
+    // Producers between checking accepting and publishing their record
+    std::atomic<int> writers ;
+    std::atomic<bool> accepting ;
+
+    std::thread thread ;
+    std::mutex mutex ;
+    std::condition_variable wakeUp ;
+    bool stopping ;
+    std::atomic<unsigned long long> written ;
+    std::atomic<unsigned long long> failed ;
+    std::atomic<unsigned long long> dropped ;
+};
+
+// Reads a capture file record by record
+class ReSpeakerCaptureReader
+{
+public:
+    ReSpeakerCaptureReader() ;
+    ~ReSpeakerCaptureReader() ;
+
+    // Returns false if path is not a capture this version can read
+    bool open ( const char *path ) ;
+    void close ( void ) ;
+    bool isOpen ( void ) const ;
+    // Returns false at the end of the capture or on a truncated record
+    bool next ( ReSpeakerCaptureRecord *record ) ;
+    bool rewind ( void ) ;
+
+private:
+    FILE *file ;
+};
+
+// Plays a capture back on a thread of its own, handing each record to the
+// handler for its stream when its time comes: at the recorded pace, scaled
+// by speed, or back to back with a speed of 0
+class ReSpeakerCapturePlayer
+{
+public:
+    explicit ReSpeakerCapturePlayer ( const char *path ) ;
+    ~ReSpeakerCapturePlayer() ;
+
+    bool isOpen ( void ) const ;
+    // Called on the player thread; set before start(). Streams without a
+    // handler are skipped
+    void setHandler ( int stream, ReSpeakerCaptureHandler handler ) ;
+
+    // Play from the beginning. speed 2 plays twice as fast
+    bool start ( double speed = 1.0 ) ;
+    void stop ( void ) ;
+    // True once every record has been handed out
+    bool finished ( void ) const ;
+    void waitFinished ( void ) ;
+
+    unsigned long long recordsPlayed ( void ) const ;
+    // Worst delay between a record falling due and its handler being
+    // called; shows whether the host kept up with the replay
+    long long maxLatenessUs ( void ) const ;
+
+private:
+    void run ( double speed ) ;
+
+    ReSpeakerCaptureReader reader ;
+    ReSpeakerCaptureHandler handlers[ReSpeakerCapture::StreamCount] ;
+
+    std::thread thread ;
+    mutable std::mutex mutex ;
+    std::condition_variable wakeUp ;
+    bool running ;
+    bool done ;
+    std::atomic<unsigned long long> played ;
+    std::atomic<long long> maxLateness ;
+};
+
+#endif // RESPEAKERCAPTURE_H
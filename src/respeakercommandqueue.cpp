@@ -0,0 +1,159 @@
+#include <string.h>
+#include <vector>
+
+#include "respeakercommandqueue.h"
+#include "respeakermicarray.h"
+
+ReSpeakerCommandQueue::ReSpeakerCommandQueue ( ReSpeakerMicArray *micArray )
+    : micArray(micArray)
+    , completedCount(0)
+    , running(true)
+{
+    thread = std::thread(&ReSpeakerCommandQueue::run, this) ;
+}
+
+ReSpeakerCommandQueue::~ReSpeakerCommandQueue()
+{
+    stop() ;
+}
+
+std::future<int> ReSpeakerCommandQueue::post ( Lane lane, ReSpeakerCommand command, ReSpeakerCommandCallback callback ) {
+    Command queued ;
+    queued.run = command ;
+    queued.callback = callback ;
+    queued.done = new std::promise<int> ;
+    std::future<int> result = queued.done->get_future() ;
+    enqueue(lane, &queued) ;
+    return result ;
+}
+
+void ReSpeakerCommandQueue::send ( Lane lane, ReSpeakerCommand command, ReSpeakerCommandCallback callback ) {
+    Command queued ;
+    queued.run = command ;
+    queued.callback = callback ;
+    enqueue(lane, &queued) ;
+}
+
+void ReSpeakerCommandQueue::enqueue ( Lane lane, Command *command ) {
+    if (!running) {
+        finish(command, -1) ;
+        return ;
+    }
+    lanes[lane].push(std::move(*command)) ;
+    // Passing through the lock guarantees the owner is either about to look
+    // at the lanes or already waiting, so the notification cannot be lost
+    { std::lock_guard<std::mutex> lock(mutex) ; }
+    wakeUp.notify_one() ;
+}
+
+std::future<int> ReSpeakerCommandQueue::readRegister ( unsigned char reg, unsigned char len, ReSpeakerRegisterCallback callback ) {
+    return post(RegisterLane, [reg, len, callback] (ReSpeakerMicArray *micArray) {
+        unsigned char data[ReSpeakerTransaction::MaxPayloadLength] ;
+        if (len > sizeof(data)) {
+            return 0 ;
+        }
+        int res = micArray->readRegister(reg, data, len) ;
+        if (callback) {
+            callback(res, data, len) ;
+        }
+        return res ;
+    }) ;
+}
+
+std::future<int> ReSpeakerCommandQueue::writeRegister ( unsigned char reg, const unsigned char *data, unsigned char len,
+                                                        ReSpeakerCommandCallback callback ) {
+    if (len > ReSpeakerTransaction::MaxPayloadLength) {
+        return post(RegisterLane, [] (ReSpeakerMicArray *) { return 0 ; }, callback) ;
+    }
+    // The caller's buffer may be gone by the time the command runs
+    std::vector<unsigned char> value(data, data + len) ;
+    return post(RegisterLane, [reg, value] (ReSpeakerMicArray *micArray) {
+        unsigned char copy[ReSpeakerTransaction::MaxPayloadLength] ;
+        memcpy(copy, value.data(), value.size()) ;
+        return micArray->writeRegister(reg, copy, value.size()) ;
+    }, callback) ;
+}
+
+std::future<int> ReSpeakerCommandQueue::execute ( ReSpeakerTransaction *transaction, ReSpeakerTransactionCallback callback ) {
+    return post(RegisterLane, [transaction, callback] (ReSpeakerMicArray *micArray) {
+        int res = micArray->execute(transaction) ;
+        if (callback) {
+            callback(transaction) ;
+        }
+        return res ;
+    }) ;
+}
+
+std::future<int> ReSpeakerCommandQueue::setLEDMode ( unsigned char mode, unsigned char data1, unsigned char data2, unsigned char data3,
+                                                     ReSpeakerCommandCallback callback ) {
+    return post(LedLane, [mode, data1, data2, data3] (ReSpeakerMicArray *micArray) {
+        return micArray->setLEDMode(mode, data1, data2, data3) ;
+    }, callback) ;
+}
+
+void ReSpeakerCommandQueue::stop ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        running = false ;
+    }
+    wakeUp.notify_all() ;
+    if (thread.joinable()) {
+        thread.join() ;
+    }
+    // Posted after the owner had drained the lanes
+    Command command ;
+    while (takeNext(&command)) {
+        finish(&command, -1) ;
+    }
+}
+
+bool ReSpeakerCommandQueue::isOwnerThread ( void ) const {
+    return std::this_thread::get_id() == thread.get_id() ;
+}
+
+unsigned long long ReSpeakerCommandQueue::completed ( void ) const {
+    return completedCount.load() ;
+}
+
+// Highest lane first
+bool ReSpeakerCommandQueue::takeNext ( Command *command ) {
+    for (int lane = 0; lane < LaneCount; lane++) {
+        if (lanes[lane].pop(command)) {
+            return true ;
+        }
+    }
+    return false ;
+}
+
+void ReSpeakerCommandQueue::finish ( Command *command, int result ) {
+    if (command->callback) {
+        command->callback(result) ;
+    }
+    if (command->done) {
+        command->done->set_value(result) ;
+        delete command->done ;
+        command->done = 0 ;
+    }
+}
+
+void ReSpeakerCommandQueue::run ( void ) {
+    Command command ;
+    for (;;) {
+        if (takeNext(&command)) {
+            finish(&command, command.run(micArray)) ;
+            completedCount++ ;
+            continue ;
+        }
+        std::unique_lock<std::mutex> lock(mutex) ;
+        bool empty = true ;
+        for (int lane = 0; lane < LaneCount; lane++) {
+            empty = empty && lanes[lane].empty() ;
+        }
+        if (empty && !running) {
+            break ;
+        }
+        if (empty) {
+            wakeUp.wait(lock) ;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef RESPEAKERCOMMANDQUEUE_H
+#define RESPEAKERCOMMANDQUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "mpscqueue.h"
+#include "respeakertransaction.h"
+
+class ReSpeakerMicArray ;
+
+// Work run against the array on the queue's thread; returns the result
+// handed to the callback and the future
+typedef std::function<int (ReSpeakerMicArray *)> ReSpeakerCommand ;
+// Called on the queue's thread once a command has run
+typedef std::function<void (int result)> ReSpeakerCommandCallback ;
+// Called on the queue's thread with the outcome of a register read
+typedef std::function<void (int result, const unsigned char *data, unsigned char len)> ReSpeakerRegisterCallback ;
+
+// Serialises every control request to one array on a single owner thread.
+// Any thread may post; posting never waits for the USB call or for other
+// posters. Completions come back through a callback, run on the owner
+// thread, and a future for callers of post(). Commands run in the order
+// they were posted within a lane, and a lane is only served once every
+// lane above it is empty, so a stream of LED frames cannot hold up a
+// register read. Auto reports do not pass through here at all; the array's
+// event reader decodes them.
+// Callbacks must be quick and must not wait for another posted command.
+class ReSpeakerCommandQueue
+{
+public:
+    enum Lane {
+        RegisterLane,   // Register reads, writes and batches
+        LedLane,        // LED frames
+        LaneCount
+    };
+
+    explicit ReSpeakerCommandQueue ( ReSpeakerMicArray *micArray ) ;
+    // Runs what is still queued, then stops
+    ~ReSpeakerCommandQueue() ;
+
+    // Run command on the owner thread. Once stopped, commands are not run
+    // and complete with -1
+    std::future<int> post ( Lane lane, ReSpeakerCommand command,
+                            ReSpeakerCommandCallback callback = ReSpeakerCommandCallback() ) ;
+    // The same without a future, for callers that only want the callback or
+    // nothing back; it saves allocating the future's shared state
+    void send ( Lane lane, ReSpeakerCommand command,
+                ReSpeakerCommandCallback callback = ReSpeakerCommandCallback() ) ;
+
+    // The array's control calls, posted to the lane they belong in
+    std::future<int> readRegister ( unsigned char reg, unsigned char len, ReSpeakerRegisterCallback callback ) ;
+    std::future<int> writeRegister ( unsigned char reg, const unsigned char *data, unsigned char len,
+                                     ReSpeakerCommandCallback callback = ReSpeakerCommandCallback() ) ;
+    // transaction must outlive the returned future
+    std::future<int> execute ( ReSpeakerTransaction *transaction,
+                               ReSpeakerTransactionCallback callback = ReSpeakerTransactionCallback() ) ;
+    std::future<int> setLEDMode ( unsigned char mode, unsigned char data1, unsigned char data2, unsigned char data3,
+                                  ReSpeakerCommandCallback callback = ReSpeakerCommandCallback() ) ;
+
+    // Finish the queued commands and join the owner thread
+    void stop ( void ) ;
+    // True on the owner thread, where commands may call the array directly
+    bool isOwnerThread ( void ) const ;
+    // Commands run so far
+    unsigned long long completed ( void ) const ;
+
+private:
+    struct Command {
+        Command() : done(0) { }
+        ReSpeakerCommand run ;
+        ReSpeakerCommandCallback callback ;
+        // Owned; 0 when nobody asked for a future
+        std::promise<int> *done ;
+    };
+
+    void enqueue ( Lane lane, Command *command ) ;
+    void run ( void ) ;
+    bool takeNext ( Command *command ) ;
+    void finish ( Command *command, int result ) ;
+
+    ReSpeakerMicArray *micArray ;
+    MpscQueue<Command> lanes[LaneCount] ;
+    std::atomic<unsigned long long> completedCount ;
+
+    // Only for sleeping; posting passes through it but never holds it
+    std::mutex mutex ;
+    std::condition_variable wakeUp ;
+    std::atomic<bool> running ;
+    std::thread thread ;
+};
+
+#endif // RESPEAKERCOMMANDQUEUE_H
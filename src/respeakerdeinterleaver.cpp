@@ -0,0 +1,237 @@
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RESPEAKER_DEINTERLEAVE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESPEAKER_DEINTERLEAVE_NEON
+#endif
+
+#include "respeakerdeinterleaver.h"
+
+const int ReSpeakerDeinterleaver::MaxChannels ;
+
+// Same scale as the example's pcmToReal(): -32768 maps to -1
+static const float PcmScale = 1.0f / 32768 ;
+
+#if defined(RESPEAKER_DEINTERLEAVE_SSE2)
+
+// count is a multiple of 4
+static void convert ( const int16_t *in, float *out, int count ) {
+    const __m128 scale = _mm_set1_ps(PcmScale) ;
+    int i = 0 ;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)) ;
+        // Widen by pairing each sample with itself and shifting the copy out
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16) ;
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16) ;
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale)) ;
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale)) ;
+    }
+    if (i < count) {
+        const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + i)) ;
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16) ;
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale)) ;
+    }
+}
+
+// rows are four frames of converted samples, stride floats apart; stores
+// channels first to first + 3 of those frames to out[0..3]
+static void transpose ( const float *rows, int stride, int first, float *out[4] ) {
+    __m128 r0 = _mm_loadu_ps(rows + first) ;
+    __m128 r1 = _mm_loadu_ps(rows + stride + first) ;
+    __m128 r2 = _mm_loadu_ps(rows + 2 * stride + first) ;
+    __m128 r3 = _mm_loadu_ps(rows + 3 * stride + first) ;
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3) ;
+    if (out[0]) _mm_store_ps(out[0], r0) ;
+    if (out[1]) _mm_store_ps(out[1], r1) ;
+    if (out[2]) _mm_store_ps(out[2], r2) ;
+    if (out[3]) _mm_store_ps(out[3], r3) ;
+}
+
+#elif defined(RESPEAKER_DEINTERLEAVE_NEON)
+
+static void convert ( const int16_t *in, float *out, int count ) {
+    int i = 0 ;
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t v = vld1q_s16(in + i) ;
+        const int32x4_t lo = vmovl_s16(vget_low_s16(v)) ;
+        const int32x4_t hi = vmovl_s16(vget_high_s16(v)) ;
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(lo), PcmScale)) ;
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(hi), PcmScale)) ;
+    }
+    if (i < count) {
+        const int32x4_t lo = vmovl_s16(vld1_s16(in + i)) ;
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(lo), PcmScale)) ;
+    }
+}
+
+static void transpose ( const float *rows, int stride, int first, float *out[4] ) {
+    const float32x4x2_t t01 = vtrnq_f32(vld1q_f32(rows + first), vld1q_f32(rows + stride + first)) ;
+    const float32x4x2_t t23 = vtrnq_f32(vld1q_f32(rows + 2 * stride + first),
+                                        vld1q_f32(rows + 3 * stride + first)) ;
+    if (out[0]) vst1q_f32(out[0], vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]))) ;
+    if (out[1]) vst1q_f32(out[1], vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]))) ;
+    if (out[2]) vst1q_f32(out[2], vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]))) ;
+    if (out[3]) vst1q_f32(out[3], vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]))) ;
+}
+
+#endif
+
+ReSpeakerDeinterleaver::ReSpeakerDeinterleaver ( int channelCount )
+    : channels(0)
+    , storage(0)
+    , stride(0)
+    , capacity(0)
+    , frames(0)
+{
+    setChannelCount(channelCount) ;
+}
+
+ReSpeakerDeinterleaver::~ReSpeakerDeinterleaver()
+{
+    free(storage) ;
+}
+
+bool ReSpeakerDeinterleaver::setChannelCount ( int channelCount ) {
+    if (channelCount < 1 || channelCount > MaxChannels) {
+        channels = 0 ;
+        map.clear() ;
+        for (int c = 0; c < MaxChannels; c++) {
+            planeOf[c] = -1 ;
+        }
+        free(storage) ;
+        storage = 0 ;
+        capacity = 0 ;
+        frames = 0 ;
+        return false ;
+    }
+    channels = channelCount ;
+    return setChannelMap(std::vector<int>()) ;
+}
+
+int ReSpeakerDeinterleaver::channelCount ( void ) const {
+    return channels ;
+}
+
+bool ReSpeakerDeinterleaver::setChannelMap ( const std::vector<int> &channelMap ) {
+    int selected[MaxChannels] ;
+    for (int c = 0; c < MaxChannels; c++) {
+        selected[c] = -1 ;
+    }
+    std::vector<int> planes(channelMap) ;
+    if (planes.empty()) {
+        for (int c = 0; c < channels; c++) {
+            planes.push_back(c) ;
+        }
+    }
+    for (size_t p = 0; p < planes.size(); p++) {
+        const int c = planes[p] ;
+        if (c < 0 || c >= channels || selected[c] >= 0) {
+            return false ;
+        }
+        selected[c] = p ;
+    }
+    map.swap(planes) ;
+    for (int c = 0; c < MaxChannels; c++) {
+        planeOf[c] = selected[c] ;
+    }
+    // The planes are laid out afresh for the new count
+    free(storage) ;
+    storage = 0 ;
+    capacity = 0 ;
+    frames = 0 ;
+    return true ;
+}
+
+const std::vector<int> &ReSpeakerDeinterleaver::channelMap ( void ) const {
+    return map ;
+}
+
+int ReSpeakerDeinterleaver::planeCount ( void ) const {
+    return map.size() ;
+}
+
+size_t ReSpeakerDeinterleaver::frameCount ( void ) const {
+    return frames ;
+}
+
+const float *ReSpeakerDeinterleaver::plane ( int index ) const {
+    return storage + index * stride ;
+}
+
+float *ReSpeakerDeinterleaver::planeData ( int index ) {
+    return storage + index * stride ;
+}
+
+const char *ReSpeakerDeinterleaver::kernel ( void ) {
+#if defined(RESPEAKER_DEINTERLEAVE_SSE2)
+    return "SSE2" ;
+#elif defined(RESPEAKER_DEINTERLEAVE_NEON)
+    return "NEON" ;
+#else
+    return "C" ;
+#endif
+}
+
+// Planes are a whole number of vectors apart, so every plane starts aligned
+void ReSpeakerDeinterleaver::reserve ( size_t frameCount ) {
+    if (frameCount <= capacity && storage) {
+        return ;
+    }
+    free(storage) ;
+    storage = 0 ;
+    capacity = (frameCount + 3) & ~size_t(3) ;
+    stride = capacity ;
+    void *aligned ;
+    if (posix_memalign(&aligned, 16, (map.size() * stride > 0 ? map.size() * stride : 4) * sizeof(float)) == 0) {
+        storage = static_cast<float *>(aligned) ;
+    } else {
+        capacity = 0 ;
+    }
+}
+
+void ReSpeakerDeinterleaver::process ( const int16_t *in, size_t frameCount ) {
+    if (channels == 0) {
+        frames = 0 ;
+        return ;
+    }
+    reserve(frameCount) ;
+    if (storage == 0) {
+        frames = 0 ;
+        return ;
+    }
+    frames = frameCount ;
+    size_t f = 0 ;
+
+#if defined(RESPEAKER_DEINTERLEAVE_SSE2) || defined(RESPEAKER_DEINTERLEAVE_NEON)
+    // Four frames of floats, plus slack for a tile reaching past the last
+    // channel of the last frame
+    float rows[4 * MaxChannels + 4] ;
+    const int tiles = (channels + 3) / 4 ;
+    for (; f + 4 <= frameCount; f += 4) {
+        convert(in + f * channels, rows, 4 * channels) ;
+        for (int t = 0; t < tiles; t++) {
+            float *out[4] ;
+            bool any = false ;
+            for (int j = 0; j < 4; j++) {
+                const int c = 4 * t + j ;
+                // Lanes past the last channel hold the next frame; drop them
+                out[j] = c < channels && planeOf[c] >= 0 ? planeData(planeOf[c]) + f : 0 ;
+                any = any || out[j] ;
+            }
+            if (any) {
+                transpose(rows, channels, 4 * t, out) ;
+            }
+        }
+    }
+#endif
+
+    for (; f < frameCount; f++) {
+        const int16_t *frame = in + f * channels ;
+        for (size_t p = 0; p < map.size(); p++) {
+            planeData(p)[f] = frame[map[p]] * PcmScale ;
+        }
+    }
+}
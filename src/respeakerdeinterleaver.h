@@ -0,0 +1,67 @@
+#ifndef RESPEAKERDEINTERLEAVER_H
+#define RESPEAKERDEINTERLEAVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Splits interleaved signed 16 bit PCM, as the array's audio interface
+// delivers it, into one contiguous float plane per channel scaled to
+// [-1, 1), so analysis can run on a single microphone or processed channel
+// without striding over the others. A channel map picks which input
+// channels become planes and in what order.
+//
+// Frames are taken four at a time: the block is converted to float and
+// each run of four channels transposed as a 4x4 tile, with SSE2 or NEON
+// where the compiler targets them and plain C otherwise.
+class ReSpeakerDeinterleaver
+{
+public:
+    static const int MaxChannels = 16 ;
+
+    explicit ReSpeakerDeinterleaver ( int channelCount = 1 ) ;
+    ~ReSpeakerDeinterleaver() ;
+
+    // Also resets the map to every channel in order. Returns false for a
+    // count outside 1 to MaxChannels, leaving no planes, so process()
+    // refuses the audio rather than splitting it at the wrong stride
+    bool setChannelCount ( int channelCount ) ;
+    int channelCount ( void ) const ;
+
+    // Plane i holds input channel map[i]; an empty map selects every
+    // channel in order. Returns false, keeping the old map, if a channel
+    // is out of range or listed twice
+    bool setChannelMap ( const std::vector<int> &map ) ;
+    const std::vector<int> &channelMap ( void ) const ;
+    int planeCount ( void ) const ;
+
+    // Replaces the planes with frameCount frames of channelCount() samples;
+    // does nothing, leaving frameCount() 0, without a valid channel count
+    void process ( const int16_t *frames, size_t frameCount ) ;
+    size_t frameCount ( void ) const ;
+    // frameCount() samples, 16 byte aligned
+    const float *plane ( int index ) const ;
+
+    // Which kernel process() uses: "SSE2", "NEON" or "C"
+    static const char *kernel ( void ) ;
+
+private:
+    ReSpeakerDeinterleaver ( const ReSpeakerDeinterleaver & ) ;
+    ReSpeakerDeinterleaver &operator= ( const ReSpeakerDeinterleaver & ) ;
+
+    void reserve ( size_t frames ) ;
+    float *planeData ( int index ) ;
+
+    int channels ;
+    std::vector<int> map ;
+    // Plane each input channel goes to, or -1
+    int planeOf[MaxChannels] ;
+
+    float *storage ;
+    size_t stride ;
+    size_t capacity ;
+    size_t frames ;
+};
+
+#endif // RESPEAKERDEINTERLEAVER_H
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <iostream>
+
+#include "respeakerdevicemanager.h"
+
+ReSpeakerDeviceManager::ReSpeakerDeviceManager ( ReSpeakerMicArray::Backend backend,
+                                                 unsigned short vendorId, unsigned short productId )
+    : backend(backend)
+    , vendorId(vendorId)
+    , productId(productId)
+    , usbContext(0)
+    , nextId(0)
+    , started(false)
+{
+    if (backend == ReSpeakerMicArray::LibusbBackend) {
+        usbContext = new ReSpeakerUsbContext ;
+    }
+}
+
+ReSpeakerDeviceManager::~ReSpeakerDeviceManager()
+{
+    close() ;
+    // Every transport using the context is gone by now
+    delete usbContext ;
+}
+
+int ReSpeakerDeviceManager::open ( void ) {
+    int added = 0 ;
+    struct hid_device_info *list = hid_enumerate(vendorId, productId) ;
+    for (struct hid_device_info *entry = list; entry; entry = entry->next) {
+        std::string path(entry->path ? entry->path : "") ;
+        if (findByPath(path) >= 0) {
+            continue ;
+        }
+        // A replugged array has a new path but reconnects by itself
+        if (entry->serial_number && *entry->serial_number && findBySerial(entry->serial_number) >= 0) {
+            continue ;
+        }
+        ReSpeakerTransport *transport = openTransport(entry->path, entry->serial_number) ;
+        if (transport == 0) {
+            std::cout << "Unable to open array at " << path << std::endl ;
+            continue ;
+        }
+        Device device ;
+        device.info.id = nextId++ ;
+        device.info.path = path ;
+        if (entry->serial_number) {
+            device.info.serial = entry->serial_number ;
+        }
+        device.micArray = new ReSpeakerMicArray(transport) ;
+        if (started) {
+            startDevice(device) ;
+        }
+        devices.push_back(device) ;
+        added++ ;
+    }
+    hid_free_enumeration(list) ;
+    return added ;
+}
+
+void ReSpeakerDeviceManager::close ( void ) {
+    for (size_t i = 0; i < devices.size(); i++) {
+        delete devices[i].micArray ;
+    }
+    devices.clear() ;
+}
+
+ReSpeakerTransport *ReSpeakerDeviceManager::openTransport ( const char *path, const wchar_t *serial ) {
+    if (path == 0) {
+        return 0 ;
+    }
+    if (backend == ReSpeakerMicArray::HidapiBackend) {
+        // The serial number lets a replugged array be found again
+        hid_device *handle = hid_open_path(path) ;
+        return handle ? new ReSpeakerHidapiTransport(handle, vendorId, productId, serial) : 0 ;
+    }
+    int interfaceNumber ;
+    libusb_device *usbDevice = findUsbDevice(path, &interfaceNumber) ;
+    if (usbDevice == 0) {
+        return 0 ;
+    }
+    ReSpeakerLibusbTransport *transport = new ReSpeakerLibusbTransport(usbContext, usbDevice, interfaceNumber) ;
+    libusb_unref_device(usbDevice) ;
+    if (!transport->isOpen()) {
+        delete transport ;
+        return 0 ;
+    }
+    return transport ;
+}
+
+// hidapi's libusb backend names devices "bus:address:interface" in hex.
+// Returns a referenced device and its interface in interfaceNumber, or 0
+// if path does not name one
+libusb_device *ReSpeakerDeviceManager::findUsbDevice ( const char *path, int *interfaceNumber ) {
+    unsigned int bus, address, interface ;
+    if (usbContext == 0 || !usbContext->isValid() ||
+        sscanf(path, "%x:%x:%x", &bus, &address, &interface) != 3) {
+        return 0 ;
+    }
+    libusb_device **list ;
+    libusb_device *found = 0 ;
+    ssize_t count = libusb_get_device_list(usbContext->context(), &list) ;
+    for (ssize_t i = 0; i < count && found == 0; i++) {
+        if (libusb_get_bus_number(list[i]) == bus && libusb_get_device_address(list[i]) == address) {
+            found = libusb_ref_device(list[i]) ;
+        }
+    }
+    if (count >= 0) {
+        libusb_free_device_list(list, 1) ;
+    }
+    *interfaceNumber = interface ;
+    return found ;
+}
+
+int ReSpeakerDeviceManager::count ( void ) const {
+    return devices.size() ;
+}
+
+const ReSpeakerDeviceInfo &ReSpeakerDeviceManager::info ( int index ) const {
+    return devices[index].info ;
+}
+
+ReSpeakerMicArray *ReSpeakerDeviceManager::device ( int id ) const {
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (devices[i].info.id == id) {
+            return devices[i].micArray ;
+        }
+    }
+    return 0 ;
+}
+
+int ReSpeakerDeviceManager::findBySerial ( const std::wstring &serial ) const {
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (devices[i].info.serial == serial) {
+            return devices[i].info.id ;
+        }
+    }
+    return -1 ;
+}
+
+int ReSpeakerDeviceManager::findByPath ( const std::string &path ) const {
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (devices[i].info.path == path) {
+            return devices[i].info.id ;
+        }
+    }
+    return -1 ;
+}
+
+void ReSpeakerDeviceManager::setAutoReportCallback ( ReSpeakerDeviceReportCallback callback ) {
+    autoReportCallback = callback ;
+}
+
+void ReSpeakerDeviceManager::start ( void ) {
+    started = true ;
+    for (size_t i = 0; i < devices.size(); i++) {
+        startDevice(devices[i]) ;
+    }
+}
+
+// Tag the array's reports with its id and start collecting them
+void ReSpeakerDeviceManager::startDevice ( Device &device ) {
+    const int id = device.info.id ;
+    ReSpeakerDeviceReportCallback callback = autoReportCallback ;
+    device.micArray->setAutoReportCallback([id, callback] (const ReSpeakerAutoReport &report) {
+        if (callback) {
+            callback(id, report) ;
+        }
+    }) ;
+    device.micArray->startEventReader() ;
+}
+
+void ReSpeakerDeviceManager::stop ( void ) {
+    started = false ;
+    for (size_t i = 0; i < devices.size(); i++) {
+        devices[i].micArray->stopEventReader() ;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef RESPEAKERDEVICEMANAGER_H
+#define RESPEAKERDEVICEMANAGER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "respeakermicarray.h"
+#include "respeakerlibusbtransport.h"
+
+// Identity of one array found by ReSpeakerDeviceManager
+struct ReSpeakerDeviceInfo
+{
+    int id ;                // Stable for the life of the manager
+    std::string path ;      // hidapi path, "bus:address:interface" with hidapi's libusb backend
+    std::wstring serial ;   // USB serial number, may be empty
+};
+
+// Called with the id of the array which sent the report
+typedef std::function<void (int deviceId, const ReSpeakerAutoReport &)> ReSpeakerDeviceReportCallback ;
+
+// Serves every connected array from one place.
+// Devices are found with hid_enumerate and told apart by path and serial.
+// With the libusb backend all of them share one ReSpeakerUsbContext, whose
+// single event thread completes every array's interrupt transfers. Each
+// array still runs two threads of its own: a command queue thread, asleep
+// until a command is posted, and an event reader, which wakes at least
+// every ReSpeakerMicArray::ReaderTimeoutMs (100 ms) to check the connection
+// and time register flushes, since pushed reports stop silently when an
+// array goes. N arrays cost 2N + 1 threads and, while idle, ten wakeups a
+// second each. With the hidapi backend there is no shared thread: each
+// event reader blocks in hid_read for its array with the same timeout, so
+// N arrays cost 2N threads.
+class ReSpeakerDeviceManager
+{
+public:
+    ReSpeakerDeviceManager ( ReSpeakerMicArray::Backend backend = ReSpeakerMicArray::LibusbBackend,
+                             unsigned short vendorId = 0x2886, unsigned short productId = 0x07 ) ;
+    ~ReSpeakerDeviceManager() ;
+
+    // Open every matching array which is not open yet; returns how many were added
+    int open ( void ) ;
+    // Close every array
+    void close ( void ) ;
+
+    int count ( void ) const ;
+    const ReSpeakerDeviceInfo &info ( int index ) const ;
+    // The array with the given id, 0 if there is none
+    ReSpeakerMicArray *device ( int id ) const ;
+    // Id of the array with the given serial or path, -1 if there is none
+    int findBySerial ( const std::wstring &serial ) const ;
+    int findByPath ( const std::string &path ) const ;
+
+    // Called for every auto report: on the shared USB event thread with the
+    // libusb backend, on the array's own event reader with hidapi. Set it
+    // before start()
+    void setAutoReportCallback ( ReSpeakerDeviceReportCallback callback ) ;
+    // Start and stop collecting reports from every array
+    void start ( void ) ;
+    void stop ( void ) ;
+
+private:
+    struct Device {
+        ReSpeakerDeviceInfo info ;
+        ReSpeakerMicArray *micArray ;
+    };
+
+    void startDevice ( Device &device ) ;
+    ReSpeakerTransport *openTransport ( const char *path, const wchar_t *serial ) ;
+    libusb_device *findUsbDevice ( const char *path, int *interfaceNumber ) ;
+
+    ReSpeakerMicArray::Backend backend ;
+    unsigned short vendorId ;
+    unsigned short productId ;
+    ReSpeakerUsbContext *usbContext ;
+    std::vector<Device> devices ;
+    int nextId ;
+    bool started ;
+    ReSpeakerDeviceReportCallback autoReportCallback ;
+};
+
+#endif // RESPEAKERDEVICEMANAGER_H
@@ -0,0 +1,151 @@
+#include <chrono>
+
+#include "respeakerdirectionhistory.h"
+#include "respeakermicarray.h"
+
+ReSpeakerDirectionHistory::ReSpeakerDirectionHistory ( int capacity )
+    : samples(capacity > 0 ? capacity : 1)
+    , head(0)
+    , used(0)
+{
+}
+
+long long ReSpeakerDirectionHistory::now ( void ) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count() ;
+}
+
+void ReSpeakerDirectionHistory::append ( const ReSpeakerAutoReport &report ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    ReSpeakerDirectionSample &sample = samples[head] ;
+    sample.timestampUs = report.timestampUs ;
+    // Keep the ring sorted even if a caller's clock steps back
+    if (used > 0 && sample.timestampUs < at(used - 1).timestampUs) {
+        sample.timestampUs = at(used - 1).timestampUs ;
+    }
+    sample.angle = report.angle ;
+    sample.vadActivity = report.vadActivity ;
+    head = (head + 1) % samples.size() ;
+    if (used < (int)samples.size()) {
+        used++ ;
+    }
+}
+
+void ReSpeakerDirectionHistory::clear ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    head = 0 ;
+    used = 0 ;
+}
+
+int ReSpeakerDirectionHistory::size ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return used ;
+}
+
+int ReSpeakerDirectionHistory::capacity ( void ) const {
+    return samples.size() ;
+}
+
+bool ReSpeakerDirectionHistory::latest ( ReSpeakerDirectionSample *sample ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    if (used == 0) {
+        return false ;
+    }
+    *sample = at(used - 1) ;
+    return true ;
+}
+
+int ReSpeakerDirectionHistory::count ( long long fromUs, long long toUs ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int first = lowerBound(fromUs) ;
+    int last = lowerBound(toUs) ;
+    return last > first ? last - first : 0 ;
+}
+
+int ReSpeakerDirectionHistory::range ( long long fromUs, long long toUs,
+                                       ReSpeakerDirectionSample *out, int maxSamples ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int first = lowerBound(fromUs) ;
+    int last = lowerBound(toUs) ;
+    int copied = 0 ;
+    for (int i = first; i < last && copied < maxSamples; i++) {
+        out[copied++] = at(i) ;
+    }
+    return copied ;
+}
+
+int ReSpeakerDirectionHistory::dominantAngle ( long long nowUs, int windowMs, int binDegrees, bool voiceOnly ) const {
+    if (binDegrees < 1) {
+        binDegrees = 1 ;
+    }
+    const int numBins = (360 + binDegrees - 1) / binDegrees ;
+    int bins[360] = { 0 } ;
+    int best = -1 ;
+    int bestCount = 0 ;
+
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int first = lowerBound(nowUs - (long long)windowMs * 1000) ;
+    int last = lowerBound(nowUs + 1) ;
+    for (int i = first; i < last; i++) {
+        const ReSpeakerDirectionSample &sample = at(i) ;
+        if (voiceOnly && sample.vadActivity != VoiceDetected) {
+            continue ;
+        }
+        int bin = (sample.angle % 360) / binDegrees ;
+        if (++bins[bin] > bestCount) {
+            bestCount = bins[bin] ;
+            best = bin ;
+        }
+    }
+    if (best < 0 || best >= numBins) {
+        return -1 ;
+    }
+    int centre = best * binDegrees + binDegrees / 2 ;
+    return centre < 360 ? centre : 359 ;
+}
+
+double ReSpeakerDirectionHistory::vadDutyCycle ( long long nowUs, int windowMs ) const {
+    const long long startUs = nowUs - (long long)windowMs * 1000 ;
+    if (windowMs <= 0) {
+        return 0.0 ;
+    }
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int first = lowerBound(startUs) ;
+    int last = lowerBound(nowUs + 1) ;
+    long long voiceUs = 0 ;
+    // The sample before the window decides the state at its start
+    long long segmentStart = startUs ;
+    bool voice = first > 0 && at(first - 1).vadActivity == VoiceDetected ;
+    for (int i = first; i < last; i++) {
+        const ReSpeakerDirectionSample &sample = at(i) ;
+        if (voice) {
+            voiceUs += sample.timestampUs - segmentStart ;
+        }
+        segmentStart = sample.timestampUs ;
+        voice = sample.vadActivity == VoiceDetected ;
+    }
+    if (voice && (first > 0 || last > first)) {
+        voiceUs += nowUs - segmentStart ;
+    }
+    return (double)voiceUs / ((long long)windowMs * 1000) ;
+}
+
+const ReSpeakerDirectionSample &ReSpeakerDirectionHistory::at ( int index ) const {
+    const int size = samples.size() ;
+    const int oldest = used < size ? 0 : head ;
+    return samples[(oldest + index) % size] ;
+}
+
+int ReSpeakerDirectionHistory::lowerBound ( long long timestampUs ) const {
+    int low = 0 ;
+    int high = used ;
+    while (low < high) {
+        int middle = low + (high - low) / 2 ;
+        if (at(middle).timestampUs < timestampUs) {
+            low = middle + 1 ;
+        } else {
+            high = middle ;
+        }
+    }
+    return low ;
+}
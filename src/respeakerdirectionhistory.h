@@ -0,0 +1,65 @@
+#ifndef RESPEAKERDIRECTIONHISTORY_H
+#define RESPEAKERDIRECTIONHISTORY_H
+
+#include <mutex>
+#include <vector>
+
+struct ReSpeakerAutoReport ;
+
+// One auto report as kept by ReSpeakerDirectionHistory
+struct ReSpeakerDirectionSample
+{
+    long long timestampUs ;     // Monotonic, see ReSpeakerDirectionHistory::now()
+    unsigned short angle ;
+    unsigned char vadActivity ;
+};
+
+// Fixed size ring of recent direction of arrival / voice activity samples.
+// The HID path appends; any thread may query. Samples are ordered by time,
+// so time ranges are found by binary search in O(log n). Memory is
+// allocated once, in the constructor.
+class ReSpeakerDirectionHistory
+{
+public:
+    // vadActivity value for detected voice
+    static const unsigned char VoiceDetected = 2 ;
+    static const int DefaultCapacity = 4096 ;
+
+    explicit ReSpeakerDirectionHistory ( int capacity = DefaultCapacity ) ;
+
+    // The clock the samples are stamped with, in microseconds
+    static long long now ( void ) ;
+
+    // Oldest samples are overwritten once the ring is full
+    void append ( const ReSpeakerAutoReport &report ) ;
+    void clear ( void ) ;
+    int size ( void ) const ;
+    int capacity ( void ) const ;
+
+    bool latest ( ReSpeakerDirectionSample *sample ) const ;
+    // Number of samples with fromUs <= timestamp < toUs
+    int count ( long long fromUs, long long toUs ) const ;
+    // Copy up to maxSamples of them, oldest first; returns the number copied
+    int range ( long long fromUs, long long toUs, ReSpeakerDirectionSample *samples, int maxSamples ) const ;
+
+    // Most frequent angle over the last windowMs before nowUs, as the centre
+    // of a binDegrees wide bin; -1 if there are no samples. With voiceOnly
+    // only samples with detected voice count
+    int dominantAngle ( long long nowUs, int windowMs, int binDegrees = 10, bool voiceOnly = true ) const ;
+    // Fraction of the last windowMs during which voice was detected. Each
+    // sample's state holds until the next one
+    double vadDutyCycle ( long long nowUs, int windowMs ) const ;
+
+private:
+    // Logical index 0 is the oldest sample
+    const ReSpeakerDirectionSample &at ( int index ) const ;
+    // Logical index of the first sample at or after timestampUs
+    int lowerBound ( long long timestampUs ) const ;
+
+    std::vector<ReSpeakerDirectionSample> samples ;
+    int head ;      // Where the next sample goes
+    int used ;
+    mutable std::mutex mutex ;
+};
+
+#endif // RESPEAKERDIRECTIONHISTORY_H
@@ -0,0 +1,238 @@
+#include <string.h>
+
+#include "respeakeremulatortransport.h"
+
+ReSpeakerEmulatorTransport::ReSpeakerEmulatorTransport()
+    : open(true)
+    , closed(false)
+    , ledWritten(false)
+    , responseLatencyUs(0)
+    , scriptStep(0)
+    , stepRepeat(0)
+    , reportIntervalUs(DefaultReportIntervalUs)
+    , reportJitterUs(0)
+    , writes(0)
+    , readRequests(0)
+    , reportsSent(0)
+{
+    memset(registerFile, 0, sizeof(registerFile)) ;
+    memset(led, 0, sizeof(led)) ;
+}
+
+ReSpeakerEmulatorTransport::~ReSpeakerEmulatorTransport()
+{
+    close() ;
+}
+
+bool ReSpeakerEmulatorTransport::isOpen ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return open ;
+}
+
+void ReSpeakerEmulatorTransport::close ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        open = false ;
+        closed = true ;
+    }
+    reportReady.notify_all() ;
+}
+
+void ReSpeakerEmulatorTransport::unplug ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        open = false ;
+    }
+    reportReady.notify_all() ;
+}
+
+bool ReSpeakerEmulatorTransport::reopen ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    open = true ;
+    closed = false ;
+    responses.clear() ;
+    return true ;
+}
+
+bool ReSpeakerEmulatorTransport::wasClosed ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return closed ;
+}
+
+// Frames are {report id, reg, flags, len, 0, data...}, as the array expects
+int ReSpeakerEmulatorTransport::write ( const unsigned char *data, int length ) {
+    if (length < 5) {
+        return -1 ;
+    }
+    const unsigned char reg = data[1] ;
+    const unsigned char flags = data[2] ;
+    const unsigned char len = data[3] < RegisterSize ? data[3] : RegisterSize ;
+
+    std::unique_lock<std::mutex> lock(mutex) ;
+    if (!open) {
+        return -1 ;
+    }
+    writes++ ;
+    if (flags & 0x80) {
+        // Read request: answer {reg, 0, 0x80, len, data...}
+        Report response ;
+        memset(response.data, 0, sizeof(response.data)) ;
+        response.data[0] = reg ;
+        response.data[2] = 0x80 ;
+        response.data[3] = len ;
+        memcpy(response.data + 4, registerFile[reg], len) ;
+        response.length = 4 + len ;
+        response.readyAt = Clock::now() + std::chrono::microseconds(responseLatencyUs) ;
+        responses.push_back(response) ;
+        readRequests++ ;
+        lock.unlock() ;
+        reportReady.notify_all() ;
+        return length ;
+    }
+    int available = length - 5 ;
+    int count = len < available ? len : available ;
+    memcpy(registerFile[reg], data + 5, count) ;
+    // Register 0 is the LED ring: mode and three data bytes
+    if (reg == 0 && count >= 4) {
+        memcpy(led, data + 5, 4) ;
+        ledWritten = true ;
+    }
+    return length ;
+}
+
+int ReSpeakerEmulatorTransport::read ( unsigned char *data, int length, int timeoutMs ) {
+    const bool blocking = timeoutMs < 0 ;
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(blocking ? 0 : timeoutMs) ;
+
+    std::unique_lock<std::mutex> lock(mutex) ;
+    for (;;) {
+        if (!open) {
+            return -1 ;
+        }
+        const Clock::time_point now = Clock::now() ;
+        Report report ;
+        bool ready = false ;
+        // Responses go first, as the array answers before its next report
+        if (!responses.empty() && responses.front().readyAt <= now) {
+            report = responses.front() ;
+            responses.pop_front() ;
+            ready = true ;
+        } else if (!script.empty() && nextReportAt <= now) {
+            nextAutoReport(&report) ;
+            ready = true ;
+        }
+        if (ready) {
+            int count = report.length < length ? report.length : length ;
+            memcpy(data, report.data, count) ;
+            return count ;
+        }
+        if (!blocking && now >= deadline) {
+            return 0 ;
+        }
+
+        Clock::time_point wake = blocking ? Clock::time_point::max() : deadline ;
+        if (!responses.empty() && responses.front().readyAt < wake) {
+            wake = responses.front().readyAt ;
+        }
+        if (!script.empty() && nextReportAt < wake) {
+            wake = nextReportAt ;
+        }
+        if (wake == Clock::time_point::max()) {
+            reportReady.wait(lock) ;
+        } else {
+            reportReady.wait_until(lock, wake) ;
+        }
+    }
+}
+
+void ReSpeakerEmulatorTransport::setAutoReportScript ( const std::vector<ReSpeakerEmulatedReport> &steps,
+                                                       int intervalUs, int jitterUs, unsigned int seed ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        script = steps ;
+        scriptStep = 0 ;
+        stepRepeat = 0 ;
+        reportIntervalUs = intervalUs > 0 ? intervalUs : 0 ;
+        reportJitterUs = jitterUs > 0 ? jitterUs : 0 ;
+        if (reportJitterUs > reportIntervalUs) {
+            reportJitterUs = reportIntervalUs ;
+        }
+        random.seed(seed) ;
+        scheduleAutoReport(Clock::now()) ;
+    }
+    reportReady.notify_all() ;
+}
+
+void ReSpeakerEmulatorTransport::setResponseLatencyUs ( int latencyUs ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    responseLatencyUs = latencyUs > 0 ? latencyUs : 0 ;
+}
+
+void ReSpeakerEmulatorTransport::setRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    memcpy(registerFile[reg], data, len < RegisterSize ? len : RegisterSize) ;
+}
+
+void ReSpeakerEmulatorTransport::getRegister ( unsigned char reg, unsigned char *data, unsigned char len ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    memcpy(data, registerFile[reg], len < RegisterSize ? len : RegisterSize) ;
+}
+
+bool ReSpeakerEmulatorTransport::ledFrame ( unsigned char *mode, unsigned char *data1,
+                                            unsigned char *data2, unsigned char *data3 ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    *mode = led[0] ;
+    *data1 = led[1] ;
+    *data2 = led[2] ;
+    *data3 = led[3] ;
+    return ledWritten ;
+}
+
+unsigned long long ReSpeakerEmulatorTransport::writesReceived ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return writes ;
+}
+
+unsigned long long ReSpeakerEmulatorTransport::readRequestsReceived ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return readRequests ;
+}
+
+unsigned long long ReSpeakerEmulatorTransport::autoReportsSent ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return reportsSent ;
+}
+
+// Called with mutex held once the next report is due
+void ReSpeakerEmulatorTransport::nextAutoReport ( Report *report ) {
+    const ReSpeakerEmulatedReport &step = script[scriptStep] ;
+    memset(report->data, 0, sizeof(report->data)) ;
+    report->data[0] = 0xFF ;
+    report->data[4] = step.vadActivity ;
+    report->data[5] = step.angle & 0xFF ;
+    report->data[6] = step.angle >> 8 ;
+    report->length = 9 ;
+    registerFile[VoiceAngleRegister][0] = step.angle & 0xFF ;
+    registerFile[VoiceAngleRegister][1] = step.angle >> 8 ;
+    reportsSent++ ;
+
+    if (++stepRepeat >= step.repeat) {
+        stepRepeat = 0 ;
+        scriptStep = (scriptStep + 1) % script.size() ;
+    }
+    scheduleAutoReport(nextReportAt) ;
+}
+
+void ReSpeakerEmulatorTransport::scheduleAutoReport ( Clock::time_point after ) {
+    int delayUs = reportIntervalUs ;
+    if (reportJitterUs > 0) {
+        std::uniform_int_distribution<int> jitter(-reportJitterUs, reportJitterUs) ;
+        delayUs += jitter(random) ;
+    }
+    nextReportAt = after + std::chrono::microseconds(delayUs) ;
+    // A reader that fell behind gets the next report when it asks, not a burst
+    const Clock::time_point now = Clock::now() ;
+    if (nextReportAt < now && reportIntervalUs > 0) {
+        nextReportAt = now ;
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef RESPEAKEREMULATORTRANSPORT_H
+#define RESPEAKEREMULATORTRANSPORT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "respeakertransport.h"
+
+// One step of an emulated auto report script
+struct ReSpeakerEmulatedReport
+{
+    unsigned short angle ;
+    unsigned char vadActivity ;
+    int repeat ;                // Reports sent with these values before the next step
+};
+
+// An in-process stand-in for the array, for running the host stack without
+// USB. Register writes land in a register file which 0x80 read requests
+// answer from, LED frames are remembered, and auto reports follow a script
+// that loops, with the report interval jittered by a seeded generator so a
+// run is repeatable. Reports are produced as read() asks for them.
+class ReSpeakerEmulatorTransport : public ReSpeakerTransport
+{
+public:
+    ReSpeakerEmulatorTransport() ;
+    ~ReSpeakerEmulatorTransport() ;
+
+    bool isOpen ( void ) const ;
+    int write ( const unsigned char *data, int length ) ;
+    int read ( unsigned char *data, int length, int timeoutMs ) ;
+    // Fail every further call and wake blocked readers. The array stays
+    // closed until reopen() is called
+    void close ( void ) ;
+    // Like close(), but as if the array dropped off the bus, so a mic
+    // array's reconnect plugs it back in
+    void unplug ( void ) ;
+    // Plug the array back in; the register file survives
+    bool reopen ( void ) ;
+    bool wasClosed ( void ) const ;
+
+    // Auto reports, one per intervalUs +- jitterUs. An intervalUs of 0 has a
+    // report ready whenever read() finds nothing else to return. An empty
+    // script stops the reports
+    void setAutoReportScript ( const std::vector<ReSpeakerEmulatedReport> &script,
+                               int intervalUs = DefaultReportIntervalUs,
+                               int jitterUs = 0, unsigned int seed = 1 ) ;
+    // Delay between a read request and its response becoming readable
+    void setResponseLatencyUs ( int latencyUs ) ;
+
+    // Register file, as the host last wrote it
+    void setRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    void getRegister ( unsigned char reg, unsigned char *data, unsigned char len ) const ;
+    // The last LED frame written; returns false if none was
+    bool ledFrame ( unsigned char *mode, unsigned char *data1, unsigned char *data2, unsigned char *data3 ) const ;
+
+    unsigned long long writesReceived ( void ) const ;
+    unsigned long long readRequestsReceived ( void ) const ;
+    unsigned long long autoReportsSent ( void ) const ;
+
+    // About what the array itself sends
+    static const int DefaultReportIntervalUs = 5000 ;
+    static const int MaxReportLength = 64 ;
+    static const int RegisterSize = 57 ;
+    // The voice angle register follows the scripted angle
+    static const unsigned char VoiceAngleRegister = 0x44 ;
+
+private:
+    typedef std::chrono::steady_clock Clock ;
+
+    struct Report {
+        unsigned char data[MaxReportLength] ;
+        int length ;
+        Clock::time_point readyAt ;
+    };
+
+    void nextAutoReport ( Report *report ) ;
+    void scheduleAutoReport ( Clock::time_point after ) ;
+
+    mutable std::mutex mutex ;
+    std::condition_variable reportReady ;
+    bool open ;
+    bool closed ;
+
+    unsigned char registerFile[256][RegisterSize] ;
+    unsigned char led[4] ;
+    bool ledWritten ;
+
+    std::deque<Report> responses ;
+    int responseLatencyUs ;
+
+    std::vector<ReSpeakerEmulatedReport> script ;
+    size_t scriptStep ;
+    int stepRepeat ;
+    int reportIntervalUs ;
+    int reportJitterUs ;
+    std::mt19937 random ;
+    Clock::time_point nextReportAt ;
+
+    unsigned long long writes ;
+    unsigned long long readRequests ;
+    unsigned long long reportsSent ;
+};
+
+#endif // RESPEAKEREMULATORTRANSPORT_H
@@ -0,0 +1,168 @@
+#include "respeakerledscheduler.h"
+#include "respeakermicarray.h"
+#include "respeakertrace.h"
+
+static const unsigned long long PendingValid = 1ULL << 32 ;
+
+static unsigned long long packFrame ( const ReSpeakerLedFrame &frame ) {
+    return PendingValid | ((unsigned long long)frame.mode << 24) | (frame.data1 << 16)
+            | (frame.data2 << 8) | frame.data3 ;
+}
+
+static ReSpeakerLedFrame unpackFrame ( unsigned long long packed ) {
+    ReSpeakerLedFrame frame ;
+    frame.mode = (packed >> 24) & 0xFF ;
+    frame.data1 = (packed >> 16) & 0xFF ;
+    frame.data2 = (packed >> 8) & 0xFF ;
+    frame.data3 = packed & 0xFF ;
+    return frame ;
+}
+
+static bool sameFrame ( const ReSpeakerLedFrame &a, const ReSpeakerLedFrame &b ) {
+    return a.mode == b.mode && a.data1 == b.data1 && a.data2 == b.data2 && a.data3 == b.data3 ;
+}
+
+ReSpeakerLedScheduler::ReSpeakerLedScheduler ( ReSpeakerMicArray *micArray, int tickMs )
+    : micArray(micArray)
+    , tickMs(tickMs)
+    , pending(0)
+    , animating(false)
+    , lastFrameValid(false)
+    , sent(0)
+    , running(true)
+{
+    thread = std::thread(&ReSpeakerLedScheduler::run, this) ;
+}
+
+ReSpeakerLedScheduler::~ReSpeakerLedScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        running = false ;
+    }
+    wakeUp.notify_all() ;
+    thread.join() ;
+}
+
+void ReSpeakerLedScheduler::setTickMs ( int ms ) {
+    tickMs = ms ;
+}
+
+void ReSpeakerLedScheduler::setLEDMode ( unsigned char mode, unsigned char data1, unsigned char data2, unsigned char data3 ) {
+    if (animating) {
+        stopAnimation() ;
+    }
+    ReSpeakerLedFrame frame = { mode, data1, data2, data3 } ;
+    pending = packFrame(frame) ;
+    wake() ;
+}
+
+// The helpers mirror ReSpeakerMicArray's LED calls
+
+void ReSpeakerLedScheduler::setLEDAllOff ( void ) {
+    setLEDMode(0,0,0,0) ;
+}
+
+void ReSpeakerLedScheduler::setLEDAllRGB ( unsigned char redColor, unsigned char greenColor, unsigned char blueColor ) {
+    setLEDMode(1,blueColor,greenColor,redColor) ;
+}
+
+void ReSpeakerLedScheduler::setLEDListening ( unsigned char directionL, unsigned char directionH ) {
+    setLEDMode(2,0,directionL,directionH) ;
+}
+
+void ReSpeakerLedScheduler::setLEDWaiting ( void ) {
+    setLEDMode(3,0,0,0) ;
+}
+
+void ReSpeakerLedScheduler::setLEDSpeaking ( unsigned char strength, unsigned char directionL, unsigned char directionH ) {
+    setLEDMode(4,strength,directionL,directionH) ;
+}
+
+void ReSpeakerLedScheduler::setLEDVolume ( unsigned char volume ) {
+    setLEDMode(5,0,0,volume) ;
+}
+
+void ReSpeakerLedScheduler::setLEDData ( void ) {
+    setLEDMode(6,0,0,0) ;
+}
+
+void ReSpeakerLedScheduler::setLEDAutoVoiceLocated ( void ) {
+    setLEDMode(7,0,0,0) ;
+}
+
+void ReSpeakerLedScheduler::setAnimation ( ReSpeakerLedAnimation newAnimation ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        animation = newAnimation ;
+        animationStart = std::chrono::steady_clock::now() ;
+        animating = (bool)animation ;
+        pending = 0 ;
+    }
+    wakeUp.notify_one() ;
+}
+
+void ReSpeakerLedScheduler::stopAnimation ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    animation = ReSpeakerLedAnimation() ;
+    animating = false ;
+}
+
+unsigned int ReSpeakerLedScheduler::framesSent ( void ) const {
+    return sent.load() ;
+}
+
+// Passing through the lock guarantees the scheduler is either about to look
+// at pending or already waiting, so the notification cannot be lost
+void ReSpeakerLedScheduler::wake ( void ) {
+    { std::lock_guard<std::mutex> lock(mutex) ; }
+    wakeUp.notify_one() ;
+}
+
+void ReSpeakerLedScheduler::run ( void ) {
+    std::chrono::steady_clock::time_point nextAllowed = std::chrono::steady_clock::now() ;
+    std::unique_lock<std::mutex> lock(mutex) ;
+    while (running) {
+        wakeUp.wait(lock, [this] { return !running || pending.load() != 0 || animating.load() ; }) ;
+        if (!running) {
+            break ;
+        }
+        // Rate limit; anything set meanwhile just replaces the pending frame
+        if (std::chrono::steady_clock::now() < nextAllowed) {
+            wakeUp.wait_until(lock, nextAllowed, [this] { return !running ; }) ;
+            continue ;
+        }
+
+        ReSpeakerLedFrame frame ;
+        bool haveFrame = false ;
+        if (animating) {
+            long long elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - animationStart).count() ;
+            if (!animation(elapsedMs, &frame)) {
+                animation = ReSpeakerLedAnimation() ;
+                animating = false ;
+            }
+            haveFrame = true ;
+        } else {
+            unsigned long long packed = pending.exchange(0) ;
+            if (packed) {
+                frame = unpackFrame(packed) ;
+                haveFrame = true ;
+            }
+        }
+        nextAllowed = std::chrono::steady_clock::now() + std::chrono::milliseconds(tickMs.load()) ;
+
+        if (haveFrame && !(lastFrameValid && sameFrame(frame, lastFrame))) {
+            lock.unlock() ;
+            // Through the array's command queue, behind any register traffic.
+            // Waiting keeps at most one of our frames queued there
+            micArray->commands()->setLEDMode(frame.mode, frame.data1, frame.data2, frame.data3).wait() ;
+            RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::LedFrame, frame.mode,
+                                  (frame.data1 << 16) | (frame.data2 << 8) | frame.data3) ;
+            sent++ ;
+            lock.lock() ;
+            lastFrame = frame ;
+            lastFrameValid = true ;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef RESPEAKERLEDSCHEDULER_H
+#define RESPEAKERLEDSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class ReSpeakerMicArray ;
+
+// One setLEDMode frame
+struct ReSpeakerLedFrame
+{
+    unsigned char mode ;
+    unsigned char data1 ;
+    unsigned char data2 ;
+    unsigned char data3 ;
+};
+
+// Host driven animation, called on the scheduler thread once per tick with
+// the time since it was set. Fill in frame and return false once it is done
+typedef std::function<bool (long long elapsedMs, ReSpeakerLedFrame *frame)> ReSpeakerLedAnimation ;
+
+// Sends LED frames to the array at a bounded rate.
+// Any thread may set the desired LED state; only the latest state is kept
+// and at most one setLEDMode frame goes out per tick, so the USB traffic
+// from LEDs stays the same however fast callers change their minds.
+// Frames identical to the last one sent are skipped. The thread sleeps
+// while there is nothing to send. Frames go out through the array's command
+// queue in its LED lane, so they never hold up register reads.
+class ReSpeakerLedScheduler
+{
+public:
+    explicit ReSpeakerLedScheduler ( ReSpeakerMicArray *micArray, int tickMs = DefaultTickMs ) ;
+    ~ReSpeakerLedScheduler() ;
+
+    void setTickMs ( int ms ) ;
+
+    // Replace the pending state; stops any animation
+    void setLEDMode ( unsigned char mode, unsigned char data1, unsigned char data2, unsigned char data3 ) ;
+    void setLEDAllOff ( void ) ;
+    void setLEDAllRGB ( unsigned char redColor, unsigned char greenColor, unsigned char blueColor ) ;
+    void setLEDListening ( unsigned char directionL, unsigned char directionH ) ;
+    void setLEDWaiting ( void ) ;
+    void setLEDSpeaking ( unsigned char strength, unsigned char directionL, unsigned char directionH ) ;
+    void setLEDVolume ( unsigned char volume ) ;
+    void setLEDData ( void ) ;
+    void setLEDAutoVoiceLocated ( void ) ;
+
+    // Run animation on the scheduler thread, one frame per tick
+    void setAnimation ( ReSpeakerLedAnimation animation ) ;
+    void stopAnimation ( void ) ;
+
+    // Frames actually written to the array
+    unsigned int framesSent ( void ) const ;
+
+    static const int DefaultTickMs = 50 ;
+
+private:
+    void run ( void ) ;
+    void wake ( void ) ;
+
+    ReSpeakerMicArray *micArray ;
+    std::atomic<int> tickMs ;
+
+    // Latest requested frame packed into the low 32 bits; bit 32 marks it valid
+    std::atomic<unsigned long long> pending ;
+    std::atomic<bool> animating ;
+    ReSpeakerLedAnimation animation ;
+    std::chrono::steady_clock::time_point animationStart ;
+
+    ReSpeakerLedFrame lastFrame ;
+    bool lastFrameValid ;
+    std::atomic<unsigned int> sent ;
+
+    std::mutex mutex ;
+    std::condition_variable wakeUp ;
+    bool running ;
+    std::thread thread ;
+};
+
+#endif // RESPEAKERLEDSCHEDULER_H
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "respeakerlibusbtransport.h"
+
+// HID class request
+static const unsigned char HidSetReport = 0x09 ;
+static const unsigned short HidOutputReport = 0x02 ;
+
+//
+// ReSpeakerUsbContext
+//
+
+ReSpeakerUsbContext::ReSpeakerUsbContext()
+    : usbContext(0)
+    , running(false)
+{
+    if (libusb_init(&usbContext) < 0) {
+        usbContext = 0 ;
+        return ;
+    }
+    running = true ;
+    eventThread = std::thread(&ReSpeakerUsbContext::eventLoop, this) ;
+}
+
+ReSpeakerUsbContext::~ReSpeakerUsbContext()
+{
+    running = false ;
+    if (eventThread.joinable()) {
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000105)
+        libusb_interrupt_event_handler(usbContext) ;
+#endif
+        eventThread.join() ;
+    }
+    if (usbContext) {
+        libusb_exit(usbContext) ;
+    }
+}
+
+bool ReSpeakerUsbContext::isValid ( void ) const {
+    return usbContext != 0 ;
+}
+
+libusb_context *ReSpeakerUsbContext::context ( void ) const {
+    return usbContext ;
+}
+
+void ReSpeakerUsbContext::eventLoop ( void ) {
+    while (running) {
+        struct timeval timeout = { 0, EventTimeoutMs * 1000 } ;
+        libusb_handle_events_timeout_completed(usbContext, &timeout, NULL) ;
+    }
+}
+
+//
+// ReSpeakerLibusbTransport
+//
+
+ReSpeakerLibusbTransport::ReSpeakerLibusbTransport ( unsigned short vendorId, unsigned short productId )
+    : usbContext(new ReSpeakerUsbContext)
+    , ownsContext(true)
+    , device(0)
+    , vendorId(vendorId)
+    , productId(productId)
+    , busNumber(0)
+    , portDepth(0)
+    , wantedInterface(-1)
+    , interfaceNumber(-1)
+    , inEndpoint(0)
+    , outEndpoint(0)
+    , inPacketSize(MaxReportLength)
+    , kernelDriverDetached(false)
+    , inTransfersActive(0)
+    , deviceLost(false)
+    , running(false)
+    , hotplugHandle(0)
+    , hotplugRegistered(false)
+{
+    memset(inTransfers, 0, sizeof(inTransfers)) ;
+    if (!open()) {
+        closeDevice() ;
+    }
+}
+
+ReSpeakerLibusbTransport::ReSpeakerLibusbTransport ( ReSpeakerUsbContext *context, libusb_device *usbDevice, int hidInterface )
+    : usbContext(context)
+    , ownsContext(false)
+    , device(0)
+    , vendorId(0)
+    , productId(0)
+    , busNumber(0)
+    , portDepth(0)
+    , wantedInterface(hidInterface)
+    , interfaceNumber(-1)
+    , inEndpoint(0)
+    , outEndpoint(0)
+    , inPacketSize(MaxReportLength)
+    , kernelDriverDetached(false)
+    , inTransfersActive(0)
+    , deviceLost(false)
+    , running(false)
+    , hotplugHandle(0)
+    , hotplugRegistered(false)
+{
+    memset(inTransfers, 0, sizeof(inTransfers)) ;
+    struct libusb_device_descriptor descriptor ;
+    if (libusb_get_device_descriptor(usbDevice, &descriptor) == 0) {
+        vendorId = descriptor.idVendor ;
+        productId = descriptor.idProduct ;
+    }
+    if (!openDevice(usbDevice)) {
+        closeDevice() ;
+    }
+}
+
+ReSpeakerLibusbTransport::~ReSpeakerLibusbTransport()
+{
+    close() ;
+}
+
+bool ReSpeakerLibusbTransport::isOpen ( void ) const {
+    return device != 0 && !deviceLost ;
+}
+
+// Opens the first device with our ids or, once we know where the array
+// lives, the one on the same port
+bool ReSpeakerLibusbTransport::open ( void ) {
+    if (usbContext == 0 || !usbContext->isValid()) {
+        return false ;
+    }
+    libusb_device **list ;
+    ssize_t count = libusb_get_device_list(usbContext->context(), &list) ;
+    bool opened = false ;
+    for (ssize_t i = 0; i < count; i++) {
+        struct libusb_device_descriptor descriptor ;
+        if (libusb_get_device_descriptor(list[i], &descriptor) < 0) {
+            continue ;
+        }
+        if (descriptor.idVendor != vendorId || descriptor.idProduct != productId) {
+            continue ;
+        }
+        if (portDepth > 0) {
+            unsigned char ports[MaxPortDepth] ;
+            int depth = libusb_get_port_numbers(list[i], ports, MaxPortDepth) ;
+            if (libusb_get_bus_number(list[i]) != busNumber || depth != portDepth ||
+                memcmp(ports, portNumbers, depth) != 0) {
+                continue ;
+            }
+        }
+        opened = openDevice(list[i]) ;
+        break ;
+    }
+    if (count >= 0) {
+        libusb_free_device_list(list, 1) ;
+    }
+    return opened ;
+}
+
+bool ReSpeakerLibusbTransport::openDevice ( libusb_device *usbDevice ) {
+    if (!usbContext->isValid() || !findEndpoints(usbDevice)) {
+        return false ;
+    }
+    if (portDepth == 0) {
+        int depth = libusb_get_port_numbers(usbDevice, portNumbers, MaxPortDepth) ;
+        if (depth > 0) {
+            busNumber = libusb_get_bus_number(usbDevice) ;
+            portDepth = depth ;
+        }
+    }
+    if (libusb_open(usbDevice, &device) < 0) {
+        device = 0 ;
+        return false ;
+    }
+
+    // usbhid normally owns the interface
+    if (libusb_kernel_driver_active(device, interfaceNumber) == 1) {
+        if (libusb_detach_kernel_driver(device, interfaceNumber) < 0) {
+            libusb_close(device) ;
+            device = 0 ;
+            return false ;
+        }
+        kernelDriverDetached = true ;
+    }
+    if (libusb_claim_interface(device, interfaceNumber) < 0) {
+        if (kernelDriverDetached) {
+            libusb_attach_kernel_driver(device, interfaceNumber) ;
+            kernelDriverDetached = false ;
+        }
+        libusb_close(device) ;
+        device = 0 ;
+        return false ;
+    }
+
+    running = true ;
+    return submitInTransfers() ;
+}
+
+// Locate the HID interface and its interrupt endpoints
+bool ReSpeakerLibusbTransport::findEndpoints ( libusb_device *usbDevice ) {
+    struct libusb_config_descriptor *config ;
+    if (libusb_get_active_config_descriptor(usbDevice, &config) < 0) {
+        return false ;
+    }
+    bool found = false ;
+    for (int i = 0; i < config->bNumInterfaces && !found; i++) {
+        const struct libusb_interface &interface = config->interface[i] ;
+        if (interface.num_altsetting < 1) {
+            continue ;
+        }
+        const struct libusb_interface_descriptor &altsetting = interface.altsetting[0] ;
+        if (altsetting.bInterfaceClass != LIBUSB_CLASS_HID ||
+            (wantedInterface >= 0 && altsetting.bInterfaceNumber != wantedInterface)) {
+            continue ;
+        }
+        inEndpoint = 0 ;
+        outEndpoint = 0 ;
+        for (int e = 0; e < altsetting.bNumEndpoints; e++) {
+            const struct libusb_endpoint_descriptor &endpoint = altsetting.endpoint[e] ;
+            if ((endpoint.bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_INTERRUPT) {
+                continue ;
+            }
+            if ((endpoint.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN) {
+                inEndpoint = endpoint.bEndpointAddress ;
+                inPacketSize = endpoint.wMaxPacketSize < MaxReportLength ? endpoint.wMaxPacketSize : MaxReportLength ;
+            } else {
+                outEndpoint = endpoint.bEndpointAddress ;
+            }
+        }
+        if (inEndpoint) {
+            interfaceNumber = altsetting.bInterfaceNumber ;
+            found = true ;
+        }
+    }
+    libusb_free_config_descriptor(config) ;
+    return found ;
+}
+
+bool ReSpeakerLibusbTransport::submitInTransfers ( void ) {
+    // A transfer may complete before the count is raised otherwise
+    std::lock_guard<std::mutex> lock(transferMutex) ;
+    for (int i = 0; i < NumInTransfers; i++) {
+        inTransfers[i] = libusb_alloc_transfer(0) ;
+        if (inTransfers[i] == 0) {
+            return false ;
+        }
+        libusb_fill_interrupt_transfer(inTransfers[i], device, inEndpoint,
+                                       inBuffers[i], inPacketSize,
+                                       &ReSpeakerLibusbTransport::inTransferComplete, this, 0) ;
+        if (libusb_submit_transfer(inTransfers[i]) < 0) {
+            return false ;
+        }
+        inTransfersActive++ ;
+    }
+    return true ;
+}
+
+void ReSpeakerLibusbTransport::close ( void ) {
+    setHotplugHandler(ReSpeakerHotplugHandler()) ;
+    closeDevice() ;
+    if (ownsContext) {
+        delete usbContext ;
+        usbContext = 0 ;
+        ownsContext = false ;
+    }
+}
+
+bool ReSpeakerLibusbTransport::reopen ( void ) {
+    closeDevice() ;
+    deviceLost = false ;
+    if (!open()) {
+        closeDevice() ;
+        return false ;
+    }
+    return true ;
+}
+
+void ReSpeakerLibusbTransport::closeDevice ( void ) {
+    {
+        // Cancelled transfers complete on the context's event thread, which
+        // runs for as long as the context does; a transfer is only freed once
+        // its callback has seen running cleared and let it go
+        std::unique_lock<std::mutex> lock(transferMutex) ;
+        running = false ;
+        for (int i = 0; i < NumInTransfers; i++) {
+            if (inTransfers[i]) {
+                libusb_cancel_transfer(inTransfers[i]) ;
+            }
+        }
+        while (inTransfersActive > 0) {
+            transfersRetired.wait(lock) ;
+        }
+    }
+    for (int i = 0; i < NumInTransfers; i++) {
+        if (inTransfers[i]) {
+            libusb_free_transfer(inTransfers[i]) ;
+            inTransfers[i] = 0 ;
+        }
+    }
+    if (device) {
+        if (interfaceNumber >= 0) {
+            libusb_release_interface(device, interfaceNumber) ;
+            if (kernelDriverDetached) {
+                libusb_attach_kernel_driver(device, interfaceNumber) ;
+                kernelDriverDetached = false ;
+            }
+        }
+        libusb_close(device) ;
+        device = 0 ;
+    }
+}
+
+bool ReSpeakerLibusbTransport::setHotplugHandler ( ReSpeakerHotplugHandler handler ) {
+    if (hotplugRegistered) {
+        // libusb calls back under its hotplug lock, so none runs once this returns
+        libusb_hotplug_deregister_callback(usbContext->context(), hotplugHandle) ;
+        hotplugRegistered = false ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(hotplugMutex) ;
+        hotplugHandler = handler ;
+    }
+    if (!handler) {
+        return true ;
+    }
+    if (usbContext == 0 || !usbContext->isValid() || !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        return false ;
+    }
+    int res = libusb_hotplug_register_callback(usbContext->context(),
+                                               (libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                                                      LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+                                               LIBUSB_HOTPLUG_NO_FLAGS, vendorId, productId,
+                                               LIBUSB_HOTPLUG_MATCH_ANY,
+                                               &ReSpeakerLibusbTransport::hotplugEvent, this, &hotplugHandle) ;
+    hotplugRegistered = res == 0 ;
+    return hotplugRegistered ;
+}
+
+// Runs on the event thread, where libusb must not be asked to open devices;
+// the handler only passes the news on
+int LIBUSB_CALL ReSpeakerLibusbTransport::hotplugEvent ( libusb_context *context, libusb_device *usbDevice,
+                                                         libusb_hotplug_event event, void *userData ) {
+    (void)context ;
+    (void)usbDevice ;
+    ReSpeakerLibusbTransport *self = static_cast<ReSpeakerLibusbTransport *>(userData) ;
+    std::lock_guard<std::mutex> lock(self->hotplugMutex) ;
+    if (self->hotplugHandler) {
+        self->hotplugHandler(event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) ;
+    }
+    // Stay registered
+    return 0 ;
+}
+
+// Runs on the event thread
+void LIBUSB_CALL ReSpeakerLibusbTransport::inTransferComplete ( libusb_transfer *transfer ) {
+    ReSpeakerLibusbTransport *self = static_cast<ReSpeakerLibusbTransport *>(transfer->user_data) ;
+    bool resubmit = true ;
+    switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+        self->reportReceived(transfer->buffer, transfer->actual_length) ;
+        break ;
+    case LIBUSB_TRANSFER_CANCELLED:
+        resubmit = false ;
+        break ;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+        self->deviceLost = true ;
+        resubmit = false ;
+        break ;
+    default:
+        // Errors and stalls; try again with the same buffer
+        break ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(self->transferMutex) ;
+        if (resubmit && self->running && libusb_submit_transfer(transfer) == 0) {
+            return ;
+        }
+        self->inTransfersActive-- ;
+        self->transfersRetired.notify_all() ;
+    }
+    if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+        self->reportReady.notify_all() ;
+    }
+}
+
+void ReSpeakerLibusbTransport::reportReceived ( const unsigned char *data, int length ) {
+    if (length <= 0) {
+        return ;
+    }
+    std::unique_lock<std::mutex> lock(reportMutex) ;
+    if (handler) {
+        handler(data, length) ;
+        return ;
+    }
+    if ((int)reports.size() >= MaxQueuedReports) {
+        reports.pop_front() ;
+    }
+    Report report ;
+    report.length = length < MaxReportLength ? length : MaxReportLength ;
+    memcpy(report.data, data, report.length) ;
+    reports.push_back(report) ;
+    lock.unlock() ;
+    reportReady.notify_one() ;
+}
+
+bool ReSpeakerLibusbTransport::setReportHandler ( ReSpeakerReportHandler reportHandler ) {
+    // Holding the lock means no callback is running once this returns
+    std::lock_guard<std::mutex> lock(reportMutex) ;
+    handler = reportHandler ;
+    reports.clear() ;
+    return true ;
+}
+
+int ReSpeakerLibusbTransport::read ( unsigned char *data, int length, int timeoutMs ) {
+    std::unique_lock<std::mutex> lock(reportMutex) ;
+    if (!isOpen() && reports.empty()) {
+        return -1 ;
+    }
+    if (timeoutMs < 0) {
+        reportReady.wait(lock, [this] { return !reports.empty() || deviceLost; }) ;
+    } else if (!reportReady.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                     [this] { return !reports.empty() || deviceLost; })) {
+        return 0 ;
+    }
+    if (reports.empty()) {
+        return -1 ;
+    }
+    const Report &report = reports.front() ;
+    int copyLength = report.length < length ? report.length : length ;
+    memcpy(data, report.data, copyLength) ;
+    reports.pop_front() ;
+    return copyLength ;
+}
+
+// Same conventions as hid_write: a leading report number of 0 is not sent
+int ReSpeakerLibusbTransport::write ( const unsigned char *data, int length ) {
+    if (!isOpen() || length < 1) {
+        return -1 ;
+    }
+    const unsigned char reportNumber = data[0] ;
+    int skipped = 0 ;
+    if (reportNumber == 0) {
+        data++ ;
+        length-- ;
+        skipped = 1 ;
+    }
+    if (outEndpoint) {
+        int transferred = 0 ;
+        int res = libusb_interrupt_transfer(device, outEndpoint, const_cast<unsigned char *>(data),
+                                            length, &transferred, WriteTimeoutMs) ;
+        if (res < 0) {
+            return -1 ;
+        }
+        return transferred + skipped ;
+    }
+    // No interrupt OUT endpoint; fall back to SET_REPORT on the control pipe
+    int res = libusb_control_transfer(device,
+                                      LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT,
+                                      HidSetReport, (HidOutputReport << 8) | reportNumber,
+                                      interfaceNumber, const_cast<unsigned char *>(data), length,
+                                      WriteTimeoutMs) ;
+    if (res < 0) {
+        return -1 ;
+    }
+    return res + skipped ;
+}
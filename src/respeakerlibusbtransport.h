@@ -0,0 +1,126 @@
+#ifndef RESPEAKERLIBUSBTRANSPORT_H
+#define RESPEAKERLIBUSBTRANSPORT_H
+
+#include <libusb.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "respeakertransport.h"
+
+// A libusb context plus the one thread which handles its events.
+// libusb polls the file descriptors of every device opened in the context
+// from that thread, so any number of arrays can share it.
+class ReSpeakerUsbContext
+{
+public:
+    ReSpeakerUsbContext() ;
+    ~ReSpeakerUsbContext() ;
+
+    bool isValid ( void ) const ;
+    libusb_context *context ( void ) const ;
+
+private:
+    void eventLoop ( void ) ;
+
+    // libusb event wait; bounds shutdown on libusb versions that cannot be interrupted
+    static const int EventTimeoutMs = 250 ;
+
+    libusb_context *usbContext ;
+    std::thread eventThread ;
+    std::atomic<bool> running ;
+};
+
+// Talks to the array's HID interface directly with libusb, bypassing hidapi.
+// Several IN transfers stay submitted on the interrupt endpoint at all times,
+// each with its own preallocated buffer, and are resubmitted from their
+// completion callback.  With a report handler set, reports are handed over
+// on the context's event thread with no further copy or queue.
+class ReSpeakerLibusbTransport : public ReSpeakerTransport
+{
+public:
+    // Opens the first device with the given ids in a context of its own
+    ReSpeakerLibusbTransport ( unsigned short vendorId = 0x2886, unsigned short productId = 0x07 ) ;
+    // Opens usbDevice in a shared context, which must outlive the transport.
+    // hidInterface picks the HID interface; -1 takes the first one with
+    // an interrupt IN endpoint
+    ReSpeakerLibusbTransport ( ReSpeakerUsbContext *context, libusb_device *usbDevice, int hidInterface = -1 ) ;
+    ~ReSpeakerLibusbTransport() ;
+
+    bool isOpen ( void ) const ;
+    int write ( const unsigned char *data, int length ) ;
+    int read ( unsigned char *data, int length, int timeoutMs ) ;
+    bool setReportHandler ( ReSpeakerReportHandler handler ) ;
+    // Opens the device with the same ids on the same port again
+    bool reopen ( void ) ;
+    bool setHotplugHandler ( ReSpeakerHotplugHandler handler ) ;
+
+    // IN transfers kept queued on the interrupt endpoint
+    static const int NumInTransfers = 4 ;
+    static const int MaxReportLength = 64 ;
+
+private:
+    struct Report {
+        unsigned char data[MaxReportLength] ;
+        int length ;
+    };
+
+    bool open ( void ) ;
+    bool openDevice ( libusb_device *usbDevice ) ;
+    bool findEndpoints ( libusb_device *usbDevice ) ;
+    bool submitInTransfers ( void ) ;
+    void closeDevice ( void ) ;
+    void close ( void ) ;
+    void reportReceived ( const unsigned char *data, int length ) ;
+    static void LIBUSB_CALL inTransferComplete ( libusb_transfer *transfer ) ;
+    static int LIBUSB_CALL hotplugEvent ( libusb_context *context, libusb_device *usbDevice,
+                                          libusb_hotplug_event event, void *userData ) ;
+
+    // Reports queued for read() while no handler is set
+    static const int MaxQueuedReports = 256 ;
+    static const int WriteTimeoutMs = 1000 ;
+    // USB 3 allows hubs seven deep
+    static const int MaxPortDepth = 7 ;
+
+    ReSpeakerUsbContext *usbContext ;
+    bool ownsContext ;
+    libusb_device_handle *device ;
+    unsigned short vendorId ;
+    unsigned short productId ;
+    // Where the device was first opened; 0 depth until then
+    unsigned char busNumber ;
+    unsigned char portNumbers[MaxPortDepth] ;
+    int portDepth ;
+    // The interface asked for, -1 for any
+    int wantedInterface ;
+    int interfaceNumber ;
+    unsigned char inEndpoint ;
+    unsigned char outEndpoint ;
+    int inPacketSize ;
+    bool kernelDriverDetached ;
+
+    libusb_transfer *inTransfers[NumInTransfers] ;
+    unsigned char inBuffers[NumInTransfers][MaxReportLength] ;
+    // Held while a transfer is resubmitted or cancelled, so closing cannot
+    // slip in between the running check and the resubmit
+    std::mutex transferMutex ;
+    std::condition_variable transfersRetired ;
+    std::atomic<int> inTransfersActive ;
+    std::atomic<bool> deviceLost ;
+    std::atomic<bool> running ;
+
+    std::mutex reportMutex ;
+    std::condition_variable reportReady ;
+    std::deque<Report> reports ;
+    ReSpeakerReportHandler handler ;
+
+    std::mutex hotplugMutex ;
+    ReSpeakerHotplugHandler hotplugHandler ;
+    libusb_hotplug_callback_handle hotplugHandle ;
+    bool hotplugRegistered ;
+};
+
+#endif // RESPEAKERLIBUSBTRANSPORT_H
@@ -1,15 +1,104 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
+#include <chrono>
 
 #include "respeakermicarray.h"
+#include "respeakerlibusbtransport.h"
+#include "respeakertrace.h"
 
-ReSpeakerMicArray::ReSpeakerMicArray()
+// Same clock as the direction history, so report times can be queried there
+static long long monotonicMicroseconds ( void ) {
+    return ReSpeakerDirectionHistory::now() ;
+}
+
+ReSpeakerMicArray::ReSpeakerMicArray( Backend backend )
+    : autoReportsDropped(0)
+    , cacheEnabled(false)
+    , cacheFlushIntervalMs(0)
+    , flushQueued(false)
+    , handle(0)
+    , transport(openTransport(backend))
+    , commandQueue(0)
+    , connected(false)
+    , transportUsers(0)
+    , hotplugPending(false)
+    , lastLedFrame(0)
+    , readerRunning(false)
+    , readerPushed(false)
 {
-    handle = hid_open(0x2886, 0x07, NULL);
-    if (handle == 0) {
+    init() ;
+}
+
+ReSpeakerMicArray::ReSpeakerMicArray( ReSpeakerTransport *transport )
+    : autoReportsDropped(0)
+    , cacheEnabled(false)
+    , cacheFlushIntervalMs(0)
+    , flushQueued(false)
+    , handle(0)
+    , transport(transport)
+    , commandQueue(0)
+    , connected(false)
+    , transportUsers(0)
+    , hotplugPending(false)
+    , lastLedFrame(0)
+    , readerRunning(false)
+    , readerPushed(false)
+{
+    init() ;
+}
+
+ReSpeakerTransport *ReSpeakerMicArray::openTransport ( Backend backend ) {
+    if (backend == LibusbBackend) {
+        return new ReSpeakerLibusbTransport(0x2886, 0x07) ;
+    }
+    return new ReSpeakerHidapiTransport(hid_open(0x2886, 0x07, NULL)) ;
+}
+
+void ReSpeakerMicArray::init ( void ) {
+    handle = transport->device() ;
+    if (!transport->isOpen()) {
         std::cout << "No USB Handle" << std::endl   ;
+        RESPEAKER_TRACE_ERROR(ReSpeakerTrace::NoHandle, 0, 0) ;
     }
+    // e.g. the voice angle follows the talker
+    for (int i = 0; i < ReSpeakerRegisterCount; i++) {
+        registers.setVolatile(ReSpeakerRegisterTable[i].id, ReSpeakerRegisterTable[i].isVolatile) ;
+    }
+    connected = transport->isOpen() ;
+    transport->setHotplugHandler([this] (bool) {
+        std::lock_guard<std::mutex> lock(readerMutex) ;
+        hotplugPending = true ;
+        readerWake.notify_all() ;
+    }) ;
+    commandQueue = new ReSpeakerCommandQueue(this) ;
+}
+
+ReSpeakerMicArray::~ReSpeakerMicArray()
+{
+    // Nothing posts behind the last flush, and queued commands still run
+    // against the array
+    stopEventReader() ;
+    commandQueue->send(ReSpeakerCommandQueue::RegisterLane, [] (ReSpeakerMicArray *micArray) {
+        return micArray->flushRegisters() ;
+    }) ;
+    delete commandQueue ;
+    transport->setHotplugHandler(ReSpeakerHotplugHandler()) ;
+    delete transport ;
+    handle = 0 ;
+}
+
+bool ReSpeakerMicArray::isOpen ( void ) const {
+    return transport->isOpen() ;
+}
+
+hid_device *ReSpeakerMicArray::hidDevice ( void ) const {
+    return handle.load() ;
+}
+
+bool ReSpeakerMicArray::isConnected ( void ) const {
+    return connected.load() ;
 }
 
 //
@@ -19,7 +108,8 @@ int ReSpeakerMicArray::setLEDMode ( unsigned char mode, unsigned char data1, uns
     // unsigned char buf[9] ;
     unsigned char buf[9] = { 0x0, 0x0, 0x0, 0x4, 0x0, mode, data1, data2, data3 } ;
     int res ;
-    res = hid_write(handle,buf,9) ;
+    lastLedFrame = (1ULL << 32) | ((unsigned long long)mode << 24) | (data1 << 16) | (data2 << 8) | data3 ;
+    res = transportWrite(buf,9) ;
     return res ;
 }
 
@@ -62,8 +152,47 @@ int ReSpeakerMicArray::setLEDAutoVoiceLocated ( void ) {
 
 // Write data of size len into register reg, return success
 int ReSpeakerMicArray::writeRegister(unsigned char reg, unsigned char * data, unsigned char len) {
-    unsigned char buf[len + 5];
+    if (!connected) {
+        // Sent when the array is back
+        if (cacheEnabled) {
+            registers.stage(reg, data, len);
+        }
+        return -1;
+    }
+    if (cacheEnabled && cacheFlushIntervalMs > 0) {
+        // Coalesce; only the last value staged before the flush is sent
+        if (registers.changes(reg, data, len)) {
+            registers.stage(reg, data, len);
+        }
+        return len + 5;
+    }
+    return writeThrough(reg, data, len);
+}
+
+// Write now unless the cache knows the register already holds data
+int ReSpeakerMicArray::writeThrough ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    if (!cacheEnabled) {
+        return sendRegister(reg, data, len) ;
+    }
+    if (!registers.changes(reg, data, len)) {
+        return len + 5 ;
+    }
+    int res = sendRegister(reg, data, len) ;
+    if (res < 0) {
+        // Sent again by the first flush once the array is back
+        registers.stageRetry(reg, data, len) ;
+    } else {
+        registers.store(reg, data, len, monotonicMicroseconds(), false) ;
+    }
+    return res ;
+}
+
+int ReSpeakerMicArray::sendRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    unsigned char buf[MaxReportLength];
     int res;
+    if (len + 5 > MaxReportLength) {
+        return -1;
+    }
     // Set a register on the mic --
     buf[0] = 0; // First byte is report number
     buf[1] = reg; // register #
@@ -74,14 +203,53 @@ int ReSpeakerMicArray::writeRegister(unsigned char reg, unsigned char * data, un
     for(int i=0;i<len;i++) {
         buf[5+i] = data[i];
     }
-    res = hid_write(handle, buf, len+5);
+    res = transportWrite(buf, len+5);
+    RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::RegisterWrite, reg, len);
+    if (res < 0) {
+        RESPEAKER_TRACE_ERROR(ReSpeakerTrace::TransportError, res, reg);
+    }
     return res;
 }
 
 // Read data of size len into ret at register reg, return success
 int ReSpeakerMicArray::readRegister(unsigned char reg, unsigned char * ret, unsigned char len) {
     int res;
-    unsigned char buf[9];
+    ResponseSlot slot;
+    if (7 + len > MaxReportLength) {
+        return 0;
+    }
+    if (cacheEnabled && registers.lookup(reg, ret, len, monotonicMicroseconds())) {
+        return 1;
+    }
+    res = sendReadRequest(reg, len, &slot);
+    if (res < 0) {
+        return 0;
+    }
+    std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(ResponseTimeoutMs);
+    res = receiveResponse(&slot, deadline);
+    if (res > 0) {
+        for(int i=0;i<len;i++) {
+            ret[i] = slot.data[4+i];
+        }
+        if (cacheEnabled) {
+            registers.store(reg, ret, len, monotonicMicroseconds(), true);
+        }
+        return 1;
+    }
+    if (res == 0) {
+        RESPEAKER_TRACE_ERROR(ReSpeakerTrace::RegisterTimeout, reg, len);
+    }
+    return 0;
+
+}
+
+// To read a register, send register with 0x80, and then read it back.
+// The answer lands in slot, which waits from before the request goes out
+// until receiveResponse() or releaseResponse() lets go of it
+int ReSpeakerMicArray::sendReadRequest ( unsigned char reg, unsigned char len, ResponseSlot *slot ) {
+    unsigned char buf[7];
+    int res;
     buf[0] = 0;
     buf[1] = reg;
     buf[2] = 0x80;
@@ -89,22 +257,89 @@ int ReSpeakerMicArray::readRegister(unsigned char reg, unsigned char * ret, unsi
     buf[4] = 0;
     buf[5] = 0;
     buf[6] = 0;
-    // To read a register, send register with 0x80, and then read it back.
-    // If blocking is off, the read will return none if it's too soon after
-    res = hid_write(handle, buf, 7);
+    RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::RegisterRead, reg, len);
+    slot->reg = reg;
+    slot->length = 0;
+    {
+        std::lock_guard<std::mutex> lock(responseMutex);
+        pendingResponses.push_back(slot);
+    }
+    res = transportWrite(buf, 7);
+    if (res < 0) {
+        releaseResponse(slot);
+    }
+    return res;
+}
 
-    res = hid_read(handle, buf, 7+len);
-    if (res == 0) {
-      printf("Too soon after write in read register\n");
+// Wait until deadline for the answer to the request slot is waiting for,
+// then let go of slot. Returns the answer's length, 0 on timeout, -1 on a
+// device error
+int ReSpeakerMicArray::receiveResponse ( ResponseSlot *slot, std::chrono::steady_clock::time_point deadline ) {
+    int res = 0 ;
+    if (eventReaderRunning()) {
+        // The reader owns the transport's reads and hands answers over
+        std::unique_lock<std::mutex> lock(responseMutex) ;
+        if (responseReady.wait_until(lock, deadline, [this, slot] { return slot->length != 0 || !connected ; })) {
+            res = slot->length != 0 ? slot->length : -1 ;
+        }
+        lock.unlock() ;
+        releaseResponse(slot) ;
+        return res ;
     }
-    if(buf[0] == reg) {
-        for(int i=0;i<len;i++) {
-            ret[i] = buf[4+i];
+    unsigned char buf[MaxReportLength] ;
+    for (;;) {
+        {
+            // Another caller's read may have picked up our answer
+            std::lock_guard<std::mutex> lock(responseMutex) ;
+            if (slot->length != 0) {
+                res = slot->length ;
+                break ;
+            }
+        }
+        long long remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count() ;
+        if (remainingMs < 0) {
+            res = 0 ;
+            break ;
+        }
+        res = transportRead(buf, sizeof(buf), (int)remainingMs) ;
+        if (res <= 0) {
+            break ;
+        }
+        // An auto report while nobody is collecting them is dropped
+        if (buf[0] != 0xFF) {
+            deliverResponse(buf, res) ;
         }
-        return 1;
     }
-    return 0;
+    releaseResponse(slot) ;
+    return res ;
+}
 
+void ReSpeakerMicArray::releaseResponse ( ResponseSlot *slot ) {
+    std::lock_guard<std::mutex> lock(responseMutex) ;
+    for (std::vector<ResponseSlot *>::iterator it = pendingResponses.begin(); it != pendingResponses.end(); ++it) {
+        if (*it == slot) {
+            pendingResponses.erase(it) ;
+            return ;
+        }
+    }
+}
+
+// Hand an answer to the oldest request for its register still waiting.
+// Answers nobody waits for any more are stale and dropped
+void ReSpeakerMicArray::deliverResponse ( const unsigned char *buf, int len ) {
+    {
+        std::lock_guard<std::mutex> lock(responseMutex) ;
+        for (size_t i = 0; i < pendingResponses.size(); i++) {
+            ResponseSlot *slot = pendingResponses[i] ;
+            if (slot->length == 0 && slot->reg == buf[0]) {
+                slot->length = len < MaxReportLength ? len : MaxReportLength ;
+                memcpy(slot->data, buf, slot->length) ;
+                break ;
+            }
+        }
+    }
+    responseReady.notify_all() ;
 }
 
 // Returns 1 if auto report was read, 0 otherwise
@@ -114,18 +349,24 @@ int ReSpeakerMicArray::readAutoReport  (unsigned short * angle, unsigned char *v
     angle[0] = 0;
     vadActivity[0] = 0;
 
-    hid_set_nonblocking(handle, 1);
-    res = hid_read(handle, buf, 9);
-    hid_set_nonblocking(handle,0) ;
+    if (eventReaderRunning()) {
+        ReSpeakerAutoReport report ;
+        if (nextAutoReport(&report)) {
+            angle[0] = report.angle;
+            vadActivity[0] = report.vadActivity;
+            return 1;
+        }
+        return 0;
+    }
+
+    // A zero timeout makes this a non-blocking read without toggling
+    // the device's blocking mode around it
+    res = transportRead(buf, 9, 0);
     if (res > 4) {
         if(buf[0] == 0xFF) {
-            int soundAngle = buf[6]*256 + buf[5];
-            if (soundAngle != 0) {
-                printf("soundAngle: %d\n",soundAngle) ;
-                fflush(stdout);
-            }
             angle[0] = buf[6]*256 + buf[5];
             vadActivity[0] = buf[4];
+            RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::AutoReport, angle[0], vadActivity[0]);
             return 1;
         }
     }
@@ -135,12 +376,427 @@ int ReSpeakerMicArray::readAutoReport  (unsigned short * angle, unsigned char *v
 // Return the voice angle
 // Returns -1 is unable
 int ReSpeakerMicArray::voiceAngle() {
-    unsigned char buffer[2] ;
-    int res ;
-    res = readRegister(0x44, buffer, 2);
-    if (res) {
-       printf("Buffer[0]: %d Buffer[1]: %d\n",buffer[0],buffer[1]) ;
-       fflush(stdout);
+    unsigned short angle ;
+    if (!get<ReSpeakerRegisters::VoiceAngle>(&angle)) {
+        return -1 ;
+    }
+    RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::RegisterValue, ReSpeakerRegisters::VoiceAngle::id, angle);
+    return angle ;
+}
+
+//
+// Snapshots
+//
+
+int ReSpeakerMicArray::snapshot ( ReSpeakerSnapshot *snapshot, unsigned int groups ) {
+    ReSpeakerTransaction reads ;
+    for (int i = 0; i < ReSpeakerRegisterCount; i++) {
+        const ReSpeakerRegisterDescriptor &descriptor = ReSpeakerRegisterTable[i] ;
+        if (descriptor.readable && (descriptor.groups & groups)) {
+            reads.readRegister(descriptor.id, descriptor.length) ;
+        }
+    }
+    return readSnapshot(&reads, snapshot) ;
+}
+
+int ReSpeakerMicArray::restore ( const ReSpeakerSnapshot &target, const ReSpeakerSnapshot *current ) {
+    ReSpeakerSnapshot now ;
+    if (current == 0) {
+        ReSpeakerTransaction reads ;
+        for (int i = 0; i < target.size(); i++) {
+            reads.readRegister(target.entry(i).reg, target.entry(i).len) ;
+        }
+        // A register which could not be read is simply written
+        readSnapshot(&reads, &now) ;
+        current = &now ;
+    }
+    ReSpeakerSnapshot changes = ReSpeakerSnapshot::diff(*current, target) ;
+    ReSpeakerTransaction writes ;
+    for (int i = 0; i < changes.size(); i++) {
+        const ReSpeakerSnapshot::Entry &entry = changes.entry(i) ;
+        const ReSpeakerRegisterDescriptor *descriptor = ReSpeakerRegisters::find(entry.reg) ;
+        // Registers the array sets itself are captured but never written
+        if (descriptor == 0 || descriptor->writable) {
+            writes.writeRegister(entry.reg, entry.data, entry.len) ;
+        }
+    }
+    if (writes.size() == 0) {
+        return 0 ;
+    }
+    return execute(&writes) ? writes.size() : -1 ;
+}
+
+// Run a batch of reads and keep the values which came back
+int ReSpeakerMicArray::readSnapshot ( ReSpeakerTransaction *reads, ReSpeakerSnapshot *snapshot ) {
+    const int result = execute(reads) ;
+    snapshot->clear() ;
+    for (int i = 0; i < reads->size(); i++) {
+        const ReSpeakerTransaction::Operation &op = reads->operation(i) ;
+        if (op.status == ReSpeakerTransaction::Done) {
+            snapshot->set(op.reg, op.data, op.len) ;
+        }
+    }
+    return result ;
+}
+
+//
+// Register cache
+//
+
+void ReSpeakerMicArray::enableRegisterCache ( int lifetimeMs, int flushIntervalMs ) {
+    registers.setLifetimeMs(lifetimeMs) ;
+    {
+        // The reader may be asleep with no flush to wait for
+        std::lock_guard<std::mutex> lock(readerMutex) ;
+        cacheFlushIntervalMs = flushIntervalMs ;
+        cacheEnabled = true ;
     }
-    return -1 ;
+    readerWake.notify_all() ;
+}
+
+void ReSpeakerMicArray::disableRegisterCache ( void ) {
+    flushRegisters() ;
+    cacheEnabled = false ;
+    cacheFlushIntervalMs = 0 ;
+    registers.invalidateAll() ;
+}
+
+int ReSpeakerMicArray::flushRegisters ( void ) {
+    if (!registers.hasDirty()) {
+        return 0 ;
+    }
+    ReSpeakerTransaction staged ;
+    int count = registers.takeDirty(&staged, monotonicMicroseconds()) ;
+    for (int i = 0; i < staged.size(); i++) {
+        const ReSpeakerTransaction::Operation &op = staged.operation(i) ;
+        if (sendRegister(op.reg, op.data, op.len) < 0) {
+            registers.stageRetry(op.reg, op.data, op.len) ;
+        }
+    }
+    return count ;
+}
+
+ReSpeakerRegisterCache *ReSpeakerMicArray::registerCache ( void ) {
+    return &registers ;
+}
+
+ReSpeakerDirectionHistory *ReSpeakerMicArray::history ( void ) {
+    return &directionHistory ;
+}
+
+//
+// Event reader
+//
+
+bool ReSpeakerMicArray::startEventReader ( void ) {
+    if (!readerRunning.exchange(true)) {
+        readerPushed = transport->setReportHandler([this] (const unsigned char *report, int length) {
+            dispatchReport(report, length) ;
+        }) ;
+        readerThread = std::thread(&ReSpeakerMicArray::eventReaderLoop, this) ;
+    }
+    return isConnected() ;
+}
+
+void ReSpeakerMicArray::stopEventReader ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(readerMutex) ;
+        readerRunning = false ;
+    }
+    readerWake.notify_all() ;
+    if (readerThread.joinable()) {
+        readerThread.join() ;
+    }
+    if (readerPushed) {
+        transport->setReportHandler(ReSpeakerReportHandler()) ;
+        readerPushed = false ;
+    }
+}
+
+bool ReSpeakerMicArray::eventReaderRunning ( void ) const {
+    return readerRunning.load() ;
+}
+
+int ReSpeakerMicArray::nextAutoReport ( ReSpeakerAutoReport *report ) {
+    return autoReports.pop(report) ? 1 : 0 ;
+}
+
+void ReSpeakerMicArray::setAutoReportCallback ( ReSpeakerAutoReportCallback callback ) {
+    autoReportCallback = callback ;
+}
+
+unsigned int ReSpeakerMicArray::droppedAutoReports ( void ) const {
+    return autoReportsDropped.load() ;
+}
+
+void ReSpeakerMicArray::eventReaderLoop ( void ) {
+    unsigned char buf[MaxReportLength] ;
+    std::chrono::steady_clock::time_point nextFlush = std::chrono::steady_clock::now() ;
+    while (readerRunning.load()) {
+        if (!connected) {
+            reconnect() ;
+            continue ;
+        }
+        // Pushed reports stop silently when the array goes, so look every
+        // ReaderTimeoutMs as well as on hotplug events
+        int timeoutMs = ReaderTimeoutMs ;
+        const int flushIntervalMs = cacheEnabled ? cacheFlushIntervalMs.load() : 0 ;
+        if (flushIntervalMs > 0) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now() ;
+            if (now >= nextFlush) {
+                postFlush() ;
+                nextFlush = now + std::chrono::milliseconds(flushIntervalMs) ;
+            }
+            int untilFlushMs = std::chrono::duration_cast<std::chrono::milliseconds>(nextFlush - now).count() ;
+            if (untilFlushMs < timeoutMs) {
+                timeoutMs = untilFlushMs ;
+            }
+        }
+        if (readerPushed) {
+            // Reports arrive on the transport's thread; sleep until the next
+            // flush, a plug event or until we are stopped
+            std::unique_lock<std::mutex> lock(readerMutex) ;
+            readerWake.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                [this] { return !readerRunning || hotplugPending || !connected ; }) ;
+            hotplugPending = false ;
+            lock.unlock() ;
+            checkConnection() ;
+            continue ;
+        }
+        int res = transport->read(buf, sizeof(buf), timeoutMs) ;
+        if (res < 0) {
+            checkConnection() ;
+            if (connected) {
+                // Device error; back off rather than spin on a dead handle
+                std::this_thread::sleep_for(std::chrono::milliseconds(ReaderTimeoutMs)) ;
+            }
+            continue ;
+        }
+        if (res > 0) {
+            dispatchReport(buf, res) ;
+        }
+    }
+}
+
+//
+// Connection
+//
+
+int ReSpeakerMicArray::transportWrite ( const unsigned char *data, int length ) {
+    transportUsers++ ;
+    if (!connected) {
+        transportUsers-- ;
+        return -1 ;
+    }
+    int res = transport->write(data, length) ;
+    transportUsers-- ;
+    if (res < 0) {
+        checkConnection() ;
+    }
+    return res ;
+}
+
+int ReSpeakerMicArray::transportRead ( unsigned char *data, int length, int timeoutMs ) {
+    transportUsers++ ;
+    if (!connected) {
+        transportUsers-- ;
+        return -1 ;
+    }
+    int res = transport->read(data, length, timeoutMs) ;
+    transportUsers-- ;
+    if (res < 0) {
+        checkConnection() ;
+    }
+    return res ;
+}
+
+// Notice a lost array and hand it to the reader thread
+void ReSpeakerMicArray::checkConnection ( void ) {
+    if (transport->isOpen() || !connected.exchange(false)) {
+        return ;
+    }
+    RESPEAKER_TRACE_ERROR(ReSpeakerTrace::Disconnected, 0, 0) ;
+    {
+        std::lock_guard<std::mutex> lock(readerMutex) ;
+        readerWake.notify_all() ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(responseMutex) ;
+        responseReady.notify_all() ;
+    }
+}
+
+// Runs on the reader thread until the array is open again or the reader is stopped
+void ReSpeakerMicArray::reconnect ( void ) {
+    // Nobody gets in now; wait for those already inside. Their calls end
+    // quickly on a missing device
+    while (transportUsers.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1)) ;
+    }
+    int delayMs = ReconnectMinDelayMs ;
+    int attempts = 0 ;
+    for (;;) {
+        hotplugPending = false ;
+        // Closed on purpose; keep waiting until its owner opens it again
+        if (!transport->wasClosed()) {
+            attempts++ ;
+            if (transport->reopen()) {
+                break ;
+            }
+        }
+        std::unique_lock<std::mutex> lock(readerMutex) ;
+        readerWake.wait_for(lock, std::chrono::milliseconds(delayMs),
+                            [this] { return !readerRunning || hotplugPending ; }) ;
+        if (!readerRunning) {
+            return ;
+        }
+        delayMs = delayMs * 2 < ReconnectMaxDelayMs ? delayMs * 2 : ReconnectMaxDelayMs ;
+    }
+
+    handle = transport->device() ;
+    {
+        // Requests sent before the array went away will not be answered
+        std::lock_guard<std::mutex> lock(responseMutex) ;
+        for (size_t i = 0; i < pendingResponses.size(); i++) {
+            if (pendingResponses[i]->length == 0) {
+                pendingResponses[i]->length = -1 ;
+            }
+        }
+    }
+    responseReady.notify_all() ;
+    connected = true ;
+    RESPEAKER_TRACE_INFO(ReSpeakerTrace::Reconnected, attempts, 0) ;
+    postReplay() ;
+}
+
+// The array came back with its defaults. The configuration is sent again
+// from the command queue's thread, in order with everything else posted
+void ReSpeakerMicArray::postReplay ( void ) {
+    if (cacheEnabled) {
+        registers.restage() ;
+        commandQueue->send(ReSpeakerCommandQueue::RegisterLane, [] (ReSpeakerMicArray *micArray) {
+            return micArray->flushRegisters() ;
+        }) ;
+    }
+    commandQueue->send(ReSpeakerCommandQueue::LedLane, [] (ReSpeakerMicArray *micArray) {
+        // A frame posted since is newer and already on its way
+        unsigned long long led = micArray->lastLedFrame.load() ;
+        if (!led) {
+            return 0 ;
+        }
+        return micArray->setLEDMode((led >> 24) & 0xFF, (led >> 16) & 0xFF, (led >> 8) & 0xFF, led & 0xFF) ;
+    }) ;
+}
+
+// At most one periodic flush waits in the queue; it takes every write
+// staged up to when it runs
+void ReSpeakerMicArray::postFlush ( void ) {
+    if (flushQueued.exchange(true)) {
+        return ;
+    }
+    commandQueue->send(ReSpeakerCommandQueue::RegisterLane, [] (ReSpeakerMicArray *micArray) {
+        micArray->flushQueued = false ;
+        return micArray->flushRegisters() ;
+    }) ;
+}
+
+// Runs on the reader thread, or the transport's own, for every report read
+// from the array
+void ReSpeakerMicArray::dispatchReport ( const unsigned char *buf, int len ) {
+    if (buf[0] == 0xFF) {
+        if (len > 6) {
+            ReSpeakerAutoReport report ;
+            report.timestampUs = monotonicMicroseconds() ;
+            report.angle = buf[6]*256 + buf[5] ;
+            report.vadActivity = buf[4] ;
+            directionHistory.append(report) ;
+            RESPEAKER_TRACE_DEBUG(ReSpeakerTrace::AutoReport, report.angle, report.vadActivity) ;
+            if (!autoReports.push(report)) {
+                RESPEAKER_TRACE_ERROR(ReSpeakerTrace::AutoReportDropped, ++autoReportsDropped, 0) ;
+            }
+            if (autoReportCallback) {
+                autoReportCallback(report) ;
+            }
+        }
+        return ;
+    }
+    // Anything else is the answer to a register read
+    deliverResponse(buf, len) ;
+}
+
+//
+// Register transactions
+//
+
+int ReSpeakerMicArray::execute ( ReSpeakerTransaction *transaction, int maxInFlight ) {
+    // Reads whose request is out, in the order they were sent. A deque keeps
+    // the slots where they are while others come and go
+    struct InFlight {
+        int index ;
+        ResponseSlot slot ;
+    };
+    std::deque<InFlight> inFlight ;
+    int next = 0 ;
+    if (maxInFlight < 1) {
+        maxInFlight = 1 ;
+    }
+    while (next < transaction->size() || !inFlight.empty()) {
+        // Fill the window. The array handles requests in order, so writes
+        // can go out while earlier reads are still unanswered
+        while (next < transaction->size() && (int)inFlight.size() < maxInFlight) {
+            ReSpeakerTransaction::Operation &op = transaction->operation(next) ;
+            if (op.read) {
+                inFlight.push_back(InFlight()) ;
+                inFlight.back().index = next ;
+                if (sendReadRequest(op.reg, op.len, &inFlight.back().slot) < 0) {
+                    op.status = ReSpeakerTransaction::Failed ;
+                    inFlight.pop_back() ;
+                }
+            } else {
+                // Batches are written straight through, never staged
+                int res = writeThrough(op.reg, op.data, op.len) ;
+                op.status = res < 0 ? ReSpeakerTransaction::Failed : ReSpeakerTransaction::Done ;
+            }
+            next++ ;
+        }
+        if (inFlight.empty()) {
+            continue ;
+        }
+
+        // The array answers in order, so the oldest read is answered first
+        std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(ResponseTimeoutMs) ;
+        ResponseSlot &slot = inFlight.front().slot ;
+        ReSpeakerTransaction::Operation &op = transaction->operation(inFlight.front().index) ;
+        int res = receiveResponse(&slot, deadline) ;
+        if (res <= 0) {
+            // Nothing more is coming for the outstanding requests
+            op.status = ReSpeakerTransaction::Failed ;
+            for (size_t i = 1; i < inFlight.size(); i++) {
+                releaseResponse(&inFlight[i].slot) ;
+                transaction->operation(inFlight[i].index).status = ReSpeakerTransaction::Failed ;
+            }
+            inFlight.clear() ;
+            continue ;
+        }
+        int available = res - 4 ;
+        int copyLength = available < op.len ? available : op.len ;
+        if (copyLength > 0) {
+            memcpy(op.data, slot.data + 4, copyLength) ;
+        }
+        op.status = copyLength == op.len ? ReSpeakerTransaction::Done : ReSpeakerTransaction::Failed ;
+        if (cacheEnabled && op.status == ReSpeakerTransaction::Done) {
+            registers.store(op.reg, op.data, op.len, monotonicMicroseconds(), true) ;
+        }
+        inFlight.pop_front() ;
+    }
+    return transaction->succeeded() ? 1 : 0 ;
+}
+
+std::future<int> ReSpeakerMicArray::submit ( ReSpeakerTransaction *transaction, ReSpeakerTransactionCallback callback ) {
+    return commandQueue->execute(transaction, callback) ;
+}
+
+ReSpeakerCommandQueue *ReSpeakerMicArray::commands ( void ) {
+    return commandQueue ;
 }
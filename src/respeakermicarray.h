@@ -4,12 +4,65 @@
 #include <libusb.h>
 #include "../../hidapi/hidapi/hidapi.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spscqueue.h"
+#include "respeakertransport.h"
+#include "respeakertransaction.h"
+#include "respeakercommandqueue.h"
+#include "respeakerregistercache.h"
+#include "respeakerregisters.h"
+#include "respeakersnapshot.h"
+#include "respeakerdirectionhistory.h"
+
+// A decoded 0xFF auto report
+struct ReSpeakerAutoReport
+{
+    long long timestampUs ;     // Monotonic time the report was read
+    unsigned short angle ;      // Direction of arrival in degrees
+    unsigned char vadActivity ; // 0 none, 2 voice activity detected
+};
+
+typedef std::function<void (const ReSpeakerAutoReport &)> ReSpeakerAutoReportCallback ;
 
 class ReSpeakerMicArray
 {
 public:
-    hid_device *handle ;
-    ReSpeakerMicArray();
+    // How the array is reached over USB
+    enum Backend {
+        HidapiBackend,  // hidapi's synchronous hid_read/hid_write
+        LibusbBackend   // asynchronous libusb interrupt transfers
+    };
+
+    ReSpeakerMicArray( Backend backend = HidapiBackend );
+    // Use transport, e.g. a stand-in for the array; takes ownership
+    explicit ReSpeakerMicArray( ReSpeakerTransport *transport );
+    // The transport the Backend constructor opens, for wrapping, e.g. in a
+    // ReSpeakerRecordingTransport, before handing it to the one above
+    static ReSpeakerTransport *openTransport ( Backend backend = HidapiBackend ) ;
+    ~ReSpeakerMicArray();
+
+    bool isOpen ( void ) const ;
+    // hidapi device when the transport goes through hidapi, 0 otherwise.
+    // For identifying the array only; the device belongs to the array's
+    // threads
+    hid_device *hidDevice ( void ) const ;
+    // Whether the array is there right now; cheap and never blocks. While it
+    // is not, control calls fail at once and the event reader thread keeps
+    // trying to reopen it, woken early by hotplug events where the transport
+    // has them, unless the transport was closed on purpose. Once it is back,
+    // register values written through the cache, including writes which
+    // failed while it was gone, and the last LED mode are sent again and
+    // reports resume
+    bool isConnected ( void ) const ;
 
     // LED control
     int setLEDMode ( unsigned char mode, unsigned char data1, unsigned char data2, unsigned char data3 ) ;
@@ -25,10 +78,170 @@ public:
     int writeRegister(unsigned char reg, unsigned char * data, unsigned char len) ;
     // Read data of size len into ret at register reg, return success
     int readRegister(unsigned char reg, unsigned char * ret, unsigned char len) ;
+    // Typed register access, e.g. get<ReSpeakerRegisters::MicGain>(&gain).
+    // Same results as readRegister and writeRegister
+    template <typename Reg>
+    int get ( typename Reg::Value *value ) {
+        static_assert(Reg::readable, "register is write only") ;
+        unsigned char data[Reg::length] ;
+        if (!readRegister(Reg::id, data, Reg::length)) {
+            return 0 ;
+        }
+        *value = ReSpeakerRegisters::decode<typename Reg::Value>(data) ;
+        return 1 ;
+    }
+    template <typename Reg>
+    int set ( typename Reg::Value value ) {
+        static_assert(Reg::writable, "register is read only") ;
+        unsigned char data[Reg::length] ;
+        ReSpeakerRegisters::encode(value, data) ;
+        return writeRegister(Reg::id, data, Reg::length) ;
+    }
     // Read Auto Report
     int readAutoReport  (unsigned short * angle, unsigned char *vadActivity) ;
     // Get the Voice Angle; returns -1 if not read
     int voiceAngle ( void ) ;
+
+    // Register transactions
+    // Run the operations of transaction in order, keeping up to maxInFlight
+    // register reads outstanding. Returns 1 if every operation succeeded
+    int execute ( ReSpeakerTransaction *transaction, int maxInFlight = DefaultReadsInFlight ) ;
+    // Run the transaction on the command queue's thread; callback, if set,
+    // runs there once the whole batch has completed. transaction must outlive
+    // the returned future
+    std::future<int> submit ( ReSpeakerTransaction *transaction,
+                              ReSpeakerTransactionCallback callback = ReSpeakerTransactionCallback() ) ;
+
+    // Snapshots
+    // Read every readable register of the given groups from the table in
+    // one pipelined batch. Returns 1 if all of them were read
+    int snapshot ( ReSpeakerSnapshot *snapshot, unsigned int groups = ReSpeakerRegisters::DspGroup ) ;
+    // Bring the array to target, writing only the registers whose value
+    // differs from current, in one batch. Without current a snapshot of the
+    // same registers is taken first. Returns the number of registers
+    // written, -1 on failure
+    int restore ( const ReSpeakerSnapshot &target, const ReSpeakerSnapshot *current = 0 ) ;
+
+    // Register cache
+    // Mirror registers on the host. Reads of values younger than lifetimeMs are
+    // served from the mirror and writes which change nothing are skipped.
+    // With flushIntervalMs > 0 writes are staged and only the latest value of
+    // each register is sent, once per interval, by a flush the event reader
+    // posts to the command queue (or by flushRegisters() when the reader is
+    // not running)
+    void enableRegisterCache ( int lifetimeMs = DefaultCacheLifetimeMs, int flushIntervalMs = 0 ) ;
+    void disableRegisterCache ( void ) ;
+    // Send staged register writes now; returns the number of registers written
+    int flushRegisters ( void ) ;
+    ReSpeakerRegisterCache *registerCache ( void ) ;
+
+    // Command queue
+    // The calls above are synchronous and not meant to be made from several
+    // threads at once. Code on other threads posts to this queue instead,
+    // which makes them one at a time on its own thread
+    ReSpeakerCommandQueue *commands ( void ) ;
+
+    // Event reader
+    // Starts a thread which blocks reading the transport, decodes auto reports
+    // into a lock-free queue and hands each register response to the read
+    // which asked for it. Transports which receive on a thread of their own
+    // deliver straight to the decoder instead. The thread also reconnects the
+    // array, so it is started even if the array is missing; what has to be
+    // sent again afterwards goes through the command queue. Returns
+    // isConnected()
+    bool startEventReader ( void ) ;
+    void stopEventReader ( void ) ;
+    bool eventReaderRunning ( void ) const ;
+    // Pop the next queued auto report; returns 1 if one was available, 0 otherwise
+    int nextAutoReport ( ReSpeakerAutoReport *report ) ;
+    // Called on the reader thread after each report is queued. It must not block.
+    // Set it before calling startEventReader
+    void setAutoReportCallback ( ReSpeakerAutoReportCallback callback ) ;
+    // Number of reports dropped because the queue was full
+    unsigned int droppedAutoReports ( void ) const ;
+    // Every decoded report is also kept here for time-range queries,
+    // e.g. history()->dominantAngle(ReSpeakerDirectionHistory::now(), 2000)
+    ReSpeakerDirectionHistory *history ( void ) ;
+
+    // Size of the largest HID report exchanged with the array
+    static const int MaxReportLength = 64 ;
+    // Register read requests execute() keeps outstanding by default
+    static const int DefaultReadsInFlight = 4 ;
+    // How long cached register values are trusted by default
+    static const int DefaultCacheLifetimeMs = 5000 ;
+
+private:
+    // Where the answer to one register read request lands. Requests wait
+    // in the order they were sent and the array answers them in that order,
+    // so each answer goes to the oldest waiting request for its register
+    struct ResponseSlot {
+        unsigned char reg ;
+        unsigned char data[MaxReportLength] ;
+        int length ;        // 0 until answered, -1 if no answer will come
+    };
+
+    void init ( void ) ;
+    // Every transport call but the reader thread's own goes through these.
+    // They fail fast while disconnected and let reconnect() wait for the
+    // calls in progress before the transport is reopened
+    int transportWrite ( const unsigned char *data, int length ) ;
+    int transportRead ( unsigned char *data, int length, int timeoutMs ) ;
+    void checkConnection ( void ) ;
+    void reconnect ( void ) ;
+    void eventReaderLoop ( void ) ;
+    // Queue the writes the array lost, for the command queue's thread
+    void postFlush ( void ) ;
+    void postReplay ( void ) ;
+    void dispatchReport ( const unsigned char *buf, int len ) ;
+    void deliverResponse ( const unsigned char *buf, int len ) ;
+    int sendRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    int writeThrough ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    int sendReadRequest ( unsigned char reg, unsigned char len, ResponseSlot *slot ) ;
+    int receiveResponse ( ResponseSlot *slot, std::chrono::steady_clock::time_point deadline ) ;
+    void releaseResponse ( ResponseSlot *slot ) ;
+    int readSnapshot ( ReSpeakerTransaction *reads, ReSpeakerSnapshot *snapshot ) ;
+
+    static const int AutoReportQueueSize = 256 ;
+    // Transport read wait; bounds how long stopEventReader takes
+    static const int ReaderTimeoutMs = 100 ;
+    // How long a register read waits for its response
+    static const int ResponseTimeoutMs = 500 ;
+    // Reopen attempts back off between these
+    static const int ReconnectMinDelayMs = 100 ;
+    static const int ReconnectMaxDelayMs = 2000 ;
+
+    SpscQueue<ReSpeakerAutoReport, AutoReportQueueSize> autoReports ;
+    ReSpeakerAutoReportCallback autoReportCallback ;
+    std::atomic<unsigned int> autoReportsDropped ;
+    ReSpeakerDirectionHistory directionHistory ;
+
+    ReSpeakerRegisterCache registers ;
+    std::atomic<bool> cacheEnabled ;
+    std::atomic<int> cacheFlushIntervalMs ;
+    // A periodic flush is posted and has not run yet
+    std::atomic<bool> flushQueued ;
+
+    // transport->device(), kept for other threads to read
+    std::atomic<hid_device *> handle ;
+    ReSpeakerTransport *transport ;
+    ReSpeakerCommandQueue *commandQueue ;
+    std::atomic<bool> connected ;
+    std::atomic<int> transportUsers ;
+    std::atomic<bool> hotplugPending ;
+    // Last LED frame asked for, to restore after a reconnect; bit 32 marks it set
+    std::atomic<unsigned long long> lastLedFrame ;
+
+    std::thread readerThread ;
+    std::atomic<bool> readerRunning ;
+    // The transport pushes reports; the reader thread only does housekeeping
+    bool readerPushed ;
+    std::mutex readerMutex ;
+    std::condition_variable readerWake ;
+
+    std::mutex responseMutex ;
+    std::condition_variable responseReady ;
+    // Read requests waiting for an answer, oldest first
+    std::vector<ResponseSlot *> pendingResponses ;
 };
 
 #endif // RESPEAKERMICARRAY_H
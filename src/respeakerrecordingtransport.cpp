@@ -0,0 +1,63 @@
+#include "respeakerrecordingtransport.h"
+
+ReSpeakerRecordingTransport::ReSpeakerRecordingTransport ( ReSpeakerTransport *transport, ReSpeakerCaptureWriter *writer )
+    : transport(transport)
+    , writer(writer)
+{
+}
+
+ReSpeakerRecordingTransport::~ReSpeakerRecordingTransport()
+{
+    delete transport ;
+}
+
+bool ReSpeakerRecordingTransport::isOpen ( void ) const {
+    return transport->isOpen() ;
+}
+
+int ReSpeakerRecordingTransport::write ( const unsigned char *data, int length ) {
+    int res = transport->write(data, length) ;
+    if (res > 0) {
+        writer->write(ReSpeakerCapture::HostReport, data, length) ;
+    }
+    return res ;
+}
+
+int ReSpeakerRecordingTransport::read ( unsigned char *data, int length, int timeoutMs ) {
+    int res = transport->read(data, length, timeoutMs) ;
+    if (res > 0) {
+        writer->write(ReSpeakerCapture::DeviceReport, data, res) ;
+    }
+    return res ;
+}
+
+bool ReSpeakerRecordingTransport::setReportHandler ( ReSpeakerReportHandler handler ) {
+    if (!handler) {
+        return transport->setReportHandler(handler) ;
+    }
+    ReSpeakerCaptureWriter *capture = writer ;
+    return transport->setReportHandler([capture, handler] (const unsigned char *report, int length) {
+        capture->write(ReSpeakerCapture::DeviceReport, report, length) ;
+        handler(report, length) ;
+    }) ;
+}
+
+bool ReSpeakerRecordingTransport::reopen ( void ) {
+    return transport->reopen() ;
+}
+
+bool ReSpeakerRecordingTransport::wasClosed ( void ) const {
+    return transport->wasClosed() ;
+}
+
+bool ReSpeakerRecordingTransport::setHotplugHandler ( ReSpeakerHotplugHandler handler ) {
+    return transport->setHotplugHandler(handler) ;
+}
+
+hid_device *ReSpeakerRecordingTransport::device ( void ) const {
+    return transport->device() ;
+}
+
+ReSpeakerTransport *ReSpeakerRecordingTransport::recorded ( void ) const {
+    return transport ;
+}
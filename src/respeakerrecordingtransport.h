@@ -0,0 +1,32 @@
+#ifndef RESPEAKERRECORDINGTRANSPORT_H
+#define RESPEAKERRECORDINGTRANSPORT_H
+
+#include "respeakertransport.h"
+#include "respeakercapture.h"
+
+// Passes every call through to another transport and tees the reports going
+// each way into a capture, for playing back with ReSpeakerReplayTransport
+class ReSpeakerRecordingTransport : public ReSpeakerTransport
+{
+public:
+    // Takes ownership of transport but not of writer, which must outlive it
+    ReSpeakerRecordingTransport ( ReSpeakerTransport *transport, ReSpeakerCaptureWriter *writer ) ;
+    ~ReSpeakerRecordingTransport() ;
+
+    bool isOpen ( void ) const ;
+    int write ( const unsigned char *data, int length ) ;
+    int read ( unsigned char *data, int length, int timeoutMs ) ;
+    bool setReportHandler ( ReSpeakerReportHandler handler ) ;
+    bool reopen ( void ) ;
+    bool wasClosed ( void ) const ;
+    bool setHotplugHandler ( ReSpeakerHotplugHandler handler ) ;
+    hid_device *device ( void ) const ;
+
+    ReSpeakerTransport *recorded ( void ) const ;
+
+private:
+    ReSpeakerTransport *transport ;
+    ReSpeakerCaptureWriter *writer ;
+};
+
+#endif // RESPEAKERRECORDINGTRANSPORT_H
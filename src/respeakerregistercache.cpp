@@ -0,0 +1,156 @@
+#include <string.h>
+
+#include "respeakerregistercache.h"
+
+ReSpeakerRegisterCache::ReSpeakerRegisterCache()
+    : lifetimeUs(0)
+    , dirtyCount(0)
+{
+    memset(entries, 0, sizeof(entries)) ;
+}
+
+void ReSpeakerRegisterCache::setLifetimeMs ( int ms ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    lifetimeUs = (long long)ms * 1000 ;
+}
+
+void ReSpeakerRegisterCache::setVolatile ( unsigned char reg, bool isVolatile ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    entries[reg].isVolatile = isVolatile ;
+}
+
+bool ReSpeakerRegisterCache::lookup ( unsigned char reg, unsigned char *data, unsigned char len, long long nowUs ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    const Entry &entry = entries[reg] ;
+    if (!entry.valid || entry.isVolatile || entry.len != len) {
+        return false ;
+    }
+    // A staged write is the value the array is about to hold
+    if (!entry.dirty && nowUs - entry.updatedUs >= lifetimeUs) {
+        return false ;
+    }
+    memcpy(data, entry.data, len) ;
+    return true ;
+}
+
+void ReSpeakerRegisterCache::store ( unsigned char reg, const unsigned char *data, unsigned char len, long long nowUs, bool fromRead ) {
+    if (len > MaxValueLength) {
+        return ;
+    }
+    std::lock_guard<std::mutex> lock(mutex) ;
+    Entry &entry = entries[reg] ;
+    if (entry.dirty) {
+        if (fromRead) {
+            return ;
+        }
+        entry.dirty = false ;
+        dirtyCount-- ;
+    }
+    memcpy(entry.data, data, len) ;
+    entry.len = len ;
+    entry.valid = true ;
+    entry.written = entry.written || !fromRead ;
+    entry.updatedUs = nowUs ;
+}
+
+bool ReSpeakerRegisterCache::changes ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    const Entry &entry = entries[reg] ;
+    // Volatile registers may have moved since we last saw them
+    return entry.isVolatile || !entry.valid || !sameValue(entry, data, len) ;
+}
+
+void ReSpeakerRegisterCache::stage ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    if (len > MaxValueLength) {
+        return ;
+    }
+    std::lock_guard<std::mutex> lock(mutex) ;
+    Entry &entry = entries[reg] ;
+    if (!entry.dirty) {
+        entry.dirty = true ;
+        dirtyCount++ ;
+    }
+    memcpy(entry.data, data, len) ;
+    entry.len = len ;
+    entry.valid = true ;
+    entry.written = true ;
+}
+
+void ReSpeakerRegisterCache::stageRetry ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    if (len > MaxValueLength) {
+        return ;
+    }
+    std::lock_guard<std::mutex> lock(mutex) ;
+    Entry &entry = entries[reg] ;
+    if (entry.dirty) {
+        return ;
+    }
+    entry.dirty = true ;
+    dirtyCount++ ;
+    memcpy(entry.data, data, len) ;
+    entry.len = len ;
+    entry.valid = true ;
+    entry.written = true ;
+}
+
+int ReSpeakerRegisterCache::takeDirty ( ReSpeakerTransaction *transaction, long long nowUs ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int taken = 0 ;
+    for (int reg = 0; reg < NumRegisters && dirtyCount > 0; reg++) {
+        Entry &entry = entries[reg] ;
+        if (entry.dirty) {
+            transaction->writeRegister(reg, entry.data, entry.len) ;
+            entry.dirty = false ;
+            entry.updatedUs = nowUs ;
+            dirtyCount-- ;
+            taken++ ;
+        }
+    }
+    return taken ;
+}
+
+bool ReSpeakerRegisterCache::hasDirty ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return dirtyCount > 0 ;
+}
+
+int ReSpeakerRegisterCache::restage ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    int staged = 0 ;
+    for (int reg = 0; reg < NumRegisters; reg++) {
+        Entry &entry = entries[reg] ;
+        if (entry.valid && entry.written && !entry.isVolatile) {
+            if (!entry.dirty) {
+                entry.dirty = true ;
+                dirtyCount++ ;
+            }
+            staged++ ;
+        }
+    }
+    return staged ;
+}
+
+void ReSpeakerRegisterCache::invalidate ( unsigned char reg ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    Entry &entry = entries[reg] ;
+    if (entry.dirty) {
+        dirtyCount-- ;
+    }
+    entry.valid = false ;
+    entry.dirty = false ;
+    entry.written = false ;
+}
+
+void ReSpeakerRegisterCache::invalidateAll ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    for (int reg = 0; reg < NumRegisters; reg++) {
+        entries[reg].valid = false ;
+        entries[reg].dirty = false ;
+        entries[reg].written = false ;
+    }
+    dirtyCount = 0 ;
+}
+
+bool ReSpeakerRegisterCache::sameValue ( const Entry &entry, const unsigned char *data, unsigned char len ) const {
+    return entry.len == len && memcmp(entry.data, data, len) == 0 ;
+}
@@ -0,0 +1,69 @@
+#ifndef RESPEAKERREGISTERCACHE_H
+#define RESPEAKERREGISTERCACHE_H
+
+#include <mutex>
+
+#include "respeakertransaction.h"
+
+// Host side mirror of the array's register file.
+// Values read from or written to the array are kept with the time they were
+// last known to be true.  Writes can be staged instead of sent, so a burst of
+// writes to one register collapses into the last value, which is taken out
+// by the next flush.  All calls are thread safe.
+class ReSpeakerRegisterCache
+{
+public:
+    static const int NumRegisters = 256 ;
+    static const int MaxValueLength = ReSpeakerTransaction::MaxPayloadLength ;
+
+    ReSpeakerRegisterCache() ;
+
+    // How long a value is trusted after it was read or written. A staged
+    // write not yet flushed is served whatever the lifetime, so with 0 only
+    // staged writes are served
+    void setLifetimeMs ( int ms ) ;
+    // Registers the array changes on its own are never served from the cache
+    void setVolatile ( unsigned char reg, bool isVolatile ) ;
+
+    // Copy a fresh value of reg into data; returns true on a hit
+    bool lookup ( unsigned char reg, unsigned char *data, unsigned char len, long long nowUs ) ;
+    // Record a value the array was sent or reported. A value read back does not
+    // replace a staged write which has not been flushed yet
+    void store ( unsigned char reg, const unsigned char *data, unsigned char len, long long nowUs, bool fromRead ) ;
+    // True if writing data would change what the array holds or is about to be sent
+    bool changes ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    // Stage a write for the next flush; replaces any write already staged for reg
+    void stage ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    // Stage a write which could not be sent, so the next flush tries again.
+    // A newer write staged in the meantime is kept instead
+    void stageRetry ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    // Append every staged write to transaction and mark them clean. Returns the count
+    int takeDirty ( ReSpeakerTransaction *transaction, long long nowUs ) ;
+    bool hasDirty ( void ) const ;
+    // Stage again every value the host wrote, e.g. after the array was
+    // reset or replugged. Returns the count
+    int restage ( void ) ;
+    // Forget what is known about reg, e.g. after a failed write
+    void invalidate ( unsigned char reg ) ;
+    void invalidateAll ( void ) ;
+
+private:
+    struct Entry {
+        unsigned char data[MaxValueLength] ;
+        unsigned char len ;
+        bool valid ;
+        bool dirty ;
+        bool isVolatile ;
+        bool written ;      // The value came from the host, not the array
+        long long updatedUs ;
+    };
+
+    bool sameValue ( const Entry &entry, const unsigned char *data, unsigned char len ) const ;
+
+    Entry entries[NumRegisters] ;
+    long long lifetimeUs ;
+    int dirtyCount ;
+    mutable std::mutex mutex ;
+};
+
+#endif // RESPEAKERREGISTERCACHE_H
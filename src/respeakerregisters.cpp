@@ -0,0 +1,10 @@
+#include "respeakerregisters.h"
+
+const ReSpeakerRegisterDescriptor *ReSpeakerRegisters::find ( unsigned char id ) {
+    for (int i = 0; i < ReSpeakerRegisterCount; i++) {
+        if (ReSpeakerRegisterTable[i].id == id) {
+            return &ReSpeakerRegisterTable[i] ;
+        }
+    }
+    return 0 ;
+}
@@ -0,0 +1,149 @@
+#ifndef RESPEAKERREGISTERS_H
+#define RESPEAKERREGISTERS_H
+
+#include "respeakertransaction.h"
+
+// The array's registers that this library knows about.
+// Each register is a type carrying its id, value type and access at compile
+// time, so ReSpeakerMicArray::get<>() and set<>() need no length argument
+// and reject reads of write-only registers at compile time. Values are
+// little endian on the wire. ReSpeakerRegisterTable lists the same
+// registers for code that walks them at run time.
+struct ReSpeakerRegisterDescriptor
+{
+    unsigned char id ;
+    unsigned char length ;
+    bool readable ;
+    bool writable ;
+    bool isVolatile ;       // Changed by the array on its own
+    unsigned int groups ;
+    const char *name ;
+};
+
+class ReSpeakerRegisters
+{
+public:
+    enum Access {
+        ReadOnly = 1,
+        WriteOnly = 2,
+        ReadWrite = 3
+    };
+
+    // Parameter groups, for bulk reads and dumps
+    enum Group {
+        DspGroup = 1 << 0,      // Settings the host tunes
+        StatusGroup = 1 << 1    // What the array reports about the room
+    };
+
+    template <unsigned char Id, typename T, int RegisterAccess, unsigned int RegisterGroups, bool Volatile = false>
+    struct Register {
+        typedef T Value ;
+        static const unsigned char id = Id ;
+        static const unsigned char length = sizeof(T) ;
+        static const bool readable = (RegisterAccess & ReadOnly) != 0 ;
+        static const bool writable = (RegisterAccess & WriteOnly) != 0 ;
+        static const bool isVolatile = Volatile ;
+        static const unsigned int groups = RegisterGroups ;
+        static_assert(sizeof(T) <= ReSpeakerTransaction::MaxPayloadLength, "register does not fit in a report") ;
+    };
+
+    struct MicGain : Register<0x10, signed char, ReadWrite, DspGroup> { } ;
+    struct SpeakerProcessingBypass : Register<0x13, unsigned char, ReadWrite, DspGroup> { } ;
+    struct AutomaticGainControl : Register<0x2A, unsigned char, ReadWrite, DspGroup> { } ;
+    struct VoiceAngle : Register<0x44, unsigned short, ReadOnly, StatusGroup, true> { } ;
+
+    // The table entry for id, or 0 if the register is not known
+    static const ReSpeakerRegisterDescriptor *find ( unsigned char id ) ;
+
+    template <typename Reg>
+    static constexpr ReSpeakerRegisterDescriptor describe ( const char *name ) {
+        return { Reg::id, Reg::length, Reg::readable, Reg::writable, Reg::isVolatile, Reg::groups, name } ;
+    }
+
+    template <typename T>
+    static void encode ( T value, unsigned char *data ) {
+        for (unsigned int i = 0; i < sizeof(T); i++) {
+            data[i] = (unsigned char)((unsigned long long)value >> (8 * i)) ;
+        }
+    }
+
+    template <typename T>
+    static T decode ( const unsigned char *data ) {
+        unsigned long long value = 0 ;
+        for (unsigned int i = 0; i < sizeof(T); i++) {
+            value |= (unsigned long long)data[i] << (8 * i) ;
+        }
+        return (T)value ;
+    }
+
+    // Typed transaction steps; these return the operation index like
+    // ReSpeakerTransaction does
+    template <typename Reg>
+    static int queueRead ( ReSpeakerTransaction *transaction ) {
+        static_assert(Reg::readable, "register is write only") ;
+        return transaction->readRegister(Reg::id, Reg::length) ;
+    }
+
+    template <typename Reg>
+    static int queueWrite ( ReSpeakerTransaction *transaction, typename Reg::Value value ) {
+        static_assert(Reg::writable, "register is read only") ;
+        unsigned char data[Reg::length] ;
+        encode(value, data) ;
+        return transaction->writeRegister(Reg::id, data, Reg::length) ;
+    }
+
+    template <typename Reg>
+    static typename Reg::Value result ( const ReSpeakerTransaction &transaction, int index ) {
+        return decode<typename Reg::Value>(transaction.result(index)) ;
+    }
+};
+
+// A fixed set of registers read as one pipelined batch. The reads are laid
+// out when the program is compiled; appendReads() only copies them in.
+//   typedef ReSpeakerRegisterGroup<ReSpeakerRegisters::MicGain, ...> Tuning ;
+//   int first = Tuning::appendReads(&transaction) ;
+//   micArray->execute(&transaction) ;
+//   gain = Tuning::value<ReSpeakerRegisters::MicGain>(transaction, first) ;
+template <typename... Regs>
+class ReSpeakerRegisterGroup
+{
+public:
+    static const int size = sizeof...(Regs) ;
+
+    // Queue one read per register; returns the index of the first
+    static int appendReads ( ReSpeakerTransaction *transaction ) {
+        int first = transaction->size() ;
+        const int unused[] = { 0, ReSpeakerRegisters::queueRead<Regs>(transaction)... } ;
+        (void)unused ;
+        return first ;
+    }
+
+    // Value of Reg from a transaction filled by appendReads at first.
+    // Fails to compile if Reg is not in the group
+    template <typename Reg>
+    static typename Reg::Value value ( const ReSpeakerTransaction &transaction, int first ) {
+        return ReSpeakerRegisters::result<Reg>(transaction, first + IndexOf<Reg, Regs...>::value) ;
+    }
+
+private:
+    template <typename Reg, typename... List> struct IndexOf ;
+    template <typename Reg, typename... Rest>
+    struct IndexOf<Reg, Reg, Rest...> { static const int value = 0 ; } ;
+    template <typename Reg, typename First, typename... Rest>
+    struct IndexOf<Reg, First, Rest...> { static const int value = 1 + IndexOf<Reg, Rest...>::value ; } ;
+};
+
+constexpr ReSpeakerRegisterDescriptor ReSpeakerRegisterTable[] = {
+    ReSpeakerRegisters::describe<ReSpeakerRegisters::MicGain>("MicGain"),
+    ReSpeakerRegisters::describe<ReSpeakerRegisters::SpeakerProcessingBypass>("SpeakerProcessingBypass"),
+    ReSpeakerRegisters::describe<ReSpeakerRegisters::AutomaticGainControl>("AutomaticGainControl"),
+    ReSpeakerRegisters::describe<ReSpeakerRegisters::VoiceAngle>("VoiceAngle"),
+} ;
+const int ReSpeakerRegisterCount = sizeof(ReSpeakerRegisterTable) / sizeof(ReSpeakerRegisterTable[0]) ;
+
+// The registers the host tunes
+typedef ReSpeakerRegisterGroup<ReSpeakerRegisters::MicGain,
+                               ReSpeakerRegisters::SpeakerProcessingBypass,
+                               ReSpeakerRegisters::AutomaticGainControl> ReSpeakerDspParameters ;
+
+#endif // RESPEAKERREGISTERS_H
@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include <chrono>
+
+#include "respeakerreplaytransport.h"
+
+ReSpeakerReplayTransport::ReSpeakerReplayTransport ( ReSpeakerCapturePlayer *player )
+    : player(player)
+    , open(true)
+    , closed(false)
+    , writes(0)
+    , delivered(0)
+{
+    player->setHandler(ReSpeakerCapture::DeviceReport, [this] (const ReSpeakerCaptureRecord &record) {
+        queueReport(record) ;
+    }) ;
+}
+
+ReSpeakerReplayTransport::~ReSpeakerReplayTransport()
+{
+    // The handler points at us; closing first releases a player held back
+    close() ;
+    player->stop() ;
+    player->setHandler(ReSpeakerCapture::DeviceReport, ReSpeakerCaptureHandler()) ;
+}
+
+bool ReSpeakerReplayTransport::isOpen ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return open ;
+}
+
+void ReSpeakerReplayTransport::close ( void ) {
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        open = false ;
+        closed = true ;
+    }
+    reportReady.notify_all() ;
+    spaceReady.notify_all() ;
+}
+
+bool ReSpeakerReplayTransport::reopen ( void ) {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    open = true ;
+    closed = false ;
+    return true ;
+}
+
+bool ReSpeakerReplayTransport::wasClosed ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return closed ;
+}
+
+int ReSpeakerReplayTransport::write ( const unsigned char *data, int length ) {
+    (void)data ;
+    std::lock_guard<std::mutex> lock(mutex) ;
+    if (!open) {
+        return -1 ;
+    }
+    writes++ ;
+    return length ;
+}
+
+int ReSpeakerReplayTransport::read ( unsigned char *data, int length, int timeoutMs ) {
+    std::unique_lock<std::mutex> lock(mutex) ;
+    auto ready = [this] { return !open || !reports.empty() ; } ;
+    if (timeoutMs < 0) {
+        reportReady.wait(lock, ready) ;
+    } else if (!reportReady.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+        return 0 ;
+    }
+    if (!open) {
+        return -1 ;
+    }
+    const std::vector<unsigned char> &report = reports.front() ;
+    int count = (int)report.size() < length ? (int)report.size() : length ;
+    memcpy(data, report.data(), count) ;
+    reports.pop_front() ;
+    delivered++ ;
+    lock.unlock() ;
+    spaceReady.notify_one() ;
+    return count ;
+}
+
+unsigned long long ReSpeakerReplayTransport::writesReceived ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return writes ;
+}
+
+unsigned long long ReSpeakerReplayTransport::reportsDelivered ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return delivered ;
+}
+
+int ReSpeakerReplayTransport::queuedReports ( void ) const {
+    std::lock_guard<std::mutex> lock(mutex) ;
+    return reports.size() ;
+}
+
+// Called on the player thread as each recorded report falls due
+void ReSpeakerReplayTransport::queueReport ( const ReSpeakerCaptureRecord &record ) {
+    {
+        std::unique_lock<std::mutex> lock(mutex) ;
+        spaceReady.wait(lock, [this] { return !open || reports.size() < (size_t)MaxQueuedReports ; }) ;
+        if (!open) {
+            return ;
+        }
+        reports.push_back(record.data) ;
+    }
+    reportReady.notify_one() ;
+}
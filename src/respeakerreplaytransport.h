@@ -0,0 +1,55 @@
+#ifndef RESPEAKERREPLAYTRANSPORT_H
+#define RESPEAKERREPLAYTRANSPORT_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "respeakertransport.h"
+#include "respeakercapture.h"
+
+// Stands in for the array while a capture plays: the reports the array sent
+// come back from read() as the player reaches them, so they go through the
+// same reader, decoder and queues as live ones. Writes are accepted and
+// counted but answer nothing; register responses in the capture arrive at
+// their recorded times instead. Once MaxQueuedReports are waiting for read()
+// the player is held back, which shows up as its lateness.
+class ReSpeakerReplayTransport : public ReSpeakerTransport
+{
+public:
+    // Installs the player's DeviceReport handler; start the player afterwards.
+    // player must outlive the transport
+    explicit ReSpeakerReplayTransport ( ReSpeakerCapturePlayer *player ) ;
+    ~ReSpeakerReplayTransport() ;
+
+    bool isOpen ( void ) const ;
+    int write ( const unsigned char *data, int length ) ;
+    int read ( unsigned char *data, int length, int timeoutMs ) ;
+    void close ( void ) ;
+    bool reopen ( void ) ;
+    bool wasClosed ( void ) const ;
+
+    unsigned long long writesReceived ( void ) const ;
+    unsigned long long reportsDelivered ( void ) const ;
+    // Reports played but not read yet
+    int queuedReports ( void ) const ;
+
+    static const int MaxQueuedReports = 1024 ;
+
+private:
+    void queueReport ( const ReSpeakerCaptureRecord &record ) ;
+
+    ReSpeakerCapturePlayer *player ;
+
+    mutable std::mutex mutex ;
+    std::condition_variable reportReady ;
+    std::condition_variable spaceReady ;
+    bool open ;
+    bool closed ;
+    std::deque<std::vector<unsigned char> > reports ;
+    unsigned long long writes ;
+    unsigned long long delivered ;
+};
+
+#endif // RESPEAKERREPLAYTRANSPORT_H
@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "respeakersnapshot.h"
+
+static const unsigned char BlobMagic[4] = { 'R', 'S', 'N', 'P' } ;
+static const size_t BlobHeaderLength = 7 ;
+
+const unsigned char ReSpeakerSnapshot::BlobVersion ;
+
+ReSpeakerSnapshot::ReSpeakerSnapshot()
+{
+}
+
+void ReSpeakerSnapshot::clear ( void ) {
+    entries.clear() ;
+}
+
+int ReSpeakerSnapshot::size ( void ) const {
+    return entries.size() ;
+}
+
+const ReSpeakerSnapshot::Entry &ReSpeakerSnapshot::entry ( int index ) const {
+    return entries[index] ;
+}
+
+void ReSpeakerSnapshot::set ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    if (len > ReSpeakerTransaction::MaxPayloadLength) {
+        return ;
+    }
+    size_t i = 0 ;
+    while (i < entries.size() && entries[i].reg < reg) {
+        i++ ;
+    }
+    if (i == entries.size() || entries[i].reg != reg) {
+        Entry added ;
+        added.reg = reg ;
+        entries.insert(entries.begin() + i, added) ;
+    }
+    entries[i].len = len ;
+    memcpy(entries[i].data, data, len) ;
+}
+
+const ReSpeakerSnapshot::Entry *ReSpeakerSnapshot::find ( unsigned char reg ) const {
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].reg == reg) {
+            return &entries[i] ;
+        }
+    }
+    return 0 ;
+}
+
+std::vector<unsigned char> ReSpeakerSnapshot::toBlob ( void ) const {
+    std::vector<unsigned char> blob(BlobMagic, BlobMagic + sizeof(BlobMagic)) ;
+    blob.push_back(BlobVersion) ;
+    blob.push_back(entries.size() & 0xFF) ;
+    blob.push_back(entries.size() >> 8) ;
+    for (size_t i = 0; i < entries.size(); i++) {
+        blob.push_back(entries[i].reg) ;
+        blob.push_back(entries[i].len) ;
+        blob.insert(blob.end(), entries[i].data, entries[i].data + entries[i].len) ;
+    }
+    return blob ;
+}
+
+bool ReSpeakerSnapshot::fromBlob ( const unsigned char *blob, size_t length ) {
+    entries.clear() ;
+    if (length < BlobHeaderLength || memcmp(blob, BlobMagic, sizeof(BlobMagic)) != 0 ||
+        blob[4] != BlobVersion) {
+        return false ;
+    }
+    const int count = blob[5] | (blob[6] << 8) ;
+    size_t offset = BlobHeaderLength ;
+    for (int i = 0; i < count; i++) {
+        if (offset + 2 > length) {
+            entries.clear() ;
+            return false ;
+        }
+        const unsigned char reg = blob[offset] ;
+        const unsigned char len = blob[offset + 1] ;
+        if (len > ReSpeakerTransaction::MaxPayloadLength || offset + 2 + len > length) {
+            entries.clear() ;
+            return false ;
+        }
+        set(reg, blob + offset + 2, len) ;
+        offset += 2 + len ;
+    }
+    return true ;
+}
+
+ReSpeakerSnapshot ReSpeakerSnapshot::diff ( const ReSpeakerSnapshot &from, const ReSpeakerSnapshot &to ) {
+    ReSpeakerSnapshot changes ;
+    for (size_t i = 0; i < to.entries.size(); i++) {
+        const Entry &target = to.entries[i] ;
+        const Entry *current = from.find(target.reg) ;
+        if (current == 0 || current->len != target.len ||
+            memcmp(current->data, target.data, target.len) != 0) {
+            changes.entries.push_back(target) ;
+        }
+    }
+    return changes ;
+}
@@ -0,0 +1,45 @@
+#ifndef RESPEAKERSNAPSHOT_H
+#define RESPEAKERSNAPSHOT_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "respeakertransaction.h"
+
+// Register values captured from an array by ReSpeakerMicArray::snapshot.
+// Saved as a compact blob: a 4 byte magic, a version byte and a 2 byte
+// little endian count, then id, length and value bytes for each register.
+class ReSpeakerSnapshot
+{
+public:
+    struct Entry {
+        unsigned char reg ;
+        unsigned char len ;
+        unsigned char data[ReSpeakerTransaction::MaxPayloadLength] ;
+    };
+
+    static const unsigned char BlobVersion = 1 ;
+
+    ReSpeakerSnapshot() ;
+
+    void clear ( void ) ;
+    int size ( void ) const ;
+    const Entry &entry ( int index ) const ;
+    // Add or replace the value of reg
+    void set ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    // Pointer to the value of reg, or 0 if it was not captured
+    const Entry *find ( unsigned char reg ) const ;
+
+    std::vector<unsigned char> toBlob ( void ) const ;
+    // Returns false, leaving the snapshot empty, if blob is not a snapshot
+    bool fromBlob ( const unsigned char *blob, size_t length ) ;
+
+    // The entries of to which from lacks or holds a different value for
+    static ReSpeakerSnapshot diff ( const ReSpeakerSnapshot &from, const ReSpeakerSnapshot &to ) ;
+
+private:
+    // Kept sorted by register
+    std::vector<Entry> entries ;
+};
+
+#endif // RESPEAKERSNAPSHOT_H
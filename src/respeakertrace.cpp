@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "respeakertrace.h"
+
+namespace {
+
+struct TraceRing
+{
+    // Count of records ever written; slot is written % RingSize
+    std::atomic<uint64_t> written ;
+    uint32_t thread ;
+    // Held by a running thread; guarded by registryMutex
+    bool inUse ;
+    ReSpeakerTraceRecord records[ReSpeakerTrace::RingSize] ;
+};
+
+// Rings outlive their threads so their last records stay in snapshots,
+// until a new thread takes the ring over: there are only ever as many
+// rings as threads tracing at once. The registry is only locked when a
+// thread records for the first time, when it exits and when taking a
+// snapshot
+std::mutex registryMutex ;
+std::vector<TraceRing *> registry ;
+
+TraceRing *acquireRing ( void ) {
+    std::lock_guard<std::mutex> lock(registryMutex) ;
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (!registry[i]->inUse) {
+            registry[i]->inUse = true ;
+            return registry[i] ;
+        }
+    }
+    TraceRing *ring = new TraceRing ;
+    ring->written.store(0, std::memory_order_relaxed) ;
+    ring->thread = registry.size() ;
+    ring->inUse = true ;
+    registry.push_back(ring) ;
+    return ring ;
+}
+
+// Gives the ring back when its thread exits
+struct RingOwner
+{
+    RingOwner() : ring(0) {}
+    ~RingOwner() {
+        if (ring) {
+            std::lock_guard<std::mutex> lock(registryMutex) ;
+            ring->inUse = false ;
+        }
+    }
+    TraceRing *ring ;
+};
+
+thread_local RingOwner threadRing ;
+
+bool earlier ( const ReSpeakerTraceRecord &x, const ReSpeakerTraceRecord &y ) {
+    return x.timestampUs < y.timestampUs ;
+}
+
+}
+
+void ReSpeakerTrace::record ( int level, int event, int a, int b ) {
+    TraceRing *ring = threadRing.ring ;
+    if (!ring) {
+        ring = threadRing.ring = acquireRing() ;
+    }
+    const uint64_t n = ring->written.load(std::memory_order_relaxed) ;
+    ReSpeakerTraceRecord &r = ring->records[n % RingSize] ;
+    r.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count() ;
+    r.thread = ring->thread ;
+    r.event = event ;
+    r.level = level ;
+    r.reserved = 0 ;
+    r.a = a ;
+    r.b = b ;
+    ring->written.store(n + 1, std::memory_order_release) ;
+}
+
+void ReSpeakerTrace::snapshot ( std::vector<ReSpeakerTraceRecord> *records ) {
+    records->clear() ;
+    std::lock_guard<std::mutex> lock(registryMutex) ;
+    for (size_t i = 0; i < registry.size(); i++) {
+        TraceRing *ring = registry[i] ;
+        const uint64_t end = ring->written.load(std::memory_order_acquire) ;
+        uint64_t begin = end > (uint64_t)RingSize ? end - RingSize : 0 ;
+        const size_t first = records->size() ;
+        for (uint64_t n = begin; n < end; n++) {
+            records->push_back(ring->records[n % RingSize]) ;
+        }
+        // The owner kept writing while we copied; drop what it overwrote,
+        // including the slot its next record may be going into
+        std::atomic_thread_fence(std::memory_order_acquire) ;
+        const uint64_t after = ring->written.load(std::memory_order_relaxed) ;
+        if (after + 1 > begin + RingSize) {
+            uint64_t stale = std::min(after + 1 - RingSize - begin, end - begin) ;
+            records->erase(records->begin() + first, records->begin() + first + stale) ;
+        }
+    }
+    std::stable_sort(records->begin(), records->end(), earlier) ;
+}
+
+int ReSpeakerTrace::dump ( const char *path ) {
+    std::vector<ReSpeakerTraceRecord> records ;
+    snapshot(&records) ;
+    FILE *file = fopen(path, "wb") ;
+    if (!file) {
+        return -1 ;
+    }
+    uint32_t header[4] = { DumpMagic, DumpVersion, sizeof(ReSpeakerTraceRecord), (uint32_t)records.size() } ;
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1 ;
+    if (ok && !records.empty()) {
+        ok = fwrite(&records[0], sizeof(ReSpeakerTraceRecord), records.size(), file) == records.size() ;
+    }
+    if (fclose(file) != 0 || !ok) {
+        return -1 ;
+    }
+    return records.size() ;
+}
+
+const char *ReSpeakerTrace::eventName ( int event ) {
+    switch (event) {
+    case NoHandle:          return "NoHandle" ;
+    case AutoReport:        return "AutoReport" ;
+    case AutoReportDropped: return "AutoReportDropped" ;
+    case RegisterRead:      return "RegisterRead" ;
+    case RegisterWrite:     return "RegisterWrite" ;
+    case RegisterTimeout:   return "RegisterTimeout" ;
+    case RegisterValue:     return "RegisterValue" ;
+    case LedFrame:          return "LedFrame" ;
+    case OpenFailed:        return "OpenFailed" ;
+    case TransportError:    return "TransportError" ;
+    case Disconnected:      return "Disconnected" ;
+    case Reconnected:       return "Reconnected" ;
+    default:                return "Unknown" ;
+    }
+}
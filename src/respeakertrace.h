@@ -0,0 +1,79 @@
+#ifndef RESPEAKERTRACE_H
+#define RESPEAKERTRACE_H
+
+#include <stdint.h>
+#include <vector>
+
+// Binary tracing for the device paths.
+// Each thread writes fixed size records into a ring of its own, so a trace
+// point is a handful of stores: no lock, no allocation after the thread's
+// first record and no stdio. A thread's ring is passed on to the next
+// thread once it exits. snapshot() collects the rings and dump() saves
+// them for the tracedump tool to decode.
+//
+// Trace points above RESPEAKER_TRACE_LEVEL compile to nothing.
+
+#define RESPEAKER_TRACE_LEVEL_OFF     0
+#define RESPEAKER_TRACE_LEVEL_ERROR   1
+#define RESPEAKER_TRACE_LEVEL_INFO    2
+#define RESPEAKER_TRACE_LEVEL_DEBUG   3
+
+#ifndef RESPEAKER_TRACE_LEVEL
+#define RESPEAKER_TRACE_LEVEL RESPEAKER_TRACE_LEVEL_INFO
+#endif
+
+#define RESPEAKER_TRACE(level, event, a, b) \
+    do { \
+        if ((level) <= RESPEAKER_TRACE_LEVEL) \
+            ReSpeakerTrace::record((level), (event), (a), (b)) ; \
+    } while (0)
+
+#define RESPEAKER_TRACE_ERROR(event, a, b)  RESPEAKER_TRACE(RESPEAKER_TRACE_LEVEL_ERROR, event, a, b)
+#define RESPEAKER_TRACE_INFO(event, a, b)   RESPEAKER_TRACE(RESPEAKER_TRACE_LEVEL_INFO, event, a, b)
+#define RESPEAKER_TRACE_DEBUG(event, a, b)  RESPEAKER_TRACE(RESPEAKER_TRACE_LEVEL_DEBUG, event, a, b)
+
+// 24 bytes, the layout written by dump()
+struct ReSpeakerTraceRecord
+{
+    int64_t timestampUs ;
+    uint32_t thread ;       // Index of the thread's ring, reused once its thread exits
+    uint16_t event ;
+    uint8_t level ;
+    uint8_t reserved ;
+    int32_t a ;
+    int32_t b ;
+};
+
+class ReSpeakerTrace
+{
+public:
+    // Append new events at the end; the numbers are stored in dumps
+    enum Event {
+        NoHandle = 1,           // a, b unused
+        AutoReport,             // a angle, b VAD activity
+        AutoReportDropped,      // a reports dropped so far
+        RegisterRead,           // a register, b length
+        RegisterWrite,          // a register, b length
+        RegisterTimeout,        // a register
+        RegisterValue,          // a register, b first two bytes
+        LedFrame,               // a mode, b data1..data3
+        OpenFailed,             // a device index
+        TransportError,         // a result
+        Disconnected,           // a, b unused
+        Reconnected             // a reopen attempts
+    };
+
+    // Records each thread's ring holds; older records are overwritten
+    static const int RingSize = 4096 ;
+    static const uint32_t DumpMagic = 0x52545352 ;  // "RSTR"
+    static const uint32_t DumpVersion = 1 ;
+
+    static void record ( int level, int event, int a, int b ) ;
+    // Records of every thread, oldest first
+    static void snapshot ( std::vector<ReSpeakerTraceRecord> *records ) ;
+    // Write a snapshot to path; returns the number of records, -1 on error
+    static int dump ( const char *path ) ;
+    static const char *eventName ( int event ) ;
+};
+
+#endif // RESPEAKERTRACE_H
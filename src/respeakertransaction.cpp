@@ -0,0 +1,80 @@
+#include <string.h>
+
+#include "respeakertransaction.h"
+
+ReSpeakerTransaction::ReSpeakerTransaction()
+{
+}
+
+int ReSpeakerTransaction::writeRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) {
+    if (len > MaxPayloadLength) {
+        return -1 ;
+    }
+    Operation op ;
+    op.reg = reg ;
+    op.len = len ;
+    op.read = false ;
+    op.status = Pending ;
+    memcpy(op.data, data, len) ;
+    operations.push_back(op) ;
+    return operations.size() - 1 ;
+}
+
+int ReSpeakerTransaction::readRegister ( unsigned char reg, unsigned char len ) {
+    if (len > MaxPayloadLength) {
+        return -1 ;
+    }
+    Operation op ;
+    op.reg = reg ;
+    op.len = len ;
+    op.read = true ;
+    op.status = Pending ;
+    memset(op.data, 0, sizeof(op.data)) ;
+    operations.push_back(op) ;
+    return operations.size() - 1 ;
+}
+
+void ReSpeakerTransaction::clear ( void ) {
+    operations.clear() ;
+}
+
+void ReSpeakerTransaction::reset ( void ) {
+    for (size_t i = 0; i < operations.size(); i++) {
+        operations[i].status = Pending ;
+    }
+}
+
+int ReSpeakerTransaction::size ( void ) const {
+    return operations.size() ;
+}
+
+ReSpeakerTransaction::Operation &ReSpeakerTransaction::operation ( int index ) {
+    return operations[index] ;
+}
+
+const ReSpeakerTransaction::Operation &ReSpeakerTransaction::operation ( int index ) const {
+    return operations[index] ;
+}
+
+const unsigned char *ReSpeakerTransaction::result ( int index ) const {
+    return operations[index].data ;
+}
+
+int ReSpeakerTransaction::failedCount ( void ) const {
+    int failed = 0 ;
+    for (size_t i = 0; i < operations.size(); i++) {
+        if (operations[i].status == Failed) {
+            failed++ ;
+        }
+    }
+    return failed ;
+}
+
+bool ReSpeakerTransaction::succeeded ( void ) const {
+    for (size_t i = 0; i < operations.size(); i++) {
+        if (operations[i].status != Done) {
+            return false ;
+        }
+    }
+    return true ;
+}
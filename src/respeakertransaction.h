@@ -0,0 +1,58 @@
+#ifndef RESPEAKERTRANSACTION_H
+#define RESPEAKERTRANSACTION_H
+
+#include <functional>
+#include <vector>
+
+// A batch of register reads and writes which ReSpeakerMicArray::execute
+// runs with several read requests in flight at once.  Responses are matched
+// to requests by the register id the array echoes in the first report byte,
+// so the batch costs roughly one USB round trip instead of one per read.
+class ReSpeakerTransaction
+{
+public:
+    // Largest payload that fits in a 64 byte report after the 7 byte header
+    static const int MaxPayloadLength = 57 ;
+
+    enum Status {
+        Pending,
+        Done,
+        Failed
+    };
+
+    struct Operation {
+        unsigned char reg ;
+        unsigned char len ;
+        bool read ;
+        Status status ;
+        unsigned char data[MaxPayloadLength] ;
+    };
+
+    ReSpeakerTransaction() ;
+
+    // Queue a write of len bytes to register reg; returns the operation index, -1 if len is too large
+    int writeRegister ( unsigned char reg, const unsigned char *data, unsigned char len ) ;
+    // Queue a read of len bytes from register reg; returns the operation index, -1 if len is too large
+    int readRegister ( unsigned char reg, unsigned char len ) ;
+    // Remove all operations
+    void clear ( void ) ;
+    // Mark every operation pending again so the batch can be re-run
+    void reset ( void ) ;
+
+    int size ( void ) const ;
+    Operation &operation ( int index ) ;
+    const Operation &operation ( int index ) const ;
+    // Data returned by a completed read, or written by a write
+    const unsigned char *result ( int index ) const ;
+    // Number of operations that failed
+    int failedCount ( void ) const ;
+    // True once every operation has completed successfully
+    bool succeeded ( void ) const ;
+
+private:
+    std::vector<Operation> operations ;
+};
+
+typedef std::function<void (ReSpeakerTransaction *)> ReSpeakerTransactionCallback ;
+
+#endif // RESPEAKERTRANSACTION_H
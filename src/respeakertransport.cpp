@@ -0,0 +1,59 @@
+#include "respeakertransport.h"
+
+ReSpeakerHidapiTransport::ReSpeakerHidapiTransport ( hid_device *device,
+                                                     unsigned short vendorId, unsigned short productId,
+                                                     const wchar_t *serial )
+    : handle(device)
+    , vendorId(vendorId)
+    , productId(productId)
+    , serial(serial ? serial : L"")
+    , failed(false)
+{
+}
+
+ReSpeakerHidapiTransport::~ReSpeakerHidapiTransport()
+{
+    if (handle) {
+        hid_close(handle) ;
+    }
+}
+
+bool ReSpeakerHidapiTransport::isOpen ( void ) const {
+    return handle != 0 && !failed ;
+}
+
+int ReSpeakerHidapiTransport::write ( const unsigned char *data, int length ) {
+    if (handle == 0) {
+        return -1 ;
+    }
+    int res = hid_write(handle, data, length) ;
+    if (res < 0) {
+        failed = true ;
+    }
+    return res ;
+}
+
+int ReSpeakerHidapiTransport::read ( unsigned char *data, int length, int timeoutMs ) {
+    if (handle == 0) {
+        return -1 ;
+    }
+    int res = hid_read_timeout(handle, data, length, timeoutMs) ;
+    if (res < 0) {
+        failed = true ;
+    }
+    return res ;
+}
+
+bool ReSpeakerHidapiTransport::reopen ( void ) {
+    if (handle) {
+        hid_close(handle) ;
+    }
+    // The path names the bus address, which changes when the array is replugged
+    handle = hid_open(vendorId, productId, serial.empty() ? NULL : serial.c_str()) ;
+    failed = false ;
+    return handle != 0 ;
+}
+
+hid_device *ReSpeakerHidapiTransport::device ( void ) const {
+    return handle ;
+}
@@ -0,0 +1,74 @@
+#ifndef RESPEAKERTRANSPORT_H
+#define RESPEAKERTRANSPORT_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "../../hidapi/hidapi/hidapi.h"
+
+// Called with every report a push style transport receives
+typedef std::function<void (const unsigned char *report, int length)> ReSpeakerReportHandler ;
+// Called when an array with the transport's ids is plugged in or removed
+typedef std::function<void (bool arrived)> ReSpeakerHotplugHandler ;
+
+// How ReSpeakerMicArray exchanges HID reports with the array.
+// write() and read() follow hidapi's conventions: the first byte written is
+// the report number (0 for the array) and read() returns the report length,
+// 0 on timeout or -1 on error.
+class ReSpeakerTransport
+{
+public:
+    virtual ~ReSpeakerTransport() { }
+
+    virtual bool isOpen ( void ) const = 0 ;
+    virtual int write ( const unsigned char *data, int length ) = 0 ;
+    // A timeoutMs of -1 blocks until a report arrives
+    virtual int read ( unsigned char *data, int length, int timeoutMs ) = 0 ;
+    // Transports which receive on a thread of their own can hand every report
+    // to handler there instead of queueing it for read(). An empty handler
+    // goes back to read(). Returns false if only read() is supported
+    virtual bool setReportHandler ( ReSpeakerReportHandler handler ) { (void)handler; return false; }
+    // Close the device and open it again, e.g. after it was unplugged.
+    // Only called while no other call is using the transport. The report
+    // handler is kept. Returns true if the device is open
+    virtual bool reopen ( void ) { return isOpen() ; }
+    // True once the transport's owner closed it on purpose. Reconnecting
+    // leaves such a transport closed until its owner reopens it
+    virtual bool wasClosed ( void ) const { return false ; }
+    // Transports which can watch the bus call handler on plug events, on a
+    // thread of their own. Returns false if they cannot
+    virtual bool setHotplugHandler ( ReSpeakerHotplugHandler handler ) { (void)handler; return false; }
+    // The hidapi device underneath, for identifying the array, or 0 for
+    // transports which do not go through hidapi
+    virtual hid_device *device ( void ) const { return 0 ; }
+};
+
+// The original transport: hidapi's synchronous calls
+class ReSpeakerHidapiTransport : public ReSpeakerTransport
+{
+public:
+    // Takes ownership of device, which may be null if the open failed.
+    // reopen() looks for the ids, and the serial number if there is one
+    explicit ReSpeakerHidapiTransport ( hid_device *device,
+                                        unsigned short vendorId = 0x2886, unsigned short productId = 0x07,
+                                        const wchar_t *serial = 0 ) ;
+    ~ReSpeakerHidapiTransport() ;
+
+    // False once a call has failed; hidapi only fails for a missing device
+    bool isOpen ( void ) const ;
+    int write ( const unsigned char *data, int length ) ;
+    int read ( unsigned char *data, int length, int timeoutMs ) ;
+    bool reopen ( void ) ;
+
+    hid_device *device ( void ) const ;
+
+private:
+    hid_device *handle ;
+    unsigned short vendorId ;
+    unsigned short productId ;
+    std::wstring serial ;
+    std::atomic<bool> failed ;
+};
+
+#endif // RESPEAKERTRANSPORT_H
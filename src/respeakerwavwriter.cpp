@@ -0,0 +1,251 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "respeakerwavwriter.h"
+
+const size_t ReSpeakerWavWriter::WriteBlockBytes ;
+const size_t ReSpeakerWavWriter::Alignment ;
+const size_t ReSpeakerWavWriter::HeaderBytes ;
+const int ReSpeakerWavWriter::PollIntervalMs ;
+
+// Header layout: RIFF/WAVE, a JUNK chunk the size of a ds64 chunk, fmt,
+// a JUNK chunk padding to HeaderBytes, then the data chunk header
+static const size_t RiffBytes = 12 ;
+static const size_t Ds64Bytes = 8 + 28 ;
+static const size_t FmtBytes = 8 + 16 ;
+static const size_t DataChunkBytes = 8 ;
+static const size_t Ds64Offset = RiffBytes ;
+static const size_t PadOffset = RiffBytes + Ds64Bytes + FmtBytes ;
+static const size_t DataOffset = ReSpeakerWavWriter::HeaderBytes - DataChunkBytes ;
+
+static void put16 ( char *p, unsigned int value ) {
+    p[0] = value & 0xff ;
+    p[1] = (value >> 8) & 0xff ;
+}
+
+static void put32 ( char *p, unsigned long value ) {
+    put16(p, value & 0xffff) ;
+    put16(p + 2, (value >> 16) & 0xffff) ;
+}
+
+static void put64 ( char *p, unsigned long long value ) {
+    put32(p, value & 0xffffffffUL) ;
+    put32(p + 4, value >> 32) ;
+}
+
+ReSpeakerWavWriter::ReSpeakerWavWriter()
+    : fd(-1)
+    , buffer(0)
+    , filled(0)
+    , fileOffset(0)
+    , stopping(false)
+    , onDisk(0)
+    , overrunCount(0)
+    , lost(0)
+    , writeFailed(false)
+{
+    memset(&audioFormat, 0, sizeof(audioFormat)) ;
+}
+
+ReSpeakerWavWriter::~ReSpeakerWavWriter()
+{
+    close() ;
+}
+
+bool ReSpeakerWavWriter::open ( const char *path, const ReSpeakerCaptureAudioFormat &format,
+                                const ReSpeakerAudioRing *ring, unsigned long long preallocateBytes ) {
+    close() ;
+    if (ring == 0 || format.channelCount == 0 || format.sampleSize == 0) {
+        return false ;
+    }
+    // A frame of slack past the block, so blocks are written whole even
+    // when frames do not divide them
+    void *aligned ;
+    if (posix_memalign(&aligned, Alignment, WriteBlockBytes + ring->frameBytes()) != 0) {
+        return false ;
+    }
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+    if (fd < 0) {
+        free(aligned) ;
+        return false ;
+    }
+    buffer = static_cast<char *>(aligned) ;
+    audioFormat = format ;
+    filled = 0 ;
+    fileOffset = HeaderBytes ;
+    onDisk = 0 ;
+    overrunCount = 0 ;
+    lost = 0 ;
+    writeFailed = false ;
+    stopping = false ;
+    if (preallocateBytes > 0) {
+        // Not every file system can; the recording works without it
+        posix_fallocate(fd, 0, HeaderBytes + preallocateBytes) ;
+    }
+    if (!writeHeader()) {
+        ::close(fd) ;
+        fd = -1 ;
+        free(buffer) ;
+        buffer = 0 ;
+        return false ;
+    }
+    cursor.attach(ring) ;
+    thread = std::thread(&ReSpeakerWavWriter::run, this) ;
+    return true ;
+}
+
+bool ReSpeakerWavWriter::close ( void ) {
+    if (fd < 0) {
+        return true ;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex) ;
+        stopping = true ;
+    }
+    wakeUp.notify_one() ;
+    thread.join() ;
+
+    // The thread has drained the ring; the tail is less than a block
+    if (filled > 0 && writeAt(buffer, filled, fileOffset)) {
+        fileOffset += filled ;
+        onDisk += filled ;
+        filled = 0 ;
+    }
+    // Drop whatever was preallocated and not used
+    if (ftruncate(fd, fileOffset) != 0) {
+        writeFailed = true ;
+    }
+    if (!writeHeader() || fdatasync(fd) != 0) {
+        writeFailed = true ;
+    }
+    if (::close(fd) != 0) {
+        writeFailed = true ;
+    }
+    fd = -1 ;
+    cursor.attach(0) ;
+    free(buffer) ;
+    buffer = 0 ;
+    return !writeFailed ;
+}
+
+bool ReSpeakerWavWriter::isOpen ( void ) const {
+    return fd >= 0 ;
+}
+
+unsigned long long ReSpeakerWavWriter::dataBytes ( void ) const {
+    return onDisk ;
+}
+
+unsigned int ReSpeakerWavWriter::overruns ( void ) const {
+    return overrunCount ;
+}
+
+long long ReSpeakerWavWriter::lostBytes ( void ) const {
+    return lost ;
+}
+
+bool ReSpeakerWavWriter::failed ( void ) const {
+    return writeFailed ;
+}
+
+void ReSpeakerWavWriter::run ( void ) {
+    std::unique_lock<std::mutex> lock(mutex) ;
+    for (;;) {
+        const bool last = stopping ;
+        lock.unlock() ;
+        drain() ;
+        lock.lock() ;
+        if (last) {
+            return ;
+        }
+        wakeUp.wait_for(lock, std::chrono::milliseconds(PollIntervalMs)) ;
+    }
+}
+
+void ReSpeakerWavWriter::drain ( void ) {
+    const size_t space = WriteBlockBytes + cursor.ring()->frameBytes() ;
+    size_t length ;
+    while ((length = cursor.read(buffer + filled, space - filled)) > 0) {
+        filled += length ;
+        if (filled >= WriteBlockBytes) {
+            if (!writeFailed && !writeAt(buffer, WriteBlockBytes, fileOffset)) {
+                writeFailed = true ;
+            }
+            if (!writeFailed) {
+                fileOffset += WriteBlockBytes ;
+                onDisk += WriteBlockBytes ;
+            }
+            // Carry the part of a frame that spilled past the block
+            filled -= WriteBlockBytes ;
+            memmove(buffer, buffer + WriteBlockBytes, filled) ;
+        }
+    }
+    overrunCount = cursor.overruns() ;
+    lost = cursor.lostBytes() ;
+}
+
+bool ReSpeakerWavWriter::writeAt ( const char *data, size_t length, unsigned long long offset ) {
+    while (length > 0) {
+        const ssize_t done = pwrite(fd, data, length, offset) ;
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue ;
+            }
+            return false ;
+        }
+        data += done ;
+        length -= done ;
+        offset += done ;
+    }
+    return true ;
+}
+
+// Sizes come from fileOffset, so this writes placeholders when called
+// from open() and the final sizes from close()
+bool ReSpeakerWavWriter::writeHeader ( void ) {
+    const unsigned long long dataSize = fileOffset - HeaderBytes ;
+    const unsigned long long riffSize = fileOffset - 8 ;
+    const bool rf64 = riffSize > 0xffffffffULL ;
+    const unsigned int frameBytes = audioFormat.channelCount * ((audioFormat.sampleSize + 7) / 8) ;
+
+    char header[HeaderBytes] ;
+    memset(header, 0, sizeof(header)) ;
+    memcpy(header, rf64 ? "RF64" : "RIFF", 4) ;
+    put32(header + 4, rf64 ? 0xffffffffUL : riffSize) ;
+    memcpy(header + 8, "WAVE", 4) ;
+
+    char *ds64 = header + Ds64Offset ;
+    memcpy(ds64, rf64 ? "ds64" : "JUNK", 4) ;
+    put32(ds64 + 4, Ds64Bytes - 8) ;
+    if (rf64) {
+        put64(ds64 + 8, riffSize) ;
+        put64(ds64 + 16, dataSize) ;
+        put64(ds64 + 24, dataSize / frameBytes) ;
+        put32(ds64 + 32, 0) ;     // No table
+    }
+
+    char *fmt = ds64 + Ds64Bytes ;
+    memcpy(fmt, "fmt ", 4) ;
+    put32(fmt + 4, FmtBytes - 8) ;
+    put16(fmt + 8, 1) ;         // PCM
+    put16(fmt + 10, audioFormat.channelCount) ;
+    put32(fmt + 12, audioFormat.sampleRate) ;
+    put32(fmt + 16, audioFormat.sampleRate * frameBytes) ;
+    put16(fmt + 20, frameBytes) ;
+    put16(fmt + 22, audioFormat.sampleSize) ;
+
+    char *pad = header + PadOffset ;
+    memcpy(pad, "JUNK", 4) ;
+    put32(pad + 4, DataOffset - PadOffset - 8) ;
+
+    char *data = header + DataOffset ;
+    memcpy(data, "data", 4) ;
+    put32(data + 4, rf64 ? 0xffffffffUL : dataSize) ;
+
+    return writeAt(header, sizeof(header), 0) ;
+}
@@ -0,0 +1,83 @@
+#ifndef RESPEAKERWAVWRITER_H
+#define RESPEAKERWAVWRITER_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "respeakeraudioring.h"
+#include "respeakercapture.h"
+
+// Streams the audio going into a ReSpeakerAudioRing to a WAV file on a
+// thread of its own, so whoever fills the ring never waits for the disk.
+// The thread drains the ring through its own cursor into an aligned buffer
+// and writes it out WriteBlockBytes at a time at block aligned offsets; the
+// header is padded so the samples start on a block. If the disk stalls for
+// longer than the ring holds, the cursor overruns and the lost audio is
+// counted rather than holding up the capture.
+//
+// The header is written with placeholder sizes and patched on close. Past
+// 4 GB the file is turned into RF64 (EBU Tech 3306): the reserved JUNK
+// chunk after the RIFF header becomes the ds64 chunk with the real sizes.
+class ReSpeakerWavWriter
+{
+public:
+    ReSpeakerWavWriter() ;
+    ~ReSpeakerWavWriter() ;
+
+    // Starts writing the audio ring receives from now on. format describes
+    // it; the ring must outlive close(). preallocateBytes reserves that much
+    // disk up front so a long recording is not fragmented or cut short by
+    // the disk filling; the file is trimmed to what was written on close
+    bool open ( const char *path, const ReSpeakerCaptureAudioFormat &format,
+                const ReSpeakerAudioRing *ring, unsigned long long preallocateBytes = 0 ) ;
+    // Writes out what is left in the ring, patches the header and closes.
+    // Returns false if anything failed to reach the disk
+    bool close ( void ) ;
+    bool isOpen ( void ) const ;
+
+    // Sample bytes on disk so far
+    unsigned long long dataBytes ( void ) const ;
+    // Times the disk fell a whole ring behind, and the bytes lost doing so
+    unsigned int overruns ( void ) const ;
+    long long lostBytes ( void ) const ;
+    // True once a write has failed; the thread stops writing after that
+    bool failed ( void ) const ;
+
+    static const size_t WriteBlockBytes = 1 << 20 ;
+    static const size_t Alignment = 4096 ;
+    // Samples start here, one aligned block in
+    static const size_t HeaderBytes = Alignment ;
+    static const int PollIntervalMs = 20 ;
+
+private:
+    ReSpeakerWavWriter ( const ReSpeakerWavWriter & ) ;
+    ReSpeakerWavWriter &operator= ( const ReSpeakerWavWriter & ) ;
+
+    void run ( void ) ;
+    // Fill the buffer from the cursor, writing each block as it fills
+    void drain ( void ) ;
+    bool writeAt ( const char *data, size_t length, unsigned long long offset ) ;
+    bool writeHeader ( void ) ;
+
+    int fd ;
+    ReSpeakerCaptureAudioFormat audioFormat ;
+    ReSpeakerAudioRingCursor cursor ;
+    char *buffer ;
+    size_t filled ;
+    unsigned long long fileOffset ;
+
+    std::thread thread ;
+    std::mutex mutex ;
+    std::condition_variable wakeUp ;
+    bool stopping ;
+    std::atomic<unsigned long long> onDisk ;
+    std::atomic<unsigned int> overrunCount ;
+    std::atomic<long long> lost ;
+    std::atomic<bool> writeFailed ;
+};
+
+#endif // RESPEAKERWAVWRITER_H
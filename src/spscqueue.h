@@ -0,0 +1,59 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Fixed size single producer / single consumer ring buffer.
+// push() may only be called from one thread and pop() from one other thread.
+// Neither call takes a lock or allocates, so the producer can be a device
+// reader thread and the consumer a GUI or worker thread.
+template <typename T, size_t Size>
+class SpscQueue
+{
+public:
+    SpscQueue() : head(0), tail(0) { }
+
+    // Returns false if the queue is full; the value is not queued
+    bool push ( const T &value ) {
+        const size_t t = tail.load(std::memory_order_relaxed) ;
+        const size_t next = (t + 1) % Size ;
+        if (next == head.load(std::memory_order_acquire))
+            return false ;
+        items[t] = value ;
+        tail.store(next, std::memory_order_release) ;
+        return true ;
+    }
+
+    // Returns false if the queue is empty
+    bool pop ( T *value ) {
+        const size_t h = head.load(std::memory_order_relaxed) ;
+        if (h == tail.load(std::memory_order_acquire))
+            return false ;
+        *value = items[h] ;
+        head.store((h + 1) % Size, std::memory_order_release) ;
+        return true ;
+    }
+
+    bool empty ( void ) const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire) ;
+    }
+
+    // Consumer side only
+    void clear ( void ) {
+        head.store(tail.load(std::memory_order_acquire), std::memory_order_release) ;
+    }
+
+private:
+    T items[Size] ;
+    // Keep the indices on separate cache lines so producer and consumer
+    // do not bounce the same line between cores. Padding rather than
+    // alignas, which plain operator new does not honour before C++17
+    char padItems[64] ;
+    std::atomic<size_t> head ;
+    char padHead[64 - sizeof(std::atomic<size_t>)] ;
+    std::atomic<size_t> tail ;
+    char padTail[64 - sizeof(std::atomic<size_t>)] ;
+};
+
+#endif // SPSCQUEUE_H